@@ -30,35 +30,102 @@
 #define TARGET_REQ_DEBUGMSG_HEXMSG(size)	(0x01 | ((size & 0xff) << 8))
 #define TARGET_REQ_DEBUGCHAR			0x02
 
-#if defined(__ARM_ARCH_7M__) || defined(__ARM_ARCH_7EM__) || defined(__ARM_ARCH_6SM__)
+#if defined(__ARM_ARCH_7M__) || defined(__ARM_ARCH_7EM__) || defined(__ARM_ARCH_6SM__) \
+    || defined(DCRDR)
 
 /* we use the System Control Block DCRDR reg to simulate a arm7_9 dcc channel
  * DCRDR[7:0] is used by target for status
  * DCRDR[15:8] is used by target for write buffer
  * DCRDR[23:16] is used for by host for status
- * DCRDR[31:24] is used for by host for write buffer */
+ * DCRDR[31:24] is used for by host for write buffer
+ * (a native build may define DCRDR and DHCSR to stand in for the debugger) */
 
+#ifndef DCRDR
 #define DCRDR		(*((volatile uint16_t *)0xE000EDF8))
+#endif
+#ifndef DHCSR
+#define DHCSR		(*((volatile uint32_t *)0xE000EDF0))
+#endif
 
 #define	BUSY	1
+#define	C_DEBUGEN	1  /* DHCSR bit set while a debugger is attached */
+
+DCCStats DCCstats;
+
+static unsigned spinEstimate = DCCminSpin << 4;  //polls the host takes, <<4
+static systime_t sleepEstimate = 1;  //tics of the last sleep that sufficed
+static systime_t spinTick;           //tic whose polling allowance is spent
+static halrtcnt_t spunInTick;        //CPU cycles spent polling during it
+
+#define spinAllowance  (halGetCounterFrequency() / CH_FREQUENCY / DCCspinShare)
 
 
 static void awaitReady(void)
 /*
   poll for data ready
-  after DCCmaxBusy ticks, poll only once every DCCbusyDelay tics
+  poll for twice as many polls as the host has lately taken to take a
+  byte, but for no more than 1/DCCspinShare of each tic, sleeping out the
+  rest of the tic once that is spent, so that a fast host is sent a batch
+  of words per wakeup and the idle thread gets the remainder
+  if the host takes longer than the polls allowed, sleep between polls,
+  starting from half the last sleep that sufficed and doubling up to
+  DCCbusyDelay
+  poll longer when the shortest sleep sufficed, less when it did not
+  return at once if no debugger is attached, as none will take the data
 */
 {
-  if (DCRDR & BUSY) {
-    systime_t wtStart = chTimeNow();
-    while (DCRDR & BUSY)
-      if (chTimeNow()-wtStart >= DCCmaxBusy) { //busy wait for first few seconds
-        do  //but, if the host is not responding...
-          chThdSleep(DCCbusyDelay);  //sleep between each poll of the BUSY bit
-        while (DCRDR & BUSY);
-        break;
-      }
+  if (!(DCRDR & BUSY))
+    return;
+  if (!(DHCSR & C_DEBUGEN)) {
+    DCCstats.detached++;
+    return;
+  }
+  unsigned polls = 0, budget = (spinEstimate >> 3) + DCCminSpin;
+  if (budget > DCCmaxSpin)
+    budget = DCCmaxSpin;
+  for (;;) {
+    systime_t tick = chTimeNow();
+    if (tick != spinTick) {
+      spinTick = tick;
+      spunInTick = 0;
+    }
+    halrtcnt_t start = halGetCounterValue(), spun;
+    bool_t ready;
+    do {
+      polls++;
+      ready = !(DCRDR & BUSY);
+      spun = halGetCounterValue() - start;
+    } while (!ready && polls < budget && spunInTick + spun < spinAllowance);
+    spunInTick += spun;
+    DCCstats.spinCycles += spun;
+    if (ready) {  //adapt to how quickly the host takes bytes
+      DCCstats.spins += polls;
+      spinEstimate += ((int)(polls << 4) - (int)spinEstimate) / 8;
+      sleepEstimate = 1;
+      return;
+    }
+    if (polls >= budget)  //the host is slower than the polls allowed
+      break;
+    chThdSleep(1);  //this tic's polling is spent
+    DCCstats.sleeps++;
+    DCCstats.slept++;
   }
+  DCCstats.spins += polls;
+  systime_t delay = sleepEstimate;
+  for (;;) {
+    chThdSleep(delay);
+    DCCstats.sleeps++;
+    DCCstats.slept += delay;
+    if (!(DCRDR & BUSY) || !(DHCSR & C_DEBUGEN))
+      break;
+    if ((delay *= 2) > DCCbusyDelay)
+      delay = DCCbusyDelay;
+  }
+  if (delay == 1)  //the host was only a little slower than the polls
+    spinEstimate = budget << 4;  //so poll twice as long next time
+  else  //the host is slow, poll less next time
+    spinEstimate -= spinEstimate / 4;
+  sleepEstimate = delay > 1 ? delay / 2 : 1;
 }
 
 static void DCCwrite(uint32_t dcc_data)
@@ -125,6 +192,49 @@ static void DCCwriteBytes(int type, const uint8_t *umsg, size_t len)
 }
 
 
+static const uint8_t *DCCwriteWords(const uint8_t *umsg, size_t *len)
+{
+  while (*len >= 4) {
+    DCCwrite((uint32_t)(umsg[0])     | (uint32_t)(umsg[1])<<8
+           | (uint32_t)(umsg[2])<<16 | (uint32_t)(umsg[3])<<24);
+    umsg += 4;
+    *len -= 4;
+  }
+  return umsg;
+}
+
+static void DCCwriteSpans(uint32_t header,
+                          const uint8_t *first, size_t firstLen,
+                          const uint8_t *second, size_t secondLen)
+{
+  uint32_t dcc_data = 0;
+  unsigned shift = 0;
+  DCCwrite(header);
+
+  first = DCCwriteWords(first, &firstLen);
+  while (firstLen--) {  //join the first span's last bytes to the second's
+    dcc_data |= (uint32_t)*first++ << shift;
+    shift += 8;
+  }
+  if (shift) {
+    while (shift < 32 && secondLen) {
+      dcc_data |= (uint32_t)*second++ << shift;
+      shift += 8;
+      --secondLen;
+    }
+    DCCwrite(dcc_data);
+    dcc_data = shift = 0;
+  }
+  second = DCCwriteWords(second, &secondLen);
+  while (secondLen--) {
+    dcc_data |= (uint32_t)*second++ << shift;
+    shift += 8;
+  }
+  if (shift)
+    DCCwrite(dcc_data);
+}
+
+
 void DCCtracePoint(uint32_t number)
 {
   DCCwrite(TARGET_REQ_TRACEMSG | (number << 8));
@@ -170,6 +280,22 @@ void DCCputs(const char *msg)
   DCCwriteBytes(TARGET_REQ_DEBUGMSG_ASCII, (const uint8_t *)msg, len);
 }
 
+void DCCputsSpans(const uint8_t *first, size_t firstLen,
+                  const uint8_t *second, size_t secondLen)
+{
+  size_t len = firstLen + secondLen;
+  DCCwriteSpans(((uint32_t)len << 16) | TARGET_REQ_DEBUGMSG_ASCII,
+                first, firstLen, second, secondLen);
+}
+
+void DCCputU32Spans(const uint8_t *first, size_t firstLen,
+                    const uint8_t *second, size_t secondLen)
+{
+  size_t len = (firstLen + secondLen) / 4;
+  DCCwriteSpans(TARGET_REQ_DEBUGMSG_HEXMSG(4) | (((uint32_t)len & 0xffff) << 16),
+                first, firstLen, second, secondLen);
+}
+
 void DCCputc(const int msg)
 {
   DCCwrite(TARGET_REQ_DEBUGCHAR | ((uint32_t)(uint8_t)msg) << 16);
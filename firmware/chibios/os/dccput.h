@@ -25,6 +25,7 @@
 #define DCCPUT_H
 
 #include "ch.h"
+#include "hal.h"
 
 void DCCputU32(const uint32_t *val, size_t len);
 void DCCputU16(const uint16_t *val, size_t len);
@@ -33,8 +34,23 @@ void DCCputByte(const uint8_t *val, size_t len);
 void DCCputs(const char *msg);
 void DCCputc(const int msg);
 
-#define DCCmaxBusy    S2ST(5)     //max # of tics to busy wait
-#define DCCbusyDelay  MS2ST(200)  //tics to wait between retries after maxBusy
+#define DCCminSpin    16          //fewest polls before sleeping
+#define DCCmaxSpin    1024        //most polls before sleeping
+#define DCCspinShare  4           //poll for at most 1/DCCspinShare of a tic
+#define DCCbusyDelay  MS2ST(200)  //longest sleep between polls
+
+/*
+  How long the debugger took to take each byte written
+*/
+typedef struct {
+  unsigned   spins;       //polls of the BUSY bit
+  halrtcnt_t spinCycles;  //CPU cycles spent in them
+  unsigned   sleeps;      //sleeps awaiting the debugger
+  systime_t  slept;       //tics spent in them
+  unsigned   detached;    //bytes written with no debugger attached
+} DCCStats;
+
+extern DCCStats DCCstats;
 
 /*
   like DCCputs, but uses the DDCfetcher function to retrieve each
@@ -44,4 +60,15 @@ typedef uint8_t (*DDCfetcher)(void *link);
 
 void DCCputsQ(DDCfetcher fetch, void *link, size_t len);
 
+/*
+  like DCCputs and DCCputU32, but for a message split in two spans,
+  as by wrapping around the end of a ring buffer.  Each is output
+  straight from memory, a word at a time.
+  DCCputU32Spans' words are little endian, and its lengths in bytes.
+*/
+void DCCputsSpans(const uint8_t *first, size_t firstLen,
+                  const uint8_t *second, size_t secondLen);
+void DCCputU32Spans(const uint8_t *first, size_t firstLen,
+                    const uint8_t *second, size_t secondLen);
+
 #endif /* DCCPUT_H */
@@ -8,7 +8,20 @@
 *  Data printed to the queue when full are discarded
 *  (Never blocks waiting for the host)
 *
-*  Does not support output from interrupt handlers
+*  The reader outputs each record's data straight from the ring, in at
+*  most two spans, then zeroes and releases the whole record at once.
+*
+*  Producers reserve space in the queue with an atomic compare and swap,
+*  never taking a lock or calling the kernel, so threads and interrupt
+*  handlers may output concurrently.  The reader polls for committed
+*  records, so output may lag by a tick.  Waking the reader instead
+*  would take a kernel lock, which producers avoid.
+*
+*  The reader passes each record to the selected transport (debugDCC
+*  by default).  debugtransport.c provides the others.
+*
+*  debugLog() leaves formatting to the host, queuing only the address
+*  of its format and the raw words of its arguments.
 *
 *  Any ChibiOS panic messages are output to the host
 *
@@ -22,44 +35,107 @@
 
 #include "dccput.h"
 
+/*
+ * debugOutput is a ring of variable length records, each with a header:
+ *   state -- recordFree until the record is committed
+ *   len   -- # of bytes of data following the header
+ *   pad   -- # of unused bytes reserved after the data
+ *
+ * Positions in the ring count bytes from debugPutInit() and wrap around
+ * at 2^32, so the ring's size must be a power of two.
+ *
+ * Producers reserve space by atomically advancing reserved, fill it,
+ * then commit the record by setting its state last.  The reader waits for
+ * the oldest record to be committed, outputs it, then zeroes its bytes
+ * before advancing released to hand them back.  The ring's free space is
+ * thus always zero, so an uncommitted record never appears committed.
+ */
+#define recordHdr   3
+#define recordFree  0
+#define recordText  1  /* len characters output as a line */
+#define recordChar  2  /* a single character output as is */
+#define recordSkip  3  /* a rolled back message */
+#define recordWords 4  /* len/4 words output as a hex message */
+
+static uint8_t *ring;
+static uint32_t ringMask;           //ring's size - 1
+static volatile uint32_t reserved;  //bytes ever reserved by producers
+static volatile uint32_t released;  //bytes ever released by the reader
+static volatile unsigned dropped;   //messages discarded
+
 /*
  * Small working area for the debug output thread
  */
-static Thread *debugReader;
 static WORKING_AREA(debugReaderArea, 128);
-static OutputQueue debugOutQ;
-static MUTEX_DECL(debugOutLock);
 
-static void resumeReader(void)
+#define debugReaderPoll  1  /* ticks the reader sleeps when idle */
+
+const DebugTransport debugDCC = {DCCputsSpans, DCCputU32Spans, DCCputc};
+
+static const DebugTransport *volatile transport = &debugDCC;
+
+static uint8_t *at(uint32_t pos)
+{
+  return ring + (pos & ringMask);
+}
+
+
+static void clear(uint32_t pos, size_t n)
 /*
-  called whenever debug data is written
-  to resume the queue reader
+  zero n bytes of the ring at pos
 */
 {
-  chSysLock();
-  if(debugReader->p_state == THD_STATE_WTQUEUE)
-    chSchWakeupS(debugReader, 0);
-  chSysUnlock();
+  size_t tail = ringMask+1 - (pos & ringMask);
+  if (n <= tail)
+    memset(at(pos), 0, n);
+  else{
+    memset(at(pos), 0, tail);
+    memset(ring, 0, n-tail);
+  }
 }
 
 
-static uint8_t fetcher(void *outQ)
+static uint32_t reserve(size_t min, size_t max, size_t *got)
 /*
-  return next byte in queue
-  block if empty
+  atomically reserve at least min and at most max bytes of free space
+  returns position of space and # of bytes reserved in *got
+  *got is zero if fewer than min bytes are free
 */
 {
-  OutputQueue *q = outQ;
-  msg_t b;
-  chSysLock();
-  while((b = chOQGetI(q)) == Q_EMPTY)
-    chSchGoSleepS(THD_STATE_WTQUEUE);
-  chSysUnlock();
-  return b;
+  uint32_t head;
+  size_t n = 0;
+  do {
+    head = reserved;
+    size_t space = ringMask+1 - (head - released);
+    if (space < min) {
+      if (head == reserved) {
+        __sync_fetch_and_add(&dropped, 1);
+        *got = 0;
+        return head;
+      }
+      continue;  //another producer raced with us
+    }
+    n = space < max ? space : max;
+  } while (!__sync_bool_compare_and_swap(&reserved, head, head+n));
+  *got = n;
+  return head;
 }
 
+
+static void commit(uint32_t pos, unsigned state, size_t len, size_t pad)
 /*
- * This thread empties the debug output queue
+  make the record at pos visible to the reader
+*/
+{
+  *at(pos+1) = len;
+  *at(pos+2) = pad;
+  __sync_synchronize();  //data and header before state
+  *at(pos) = state;
+}
+
+
+/*
+ * This thread empties the debug output ring
  */
 __attribute__((noreturn))
 static msg_t debugReaderMain(void *arg)
@@ -67,25 +143,86 @@ static msg_t debugReaderMain(void *arg)
   (void) arg;
   chRegSetThreadName("debugQreader");
   while (TRUE) {
-    size_t len = fetcher(&debugOutQ);
-    if (len)
-      DCCputsQ(fetcher, &debugOutQ, len);
-    else
-      DCCputc(fetcher(&debugOutQ));
+    uint32_t pos = released;
+    unsigned state;
+    if (pos == reserved || (state = *at(pos)) == recordFree) {
+      chThdSleep(debugReaderPoll);
+      continue;
+    }
+    __sync_synchronize();  //state before the rest of the record
+    size_t len = *at(pos+1);
+    uint32_t data = pos + recordHdr;
+    uint32_t end = data + len + *at(pos+2);
+    size_t first = ringMask+1 - (data & ringMask);  //bytes before the wrap
+    if (first > len)
+      first = len;
+    const DebugTransport *out = transport;
+    switch (state) {  //output the data straight from the ring
+      case recordText:
+        out->text(at(data), first, ring, len-first);
+        break;
+      case recordChar:
+        out->chr(*at(data));
+        break;
+      case recordWords:
+        out->words(at(data), first, ring, len-first);
+    }
+    clear(pos, end - pos);
+    __sync_synchronize();  //zeroes before release
+    released = end;
   }
 }
 
 
 Thread *debugPutInit(char *outq, size_t outqSize)
 /*
-  allocate output queue of outqSize bytes and start background thread
+  allocate output ring of outqSize bytes and start background thread
+  outqSize is rounded down to a power of two
   return background thread
 */
 {
-  chOQInit(&debugOutQ, (uint8_t *)outq, outqSize, NULL, NULL);
-  return debugReader =
-    chThdCreateStatic(debugReaderArea, sizeof(debugReaderArea),
-                          LOWPRIO, debugReaderMain, NULL);
+  while (outqSize & (outqSize-1))
+    outqSize &= outqSize-1;
+  ring = (uint8_t *)outq;
+  ringMask = outqSize-1;
+  memset(ring, 0, outqSize);
+  reserved = released = 0;
+  dropped = 0;
+  return chThdCreateStatic(debugReaderArea, sizeof(debugReaderArea),
+                           LOWPRIO, debugReaderMain, NULL);
+}
+
+
+void debugTransport(const DebugTransport *newTransport)
+/*
+  send records not yet output via transport
+*/
+{
+  transport = newTransport;
+}
+
+
+unsigned debugDropped(void)
+/*
+  returns # of messages discarded because the output ring was full
+*/
+{
+  return dropped;
+}
+
+
+static void put(uint32_t pos, const uint8_t *block, size_t n)
+/*
+  copy n bytes to the ring at pos
+*/
+{
+  size_t tail = ringMask+1 - (pos & ringMask);
+  if (n <= tail)
+    memcpy(at(pos), block, n);
+  else{
+    memcpy(at(pos), block, tail);
+    memcpy(ring, block+tail, n-tail);
+  }
 }
 
 
@@ -94,14 +231,12 @@ int debugPutc(int c)
   returns -1 if output fails
 */
 {
-  chMtxLock(&debugOutLock);
-  if (chOQGetEmptyI(&debugOutQ) > 1) {
-    chOQPutTimeout( &debugOutQ, 0, TIME_IMMEDIATE);
-    chOQPutTimeout( &debugOutQ, c, TIME_IMMEDIATE);
-  }else
-    c = -1;
-  resumeReader();
-  chMtxUnlock();
+  size_t got;
+  uint32_t pos = reserve(recordHdr+1, recordHdr+1, &got);
+  if (!got)
+    return -1;
+  *at(pos+recordHdr) = c;
+  commit(pos, recordChar, 1, 0);
   return c;
 }
 
@@ -109,26 +244,20 @@ int debugPutc(int c)
 size_t debugPut(const uint8_t *block, size_t n)
 /*
   truncate any block > 255 bytes
+  discards any block that would overflow the output queue
   returns # of characters actually output (including the trailing newline)
 */
 {
   if (n) {
-    chMtxLock(&debugOutLock);
-    size_t space = chOQGetEmptyI(&debugOutQ);
-    if (space) {
-      if (n >= space)
-        n = space - 1;
-      if (n) {
-        if (n > 255)
-          n = 255;
-        chOQPutTimeout( &debugOutQ, n, TIME_IMMEDIATE);
-        chOQWriteTimeout( &debugOutQ, block, n, TIME_IMMEDIATE);
-        resumeReader();
-        n++;
-      }
-    }else
-      n = 0;
-    chMtxUnlock();
+    if (n > 255)
+      n = 255;
+    size_t got;
+    uint32_t pos = reserve(recordHdr+n, recordHdr+n, &got);
+    if (!got)
+      return 0;
+    put(pos+recordHdr, block, n);
+    commit(pos, recordText, n, 0);
+    n++;
   }else
     if (debugPutc('\n') >= 0)
       n = 1;
@@ -141,84 +270,94 @@ size_t debugPuts(const char *str)
 }
 
 
-#if debugPrintBufSize < 0
 /*
   printf like debug messages to host via ARM DCC
-  RAM is precious, so we expand the printf string twice;
-  once to determine its length and again to queue it.
+  RAM is precious, so each message is formatted in place, straight into
+  space reserved in the ring after its record's header.  Unused space is
+  then returned if no other producer has reserved space since, otherwise
+  it becomes the record's pad.  A message that overflows the ring is
+  rolled back, or, failing that, committed as a record to be skipped.
 */
 
-struct NullStreamVMT {
+struct qStreamVMT {
    _base_sequential_stream_methods
 };
 
 typedef struct  {
-  const struct NullStreamVMT *vmt;
-  size_t  len;
-} NullStream;
-
-static size_t nullWrites(void *ip, const uint8_t *bp, size_t n) {
-  NullStream *nsp = ip;
-  (void)bp;
-  if (-debugPrintBufSize - nsp->len < n)
-    n = -debugPrintBufSize - nsp->len;
-  nsp->len += n;
-  return n;
-}
+  const struct qStreamVMT *vmt;
+  uint32_t pos;     //next reserved byte
+  size_t  len;      //bytes written
+  size_t  max;      //longest message
+  size_t  space;    //bytes reserved
+} qStream;
 
-static size_t nullReads(void *ip, uint8_t *bp, size_t n) {
-  (void)ip; (void) bp; (void) n;
-  return RDY_RESET;
+static size_t qwrites(void *ip, const uint8_t *bp, size_t n) {
+  qStream *qsp = ip;
+  if (n > qsp->max - qsp->len)
+    n = qsp->max - qsp->len;  //truncate long message
+  qsp->len += n;
+  if (qsp->len > qsp->space)  //overflowed ring
+    return 0;
+  put(qsp->pos, bp, n);
+  qsp->pos += n;
+  return n;
 }
 
-static msg_t nullPut(void *ip, uint8_t b) {
-  NullStream *nsp = ip;
-  (void)b;
-  if (nsp->len >= -debugPrintBufSize)
+static msg_t qput(void *ip, uint8_t b) {
+  qStream *qsp = ip;
+  if (qsp->len >= qsp->max || ++qsp->len > qsp->space)
     return RDY_RESET;
-  nsp->len++;
+  *at(qsp->pos++) = b;
   return RDY_OK;
 }
 
-static msg_t nullGet(void *ip) {
+static size_t qreads(void *ip, uint8_t *bp, size_t n) {
+  (void)ip; (void) bp; (void) n;
+  return 0;
+}
+
+static msg_t qget(void *ip) {
   (void)ip;
   return RDY_RESET;
 }
 
-static const struct NullStreamVMT nullVmt =
-  {nullWrites, nullReads, nullPut, nullGet};
+static const struct qStreamVMT qVmt = {qwrites, qreads, qput, qget};
 
 
-struct qStreamVMT {
-   _base_sequential_stream_methods
-};
-
-
-typedef struct  {
-  const struct qStreamVMT *vmt;
-  size_t  space;
-} qStream;
-
-
-static size_t qwrites(void *ip, const uint8_t *bp, size_t n) {
-  qStream *qsp = ip;
-  if (n > qsp->space)
-    n = qsp->space;
-  qsp->space -= n;
-  chOQWriteTimeout( &debugOutQ, bp, n, TIME_IMMEDIATE);
-  return n;
+static size_t shrink(uint32_t pos, size_t got, size_t used)
+/*
+  return the last got-used of got bytes reserved at pos if still possible
+  returns # of bytes that remain reserved beyond those used
+*/
+{
+  return __sync_bool_compare_and_swap(&reserved, pos+got, pos+used) ?
+    0 : got-used;
 }
 
-static msg_t qput(void *ip, uint8_t b) {
-  qStream *qsp = ip;
-  if (!qsp->space)
-    return RDY_RESET;
-  --qsp->space;
-  chOQPutTimeout( &debugOutQ, b, TIME_IMMEDIATE);
-  return RDY_OK;
+
+static size_t finish(uint32_t pos, size_t got, const qStream *msg,
+                     unsigned state)
+/*
+  commit msg written into the got bytes reserved at pos
+  rolling it back if it overflowed
+  returns length of msg or 0 if it was rolled back
+*/
+{
+  size_t len = msg->len;
+  if (len > msg->space) {  //roll back message that overflowed
+    clear(pos+recordHdr, msg->space);
+    size_t pad = shrink(pos, got, 0);
+    if (pad)
+      commit(pos, recordSkip, 0, pad-recordHdr);
+    __sync_fetch_and_add(&dropped, 1);
+    return 0;
+  }
+  commit(pos, state, len, shrink(pos, got, recordHdr+len));
+  return len;
 }
 
-static const struct qStreamVMT qVmt = {qwrites, nullReads, qput, nullGet};
+#if debugPrintBinary
+#elif debugPrintBufSize < 0
 
 
 size_t debugPrint(const char *fmt, ...)
@@ -227,34 +366,23 @@ size_t debugPrint(const char *fmt, ...)
   outputs a trailing newline
 */
 {
+  size_t max = -debugPrintBufSize < 255 ? -debugPrintBufSize : 255;
+  size_t got;
+  uint32_t pos = reserve(recordHdr+1, recordHdr+max, &got);
+  if (!got)
+    return 0;
+  qStream dbgStream = {&qVmt, pos+recordHdr, 0, max, got-recordHdr};
   va_list ap;
   va_start(ap, fmt);
-  NullStream lenStream = {&nullVmt, 0};
-  chvprintf((BaseSequentialStream *) &lenStream, fmt, ap);
-  size_t len = lenStream.len;
-  if (len) {
-    chMtxLock(&debugOutLock);
-    size_t qspace = chOQGetEmptyI(&debugOutQ);
-    if (qspace) {
-      if (len >= qspace)
-        len = qspace - 1;  //truncate string if it won't fit in queue
-      if (len) {
-        if (len > 255)
-          len = 255;
-        qStream dbgStream = {&qVmt, len};
-        chOQPutTimeout(&debugOutQ, len, TIME_IMMEDIATE);
-        chvprintf((BaseSequentialStream *) &dbgStream, fmt, ap);
-        resumeReader();
-        len++;
-      }
-    }else
-      len=0;
-    chMtxUnlock();
-  }else
-    if (debugPutc('\n') >= 0)
-      len=1;
+  chvprintf((BaseSequentialStream *) &dbgStream, fmt, ap);
   va_end(ap);
-  return len;
+  if (!dbgStream.len) {
+    *at(pos+recordHdr) = '\n';
+    dbgStream.len = 1;
+    return finish(pos, got, &dbgStream, recordChar);
+  }
+  size_t len = finish(pos, got, &dbgStream, recordText);
+  return len ? len+1 : 0;
 }
 
 #elif debugPrintBufSize > 0  //use global buffer to avoid expanding printf twice
@@ -283,6 +411,62 @@ size_t debugPrint(const char *fmt, ...)
 #endif
 
 
+static void pack(qStream *msg, uint32_t word)
+{
+  qwrites(msg, (const uint8_t *)&word, sizeof word);
+}
+
+size_t debugLog(const char *fmt, ...)
+/*
+  printf style debugging output, formatted by the host
+  outputs fmt's address followed by the raw words of its arguments
+  as a DCC hex message.  %s arguments are copied as their length
+  followed by their characters.  The host finds fmt in the ELF file.
+  discards any message that would overflow the output queue or 252 bytes
+  returns # of bytes actually output
+*/
+{
+  size_t got;
+  uint32_t pos = reserve(recordHdr+4, recordHdr+252, &got);
+  if (!got)
+    return 0;
+  size_t space = (got-recordHdr) & ~3;
+  qStream msg = {&qVmt, pos+recordHdr, 0, 255, space};
+  pack(&msg, (uint32_t)(uintptr_t)fmt);
+  va_list ap;
+  va_start(ap, fmt);
+  char c;
+  while ((c = *fmt++))  //the arguments of each chprintf() conversion
+    if (c == '%')
+      while ((c = *fmt)) {
+        fmt++;
+        if (c == '*')
+          pack(&msg, va_arg(ap, int));
+        else if (c == 's') {
+          const char *str = va_arg(ap, const char *);
+          size_t len = strlen(str);
+          static const uint8_t zeros[3];
+          pack(&msg, len);
+          qwrites(&msg, (const uint8_t *)str, len);
+          qwrites(&msg, zeros, -len & 3);
+          break;
+        }else if (c == 'f') {
+          union {double d; uint32_t w[2];} f = {va_arg(ap, double)};
+          pack(&msg, f.w[0]);
+          pack(&msg, f.w[1]);
+          break;
+        }else if (c == '%')
+          break;
+        else if ((c|' ') >= 'a' && (c|' ') <= 'z' && (c|' ') != 'l') {
+          pack(&msg, va_arg(ap, uint32_t));
+          break;
+        }
+      }
+  va_end(ap);
+  return finish(pos, got, &msg, recordWords);
+}
+
+
 void logPanic(const char *panicTxt)
 /*
   intended to be called from the SYSTEM_HALT_HOOK
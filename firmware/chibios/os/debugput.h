@@ -8,7 +8,13 @@
 *  Data printed to the queue when full are discarded
 *  (Never blocks waiting for the host)
 *
-*  Does not support output from interrupt handlers
+*  The thread polls the queue, so it wakes every tick even when idle.
+*  That costs two context switches and a check of the queue per tick
+*  (a few hundred cycles, so roughly 0.1% of the CPU at 32MHz and
+*  CH_FREQUENCY 100).
+*
+*  Threads and interrupt handlers may output concurrently
+*  (debugPrint() from interrupt handlers only if debugPrintBufSize < 0)
 *
 *  Any ChibiOS panic messages are output to the host
 *
@@ -32,12 +38,18 @@
 
 //max length of debugPrint() string.
 //0 omits debugPrint() entirely
-//<0 avoids allocation of global buffer by evaluating printf twice
+//<0 avoids allocation of global buffer by formatting in place in the queue
+//>0 serializes debugPrint() with a mutex, so not from interrupt handlers
 #define debugPrintBufSize -250
 
+//nonzero makes debugPrint() a synonym for debugLog(),
+//leaving its messages to be formatted by the host (zev/host/debuglog.c)
+#define debugPrintBinary  0
+
 Thread *debugPutInit(char *outq, size_t outqSize);
 /*
-  allocate output queue of outqSize bytes and start background thread
+  allocate output ring of outqSize bytes and start background thread
+  outqSize is rounded down to a power of two
   return background thread
 */
 
@@ -51,16 +63,69 @@ int debugPutc(int c);
 size_t debugPut(const uint8_t *block, size_t n);
 /*
   truncate any block > 255 bytes
+  discards any block that would overflow the output queue
   returns # of characters actually output (including the trailing newline)
 */
 
 size_t debugPuts(const char *str);
 
-#if debugPrintBufSize
+unsigned debugDropped(void);
+/*
+  returns # of messages discarded because the output ring was full
+*/
+
+/*
+ * The reader thread passes each record's data to a transport as the spans
+ * before and after the ring wraps.  Only the reader calls a transport.
+ */
+typedef void debugSpans(const uint8_t *first, size_t firstLen,
+                        const uint8_t *second, size_t secondLen);
+
+typedef struct {
+  debugSpans *text;       //a line of text, without its newline
+  debugSpans *words;      //debugLog() message of little endian words
+  void (*chr)(const int c);
+} DebugTransport;
+
+extern const DebugTransport debugDCC;     //ARM DCC to openocd (the default)
+extern const DebugTransport debugStream;  //text to debugStreamInit()'s stream
+extern const DebugTransport debugRAM;     //text to debugRAMInit()'s ring
+
+void debugTransport(const DebugTransport *transport);
+/*
+  send records not yet output via transport
+*/
+
+void debugStreamInit(BaseSequentialStream *out);
+/*
+  send lines, with debugLog() messages as lines of hex words,
+  to out via debugStream
+*/
+
+void debugRAMInit(char *ring, size_t size);
+/*
+  keep the latest text output via debugRAM in ring for gdb's debuglog
+  size is rounded down to a power of two
+*/
+
+size_t debugLog(const char *fmt, ...);
+/*
+  printf style debugging output, formatted by the host
+  outputs fmt's address followed by the raw words of its arguments
+  as a DCC hex message.  %s arguments are copied as their length
+  followed by their characters.  The host finds fmt in the ELF file.
+  discards any message that would overflow the output queue or 252 bytes
+  returns # of bytes actually output
+*/
+
+#if debugPrintBinary
+#define debugPrint  debugLog
+#elif debugPrintBufSize
 size_t debugPrint(const char *fmt, ...);
 /*
   printf style debugging output
   outputs a trailing newline
+  discards any message that would overflow the output queue
   returns # of characters actually output (including the trailing newline)
 */
 #endif
@@ -0,0 +1,158 @@
+/**********************  debugtransport.c  ************************
+*
+*  Debug output transports other than ARM DCC (see debugput.h)
+*
+*  debugStream writes each line, terminated by CR LF, to a sequential
+*  stream, such as a serial port.  It blocks the reader thread, never
+*  the producers, while the stream is busy.
+*
+*  debugRAM keeps the latest text output in a RAM ring, for gdb's
+*  debuglog command (stm32l-discovery/cmds.gdb) to read out without
+*  the target's help.  debugRAMhead counts every byte ever written,
+*  so the ring holds the last debugRAMsize of them.
+*
+*  A transport selected before its Init() outputs nothing.
+*
+*  Both output debugLog() messages as a line of 8 digit hex words,
+*  which zev/host/debuglog.c formats as it does those in a console capture.
+*
+***************************************************************/
+
+#include "debugput.h"
+
+#include <string.h>
+
+static BaseSequentialStream *stream;
+
+char *debugRAMbuf;
+size_t debugRAMsize;
+volatile uint32_t debugRAMhead;
+
+
+static void hexWords(void (*write)(const uint8_t *data, size_t n),
+                     const uint8_t *first, size_t firstLen,
+                     const uint8_t *second, size_t secondLen)
+/*
+  write the little endian words in the spans as 8 hex digits each,
+  followed by a space
+*/
+{
+  static const char hex[] = "0123456789abcdef";
+  size_t i, len = firstLen + secondLen;
+  for (i = 0; i < len; i += 4) {
+    uint8_t word[9];
+    unsigned j;
+    for (j = 0; j < 4; j++) {
+      size_t k = i+3-j;
+      uint8_t b = k < firstLen ? first[k] : second[k-firstLen];
+      word[2*j] = hex[b >> 4];
+      word[2*j+1] = hex[b & 15];
+    }
+    word[8] = ' ';
+    write(word, sizeof word);
+  }
+}
+
+
+static void streamWrite(const uint8_t *data, size_t n)
+{
+  if (n)
+    chSequentialStreamWrite(stream, data, n);
+}
+
+static void streamText(const uint8_t *first, size_t firstLen,
+                       const uint8_t *second, size_t secondLen)
+{
+  if (stream) {
+    streamWrite(first, firstLen);
+    streamWrite(second, secondLen);
+    streamWrite((const uint8_t *)"\r\n", 2);
+  }
+}
+
+static void streamWords(const uint8_t *first, size_t firstLen,
+                        const uint8_t *second, size_t secondLen)
+{
+  if (stream) {
+    hexWords(streamWrite, first, firstLen, second, secondLen);
+    streamWrite((const uint8_t *)"\r\n", 2);
+  }
+}
+
+static void streamChar(const int c)
+{
+  if (stream)
+    chSequentialStreamPut(stream, c);
+}
+
+const DebugTransport debugStream = {streamText, streamWords, streamChar};
+
+void debugStreamInit(BaseSequentialStream *out)
+/*
+  send lines, with debugLog() messages as lines of hex words,
+  to out via debugStream
+*/
+{
+  stream = out;
+}
+
+
+static void ramWrite(const uint8_t *data, size_t n)
+{
+  if (!debugRAMsize)
+    return;
+  uint32_t head = debugRAMhead;
+  size_t offset = head & (debugRAMsize-1);
+  size_t tail = debugRAMsize - offset;
+  if (n > debugRAMsize) {  //only the last of it fits
+    data += n - debugRAMsize;
+    head += n - debugRAMsize;
+    n = debugRAMsize;
+    offset = head & (debugRAMsize-1);
+    tail = debugRAMsize - offset;
+  }
+  if (n <= tail)
+    memcpy(debugRAMbuf+offset, data, n);
+  else{
+    memcpy(debugRAMbuf+offset, data, tail);
+    memcpy(debugRAMbuf, data+tail, n-tail);
+  }
+  debugRAMhead = head + n;
+}
+
+static void ramText(const uint8_t *first, size_t firstLen,
+                    const uint8_t *second, size_t secondLen)
+{
+  ramWrite(first, firstLen);
+  ramWrite(second, secondLen);
+  ramWrite((const uint8_t *)"\n", 1);
+}
+
+static void ramWords(const uint8_t *first, size_t firstLen,
+                     const uint8_t *second, size_t secondLen)
+{
+  hexWords(ramWrite, first, firstLen, second, secondLen);
+  ramWrite((const uint8_t *)"\n", 1);
+}
+
+static void ramChar(const int c)
+{
+  uint8_t b = c;
+  ramWrite(&b, 1);
+}
+
+const DebugTransport debugRAM = {ramText, ramWords, ramChar};
+
+void debugRAMInit(char *ring, size_t size)
+/*
+  keep the latest text output via debugRAM in ring for gdb's debuglog
+  size is rounded down to a power of two
+*/
+{
+  while (size & (size-1))
+    size &= size-1;
+  memset(ring, 0, size);
+  debugRAMbuf = ring;
+  debugRAMsize = size;
+  debugRAMhead = 0;
+}
@@ -0,0 +1,92 @@
+/**********************  accum.c  ************************
+*
+*  Per channel accumulation of the interleaved ADC sample buffer
+*
+*  A single pass over the buffer keeps all six channel sums in registers.
+*  The current differential needs no pass of its own, because
+*    sum(Vcc/2 - sense) == sum(Vcc/2) - sum(sense)
+*  exactly in integer arithmetic.
+*
+*  The scalar version processes rows in pairs to halve the loop overhead.
+*
+*  The SWAR version loads each row as three 32 bit words, each holding
+*  the 16 bit samples of two adjacent channels, and adds whole words.
+*  The low lane carries into the high lane once it exceeds 16 bits, so
+*  lanes are widened into 32 bit sums every SWARspan rows, before that
+*  can happen.
+*
+***************************************************************/
+
+#include "accum.h"
+
+#if ADCchannels != 6
+#error  accumulateScalar() and accumulateSWAR() are unrolled for exactly six channels
+#endif
+
+void accumulateScalar(ChannelSums *sums,
+                      const adcsample_t *row, size_t depth)
+/*
+  sum depth rows of interleaved samples
+  every sample is read exactly once
+*/
+{
+  uint32_t s0 = 0, s1 = 0, s2 = 0, s3 = 0, s4 = 0, s5 = 0;
+  const adcsample_t *end = row + depth*ADCchannels;
+  if (depth & 1) {
+    s0 = row[0]; s1 = row[1]; s2 = row[2];
+    s3 = row[3]; s4 = row[4]; s5 = row[5];
+    row += ADCchannels;
+  }
+  while (row < end) {
+    s0 += row[0] + row[6];
+    s1 += row[1] + row[7];
+    s2 += row[2] + row[8];
+    s3 += row[3] + row[9];
+    s4 += row[4] + row[10];
+    s5 += row[5] + row[11];
+    row += 2*ADCchannels;
+  }
+  sums->sum[0] = s0; sums->sum[1] = s1; sums->sum[2] = s2;
+  sums->sum[3] = s3; sums->sum[4] = s4; sums->sum[5] = s5;
+  sums->current = (int32_t)(s4 - s5);
+}
+
+
+#define ADCmaxSample  0xfff  /* 12 bit right aligned conversions */
+
+/* # of rows that may be summed in a 16 bit lane without overflow */
+#define SWARspan      (0xffff / ADCmaxSample)
+
+#if SWARspan < 1
+#error  ADC samples are too wide for 16 bit SWAR lanes
+#endif
+
+typedef uint32_t __attribute__((may_alias)) adcpair_t;  //two adjacent samples
+
+void accumulateSWAR(ChannelSums *sums,
+                    const adcsample_t *samples, size_t depth)
+/*
+  sum depth rows of interleaved samples, two channels per 32 bit add
+  samples must be word aligned and no more than 12 bits wide
+*/
+{
+  const adcpair_t *row = (const adcpair_t *)samples;
+  uint32_t s0 = 0, s1 = 0, s2 = 0, s3 = 0, s4 = 0, s5 = 0;
+  while (depth) {
+    size_t n = depth < SWARspan ? depth : SWARspan;
+    uint32_t p01 = 0, p23 = 0, p45 = 0;  //packed partial sums
+    depth -= n;
+    do {
+      p01 += row[0];
+      p23 += row[1];
+      p45 += row[2];
+      row += ADCchannels/2;
+    } while (--n);
+    s0 += p01 & 0xffff;  s1 += p01 >> 16;
+    s2 += p23 & 0xffff;  s3 += p23 >> 16;
+    s4 += p45 & 0xffff;  s5 += p45 >> 16;
+  }
+  sums->sum[0] = s0; sums->sum[1] = s1; sums->sum[2] = s2;
+  sums->sum[3] = s3; sums->sum[4] = s4; sums->sum[5] = s5;
+  sums->current = (int32_t)(s4 - s5);
+}
@@ -0,0 +1,54 @@
+/**********************  accum.h  ************************
+*
+*  Per channel accumulation of the interleaved ADC sample buffer
+*
+*  Each row of the DMA buffer holds one sample of every channel in
+*  the order they are listed in the ADC conversion group:
+*
+*    0 = temperature sensor, 1 = High Voltage, 2 = Charger setpoint feedback,
+*    3 = Celltop overvoltage, 4 = Current sensor Vcc/2, 5 = Current sensor
+*
+***************************************************************/
+
+#ifndef ACCUM_H
+#define ACCUM_H
+
+#include <hal.h>
+
+/* Total number of channels to be sampled by a single ADC operation.*/
+#define ADCchannels   6
+
+/*
+ * Nonzero to accumulate two samples per 32 bit add (SIMD within a register)
+ * The sample buffer must then be word aligned.
+ */
+#define ADCaccumSWAR  1
+
+typedef struct {
+  uint32_t sum[ADCchannels];  //sum of each channel's samples
+  int32_t  current;           //sum of (Vcc/2 - current sensor) samples
+} ChannelSums;
+
+void accumulateScalar(ChannelSums *sums,
+                      const adcsample_t *samples, size_t depth);
+/*
+  sum depth rows of interleaved samples
+  every sample is read exactly once
+*/
+
+void accumulateSWAR(ChannelSums *sums,
+                    const adcsample_t *samples, size_t depth);
+/*
+  sum depth rows of interleaved samples, two channels per 32 bit add
+  samples must be word aligned and no more than 12 bits wide
+*/
+
+#if ADCaccumSWAR
+#define accumulateChannels(sums, samples, depth) \
+          accumulateSWAR(sums, samples, depth)
+#else
+#define accumulateChannels(sums, samples, depth) \
+          accumulateScalar(sums, samples, depth)
+#endif
+
+#endif /* ACCUM_H */
@@ -0,0 +1,117 @@
+/**********************  awd.c  ************************
+*
+*  Fast overcurrent and overvoltage protection
+*
+*  ChibiOS owns the ADC interrupt vector, so the watchdog handler is hooked
+*  in front of it and chains to it.  The handler drops CHARGER before doing
+*  anything else.
+*
+*  Latency is measured from the trigger that started the conversion
+*  sequence, as the trigger timer's count is then the time elapsed since.
+*
+***************************************************************/
+
+#include "awd.h"
+#include "irqhook.h"
+#include "pins.h"
+#include "sampling.h"
+#include "trace.h"
+
+#define nsPerTick  (1000000000 / adcTimeBase)
+
+static irqHandler adcDriverIrq;
+static AwdTrip last;
+
+
+static void record(unsigned source, unsigned channel, halrtcnt_t entry,
+                   uint32_t ticks)
+{
+  halrtcnt_t now = halGetCounterValue();
+  last.trips++;
+  last.source = source;
+  last.channel = channel;
+  last.stamp = now;
+  last.isrCycles = now - entry;
+  last.latency = ticks * nsPerTick;
+  trace(traceTrip, source << 8 | channel);
+}
+
+
+static void awdIrq(void)
+/*
+  hooked in front of the ChibiOS ADC1 interrupt handler
+*/
+{
+  if (ADC1->SR & ADC_SR_AWD) {
+    halrtcnt_t entry = halGetCounterValue();
+    clearPad(CHARGER);
+    uint32_t ticks = samplingSinceTrigger();
+    samplingClearCR1I(ADC_CR1_AWDIE);  //until rearmed, even if restarted
+    ADC1->SR = ~ADC_SR_AWD;
+    record(awdHardware, ADC1->CR1 & ADC_CR1_AWDCH, entry, ticks);
+  }
+  adcDriverIrq();
+}
+
+
+void awdInit(void)
+/*
+  hook the ADC interrupt (watchdog remains disarmed)
+*/
+{
+  adcDriverIrq = irqHook(ADC1_IRQn, awdIrq);
+}
+
+
+void awdArm(unsigned channel, uint16_t low, uint16_t high)
+/*
+  trip when any conversion of ADC_CHANNEL_INx channel is outside [low, high]
+*/
+{
+  ADC1->LTR = low;
+  ADC1->HTR = high;
+  samplingSetCR1(ADC_CR1_AWDEN | ADC_CR1_AWDSGL | ADC_CR1_AWDIE |
+                 (channel & ADC_CR1_AWDCH));
+}
+
+void awdDisarm(void)
+{
+  samplingSetCR1(0);
+}
+
+
+bool_t awdScanI(const adcsample_t *samples, size_t depth,
+                unsigned column, uint16_t low, uint16_t high)
+/*
+  trip if CHARGER is on and any sample in column is outside [low, high]
+  returns TRUE if tripped
+*/
+{
+  if (padLatched(CHARGER)) {
+    halrtcnt_t entry = halGetCounterValue();
+    const adcsample_t *cursor = samples + column;
+    const adcsample_t *end = cursor + depth*ADCchannels;
+    while (cursor < end) {
+      if (*cursor < low || *cursor > high) {
+        clearPad(CHARGER);
+        record(awdSoftware, column, entry, 0);
+        return TRUE;
+      }
+      cursor += ADCchannels;
+    }
+  }
+  return FALSE;
+}
+
+
+unsigned awdLastTrip(AwdTrip *trip)
+/*
+  copy details of the most recent trip
+  returns total # of trips
+*/
+{
+  chSysLock();
+  *trip = last;
+  chSysUnlock();
+  return trip->trips;
+}
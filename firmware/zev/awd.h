@@ -0,0 +1,60 @@
+/**********************  awd.h  ************************
+*
+*  Fast overcurrent and overvoltage protection
+*
+*  The ADC's analog watchdog compares each conversion of one channel
+*  against a window as it completes.  Its interrupt drops CHARGER within
+*  microseconds, without waiting for a frame to be averaged.
+*
+*  The STM32L ADC has just one watchdog, so other channels are checked
+*  by scanning each completed frame from the DMA interrupt.
+*
+*  A hardware trip disables the watchdog interrupt until it is rearmed,
+*  even if sampling is restarted with a new profile meanwhile.
+*
+***************************************************************/
+
+#ifndef AWD_H
+#define AWD_H
+
+#include <hal.h>
+
+#define awdHardware   1  //tripped by the analog watchdog
+#define awdSoftware   2  //tripped by scanning a completed frame
+
+typedef struct {
+  unsigned   trips;      //total # of trips
+  unsigned   source;     //awdHardware or awdSoftware
+  unsigned   channel;    //ADC channel (hardware) or row column (software)
+  halrtcnt_t stamp;      //CPU cycle counter when CHARGER was dropped
+  halrtcnt_t isrCycles;  //cycles from interrupt entry to CHARGER dropped
+  uint32_t   latency;    //ns from conversion trigger to CHARGER dropped
+                         //(hardware trips only)
+} AwdTrip;
+
+void awdInit(void);
+/*
+  hook the ADC interrupt (watchdog remains disarmed)
+*/
+
+void awdArm(unsigned channel, uint16_t low, uint16_t high);
+/*
+  trip when any conversion of ADC_CHANNEL_INx channel is outside [low, high]
+*/
+
+void awdDisarm(void);
+
+bool_t awdScanI(const adcsample_t *samples, size_t depth,
+                unsigned column, uint16_t low, uint16_t high);
+/*
+  trip if CHARGER is on and any sample in column is outside [low, high]
+  returns TRUE if tripped
+*/
+
+unsigned awdLastTrip(AwdTrip *trip);
+/*
+  copy details of the most recent trip
+  returns total # of trips
+*/
+
+#endif /* AWD_H */
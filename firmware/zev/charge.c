@@ -0,0 +1,86 @@
+/**********************  charge.c  ************************
+*
+*  Constant current / constant voltage charge controller
+*
+*  Each loop computes  u = Kp*err + I  where I accumulates Ki*err.
+*  The controller in control is the one with the lower u.  After limiting
+*  the output, both integrators are back calculated as I = out - Kp*err,
+*  so the loop not in control, and a loop driven into a limit,
+*  hold exactly the output applied instead of winding up.
+*
+***************************************************************/
+
+#include "charge.h"
+
+/*
+ * Conservative defaults -- hvScale is uncalibrated, so volts are ADC counts
+ */
+const ChargeConfig defaultCharge = {
+  Q16(5.0),             //Amps
+  Q16(3000.0),          //Volts
+  Q16(8.0), Q16(2.0),   //CC Kp, Ki
+  Q16(0.5), Q16(0.1),   //CV Kp, Ki
+  0, 4095,              //DAC limits
+  16                    //slew
+};
+
+static int64_t q16mul(q16 a, q16 b)
+{
+  return ((int64_t)a * b) >> 16;
+}
+
+static int32_t limit(int64_t x, int32_t lo, int32_t hi)
+{
+  return x < lo ? lo : x > hi ? hi : (int32_t)x;
+}
+
+
+void chargeReset(ChargeController *c)
+/*
+  reset integrators and output to the minimum (i.e. when charger is off)
+*/
+{
+  c->output = c->ccInteg = c->cvInteg = (int32_t)c->cfg.dacMin << 16;
+  c->mode = chargeCC;
+}
+
+void chargeInit(ChargeController *c, const ChargeConfig *cfg)
+/*
+  configure controller and reset it to its minimum output
+*/
+{
+  c->cfg = *cfg;
+  chargeReset(c);
+}
+
+
+uint16_t chargeUpdate(ChargeController *c, q16 amps, q16 volts)
+/*
+  run one iteration given the measured current and voltage
+  returns new DAC output
+*/
+{
+  const ChargeConfig *cfg = &c->cfg;
+  /* a saturated reading must not wrap its error around to the other sign */
+  q16 ccErr = limit((int64_t)cfg->amps - amps, INT32_MIN, INT32_MAX);
+  q16 cvErr = limit((int64_t)cfg->volts - volts, INT32_MIN, INT32_MAX);
+  int64_t ccP = q16mul(cfg->ccKp, ccErr);
+  int64_t cvP = q16mul(cfg->cvKp, cvErr);
+  int64_t cc = ccP + c->ccInteg + q16mul(cfg->ccKi, ccErr);
+  int64_t cv = cvP + c->cvInteg + q16mul(cfg->cvKi, cvErr);
+  int64_t u;
+  if (cc <= cv) {
+    u = cc;
+    c->mode = chargeCC;
+  }else{
+    u = cv;
+    c->mode = chargeCV;
+  }
+  int32_t slew = (int32_t)cfg->slew << 16;
+  int32_t out = limit(u, c->output - slew, c->output + slew);
+  out = limit(out, (int32_t)cfg->dacMin << 16, (int32_t)cfg->dacMax << 16);
+  c->output = out;
+  c->ccInteg = out - ccP;  //back calculate integrators from applied output
+  c->cvInteg = out - cvP;
+  return (uint16_t)((out + (1<<15)) >> 16);
+}
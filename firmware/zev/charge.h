@@ -0,0 +1,63 @@
+/**********************  charge.h  ************************
+*
+*  Constant current / constant voltage charge controller
+*
+*  Two fixed point PI loops compute the charger voltage setpoint (DAC
+*  counts on PA4): one regulating current, one regulating voltage.
+*  The lower of the two outputs is applied, so the charger is current
+*  limited until the battery reaches the voltage setpoint, then voltage
+*  limited as the current tapers off.
+*
+*  The loop that is not in control tracks the applied output, so it can
+*  take over without a bump, and neither integrator winds up while the
+*  output is limited.  The output is also slew rate limited.
+*
+*  Gains are per iteration, so they must be retuned if the frame rate
+*  changes significantly.
+*
+***************************************************************/
+
+#ifndef CHARGE_H
+#define CHARGE_H
+
+#include "convert.h"
+
+typedef struct {
+  q16 amps;            //constant current setpoint
+  q16 volts;           //constant voltage setpoint
+  q16 ccKp, ccKi;      //DAC counts per Amp of error
+  q16 cvKp, cvKi;      //DAC counts per Volt of error
+  uint16_t dacMin;     //output limits in DAC counts
+  uint16_t dacMax;
+  uint16_t slew;       //maximum output change per iteration in DAC counts
+} ChargeConfig;
+
+#define chargeCC  1    //current loop in control
+#define chargeCV  2    //voltage loop in control
+
+typedef struct {
+  ChargeConfig cfg;
+  int64_t ccInteg, cvInteg;  //integrators, Q16 DAC counts
+  int32_t output;            //applied output, Q16 DAC counts
+  unsigned mode;             //chargeCC or chargeCV
+} ChargeController;
+
+extern const ChargeConfig defaultCharge;
+
+void chargeInit(ChargeController *c, const ChargeConfig *cfg);
+/*
+  configure controller and reset it to its minimum output
+*/
+
+void chargeReset(ChargeController *c);
+/*
+  reset integrators and output to the minimum (i.e. when charger is off)
+*/
+
+uint16_t chargeUpdate(ChargeController *c, q16 amps, q16 volts);
+/*
+  run one iteration given the measured current and voltage
+  returns new DAC output
+*/
+
+#endif /* CHARGE_H */
@@ -0,0 +1,87 @@
+/**********************  cobs.c  ************************
+*
+*  Consistent Overhead Byte Stuffing and CRC for binary packets
+*
+*  The CRC is computed a nibble at a time from a 16 entry table,
+*  which is nearly as fast as a 256 entry table on the M3.
+*
+***************************************************************/
+
+#include "cobs.h"
+
+static const uint16_t crcNibble[16] = {
+  0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50a5, 0x60c6, 0x70e7,
+  0x8108, 0x9129, 0xa14a, 0xb16b, 0xc18c, 0xd1ad, 0xe1ce, 0xf1ef
+};
+
+uint16_t crc16(uint16_t crc, const uint8_t *data, size_t len)
+/*
+  update CCITT crc (initially 0xffff) with len bytes of data
+*/
+{
+  while (len--) {
+    uint8_t b = *data++;
+    crc = (crc << 4) ^ crcNibble[(crc >> 12) ^ (b >> 4)];
+    crc = (crc << 4) ^ crcNibble[(crc >> 12) ^ (b & 0xf)];
+  }
+  return crc;
+}
+
+
+size_t cobsPacket(uint8_t *packet, const uint8_t *payload, size_t len)
+/*
+  encode payload as a zero terminated packet
+  packet must have room for len + cobsOverhead(len) bytes
+  returns # of bytes in packet, including the terminating zero
+*/
+{
+  uint16_t crc = crc16(0xffff, payload, len);
+  uint8_t *code = packet;   //where to store length of current run
+  uint8_t *out = packet+1;
+  size_t i;
+  for (i = 0; i < len+2; i++) {
+    uint8_t b = i < len ? payload[i] : i == len ? crc : crc >> 8;
+    if (b) {
+      *out++ = b;
+      if (out - code < 0xff)
+        continue;
+    }
+    *code = out - code;  //end this run
+    code = out++;
+  }
+  *code = out - code;
+  *out++ = 0;
+  return out - packet;
+}
+
+
+size_t cobsUnpack(uint8_t *payload, const uint8_t *packet, size_t len)
+/*
+  decode len bytes of a packet (excluding its terminating zero)
+  payload must have room for len bytes
+  returns payload length or 0 if the packet is malformed or its CRC is bad
+*/
+{
+  const uint8_t *end = packet + len;
+  uint8_t *out = payload;
+  while (packet < end) {
+    unsigned code = *packet++;
+    if (!code || code-1 > (size_t)(end - packet))
+      return 0;
+    unsigned run = code;
+    while (--run) {
+      if (!*packet)
+        return 0;
+      *out++ = *packet++;
+    }
+    if (code != 0xff && packet < end)  //run ended with a zero
+      *out++ = 0;
+  }
+  size_t n = out - payload;
+  if (n <= 2)
+    return 0;
+  n -= 2;
+  if (crc16(0xffff, payload, n) != (payload[n] | payload[n+1] << 8))
+    return 0;
+  return n;
+}
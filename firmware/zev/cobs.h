@@ -0,0 +1,40 @@
+/**********************  cobs.h  ************************
+*
+*  Consistent Overhead Byte Stuffing and CRC for binary packets
+*
+*  A packet is its payload followed by a CRC-16 (CCITT, LSB first),
+*  COBS encoded so that it contains no zeros, then terminated by a zero.
+*  A receiver may therefore resynchronize at any zero byte.
+*  Encoding adds 1 byte per 254 bytes of payload.
+*
+***************************************************************/
+
+#ifndef COBS_H
+#define COBS_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define cobsMaxPayload     254  /* longest payload with a single code byte */
+#define cobsOverhead(len)  (((len)+2)/254 + 4)  /* code bytes + CRC + zero */
+
+uint16_t crc16(uint16_t crc, const uint8_t *data, size_t len);
+/*
+  update CCITT crc (initially 0xffff) with len bytes of data
+*/
+
+size_t cobsPacket(uint8_t *packet, const uint8_t *payload, size_t len);
+/*
+  encode payload as a zero terminated packet
+  packet must have room for len + cobsOverhead(len) bytes
+  returns # of bytes in packet, including the terminating zero
+*/
+
+size_t cobsUnpack(uint8_t *payload, const uint8_t *packet, size_t len);
+/*
+  decode len bytes of a packet (excluding its terminating zero)
+  payload must have room for len bytes
+  returns payload length or 0 if the packet is malformed or its CRC is bad
+*/
+
+#endif /* COBS_H */
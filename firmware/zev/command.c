@@ -0,0 +1,266 @@
+/**********************  command.c  ************************
+*
+*  Serial command interpreter
+*
+*  The USART1 interrupt is hooked to note when each character arrives,
+*  so the latency of an immediate shutdown can be measured from then.
+*
+*  Replies are passed to the reporter thread (report.h), which sends them
+*  between frame reports, framed for SD1's current reporting mode.
+*
+***************************************************************/
+
+#include <string.h>
+#include <chprintf.h>
+#include <memstreams.h>
+
+#include "command.h"
+#include "report.h"
+#include "irqhook.h"
+#include "cobs.h"
+#include "trace.h"
+
+CommandStats commandStats;
+
+static const Command *commands;
+static void (*shutdown)(void);
+
+static irqHandler chainedIrq;
+static volatile halrtcnt_t rxStamp;  //counter when last character arrived
+
+static char line[commandMaxLine + cobsOverhead(commandMaxLine)];
+static size_t lineLen;
+static bool_t overflowed;  //discarding the rest of a line too long
+static bool_t packet;      //a zero started this line
+static bool_t cancelled;   //discarding the rest of a line begun by '0'
+
+static char reply[commandMaxReply+1];  //one extra to detect overflow
+static MemoryStream output;  //current line's output
+
+static WORKING_AREA(commandArea, 512);
+
+
+static void rxIrq(void)
+/*
+  hooked in front of the USART1 interrupt handler
+*/
+{
+  if (USART1->SR & USART_SR_RXNE)
+    rxStamp = halGetCounterValue();
+  chainedIrq();
+}
+
+
+static void sendReply(const char *tag, size_t tagLen, const char *status)
+/*
+  queue {tag }status followed by any output as the reply to the current line
+*/
+{
+  char text[commandMaxLine + commandMaxReply];
+  size_t len = 0, statusLen = strlen(status);
+  if (tagLen) {
+    memcpy(text, tag, tagLen);
+    text[tagLen] = ' ';
+    len = tagLen+1;
+  }
+  memcpy(text+len, status, statusLen);
+  len += statusLen;
+  size_t outLen = output.eos;
+  if (outLen > commandMaxReply) {  //mark where the output was cut
+    outLen = commandMaxReply;
+    memcpy(reply+outLen-3, "...", 3);
+    commandStats.truncated++;
+  }
+  memcpy(text+len, output.buffer, outLen);
+  len += outLen;
+  if (!reportReply(text, len))
+    commandStats.unsent++;
+}
+
+
+static const Command *lookup(const char *name, size_t len)
+{
+  const Command *cmd;
+  for (cmd = commands; cmd->name; cmd++)
+    if (strlen(cmd->name) == len && !memcmp(cmd->name, name, len))
+      return cmd;
+  return NULL;
+}
+
+
+static void execute(char *text)
+/*
+  execute the semicolon separated commands in the nul terminated text
+*/
+{
+  const char *tag = text;
+  size_t tagLen = 0;
+  if (*text == '#') {  //reply will be tagged
+    tagLen = strcspn(text, " ;");
+    text += tagLen;
+  }
+  msObjectInit(&output, (uint8_t *)reply, sizeof reply, 0);
+  commandStats.lines++;
+  unsigned executed = 0;
+  while (*text) {
+    char *end = strchr(text, ';');
+    if (end)
+      *end++ = '\0';
+    else
+      end = text + strlen(text);
+    while (*text == ' ')
+      text++;
+    size_t nameLen = strcspn(text, " ");
+    if (nameLen) {
+      const char *args = text + nameLen;
+      while (*args == ' ')
+        args++;
+      trace(traceCommand, traceName(text, nameLen));
+      const Command *cmd = lookup(text, nameLen);
+      const char *err = cmd ? cmd->handler(args) : "unknown command";
+      if (err) {
+        commandStats.errors++;
+        output.eos = 0;
+        commandReply("%d %s", executed, err);
+        sendReply(tag, tagLen, "err ");
+        return;
+      }
+      executed++;
+    }
+    text = end;
+  }
+  sendReply(tag, tagLen, "ok");
+}
+
+
+/*
+ * This thread assembles and executes command lines
+ */
+__attribute__((noreturn))
+static msg_t commander(void *arg)
+{
+  (void)arg;
+  chRegSetThreadName("command");
+  while (TRUE) {
+    msg_t c = chnGetTimeout(&SD1, TIME_INFINITE);
+    if (c < 0) {  //serial driver restarted
+      lineLen = 0;
+      overflowed = packet = cancelled = FALSE;
+      continue;
+    }
+    if (!lineLen && c == '0' && !overflowed && !packet && !cancelled) {
+      shutdown();  //shut down now
+      trace(traceCommand, '0');
+      halrtcnt_t latency = halGetCounterValue() - rxStamp;
+      commandStats.shutdowns++;
+      commandStats.lastLatency = latency;
+      if (latency > commandStats.maxLatency)
+        commandStats.maxLatency = latency;
+      msObjectInit(&output, (uint8_t *)reply, sizeof reply, 0);
+      commandReply(" off %dns", commandNanoseconds(latency));
+      sendReply("", 0, "ok");
+      cancelled = TRUE;  //so nothing after it can turn the charger back on
+      continue;
+    }
+    if (c && (packet || (c != '\r' && c != '\n'))) {
+      if (lineLen < sizeof line - 1)
+        line[lineLen++] = c;
+      else
+        overflowed = TRUE;
+      continue;
+    }
+    if (!c && !lineLen && !overflowed) {  //packet follows
+      packet = TRUE;
+      cancelled = FALSE;
+      continue;
+    }
+    if (cancelled) {
+      if (lineLen || overflowed)
+        commandStats.cancelled++;
+    }else if (overflowed)
+      commandStats.overflows++;
+    else if (lineLen && packet &&
+        !(lineLen = cobsUnpack((uint8_t *)line, (uint8_t *)line, lineLen)))
+      commandStats.badPackets++;
+    else if (lineLen > commandMaxLine)
+      commandStats.overflows++;
+    else if (lineLen) {
+      line[lineLen] = '\0';
+      execute(line);
+    }
+    lineLen = 0;
+    overflowed = packet = cancelled = FALSE;
+  }
+}
+
+
+Thread *commandInit(const Command *table, void (*shutdownNow)(void),
+                    tprio_t prio)
+/*
+  start command thread at prio, executing commands in table
+  table ends with an entry whose name is NULL
+  shutdown is called as soon as a '0' starts a line
+  returns the thread
+*/
+{
+  commands = table;
+  shutdown = shutdownNow;
+  lineLen = 0;
+  overflowed = packet = cancelled = FALSE;
+  chainedIrq = irqHook(USART1_IRQn, rxIrq);
+  return chThdCreateStatic(commandArea, sizeof(commandArea),
+                           prio, commander, NULL);
+}
+
+
+void commandReply(const char *fmt, ...)
+/*
+  append printf style output to the current line's reply
+*/
+{
+  va_list ap;
+  va_start(ap, fmt);
+  chvprintf((BaseSequentialStream *)&output, fmt, ap);
+  va_end(ap);
+}
+
+
+bool_t commandQ16(const char *arg, q16 *x)
+/*
+  parse arg as a decimal number with up to 3 fraction digits
+  returns FALSE if arg is not such a number
+*/
+{
+  bool_t negative = *arg == '-';
+  if (negative)
+    arg++;
+  int32_t milli = 0;
+  unsigned digits = 0, fraction = 0;
+  while (*arg >= '0' && *arg <= '9') {
+    if (milli > 3276700)
+      return FALSE;
+    milli = milli * 10 + 1000 * (*arg++ - '0');
+    digits++;
+  }
+  if (*arg == '.')
+    while (*++arg >= '0' && *arg <= '9') {
+      if (++fraction > 3)
+        return FALSE;
+      static const uint16_t place[] = {100, 10, 1};
+      milli += place[fraction-1] * (*arg - '0');
+      digits++;
+    }
+  if (!digits || (*arg && *arg != ' ') || milli > 32767999)
+    return FALSE;
+  *x = (q16)(((int64_t)(negative ? -milli : milli) << 16) / 1000);
+  return TRUE;
+}
+
+
+uint32_t commandNanoseconds(halrtcnt_t cycles)
+/*
+  convert CPU cycles to nanoseconds
+*/
+{
+  return (uint32_t)((uint64_t)cycles * 1000000000 / halGetCounterFrequency());
+}
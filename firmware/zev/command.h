@@ -0,0 +1,89 @@
+/**********************  command.h  ************************
+*
+*  Serial command interpreter
+*
+*  A thread at a higher priority than the frame loop sleeps until SD1
+*  receives a character, so commands take effect as soon as they arrive
+*  rather than once per frame.
+*
+*  Commands are lines of text terminated by CR or LF, or COBS packets
+*  (cobs.h) whose payload is such a line.  Packets must be preceded by
+*  a zero as well as terminated by one.  A line may hold several
+*  commands separated by semicolons.  They are executed in order until
+*  one fails, then the whole line is acknowledged with a single reply:
+*    {#tag }ok{ output}
+*    {#tag }err <n> <message>
+*  where n is the number of commands executed before the one that failed.
+*  A line beginning with #tag has that tag echoed in its reply.
+*  Output beyond commandMaxReply characters is dropped, and the reply
+*  ends with "..." to show it was cut short.
+*
+*  A '0' at the start of a line shuts the charger down at once, without
+*  waiting for the end of the line.  The time from the USART1 receive
+*  interrupt to the end of the shutdown is measured and acknowledged.
+*  The rest of that line is discarded unexecuted, so "0;1" leaves the
+*  charger off.
+*
+***************************************************************/
+
+#ifndef COMMAND_H
+#define COMMAND_H
+
+#include <hal.h>
+#include "convert.h"
+
+#define commandMaxLine   64  /* longest command line */
+#define commandMaxReply  128  /* longest reply output */
+
+typedef const char *commandHandler(const char *args);
+/*
+  args are the rest of the command, after any leading spaces
+  returns NULL if successful, otherwise an error message
+*/
+
+typedef struct {
+  const char     *name;
+  commandHandler *handler;
+} Command;
+
+typedef struct {
+  unsigned   lines;        //command lines received
+  unsigned   errors;       //lines with a failed command
+  unsigned   overflows;    //lines discarded because they were too long
+  unsigned   badPackets;   //packets discarded for bad framing or CRC
+  unsigned   unsent;       //replies dropped because one was still pending
+  unsigned   truncated;    //replies cut short at commandMaxReply
+  unsigned   shutdowns;    //immediate shutdowns
+  unsigned   cancelled;    //lines discarded after an immediate shutdown
+  halrtcnt_t lastLatency;  //CPU cycles from receipt to end of last shutdown
+  halrtcnt_t maxLatency;   //longest shutdown
+} CommandStats;
+
+extern CommandStats commandStats;
+
+Thread *commandInit(const Command *table, void (*shutdown)(void),
+                    tprio_t prio);
+/*
+  start command thread at prio, executing commands in table
+  table ends with an entry whose name is NULL
+  shutdown is called as soon as a '0' starts a line
+  returns the thread
+*/
+
+void commandReply(const char *fmt, ...);
+/*
+  append printf style output to the current line's reply
+*/
+
+bool_t commandQ16(const char *arg, q16 *x);
+/*
+  parse arg as a decimal number with up to 3 fraction digits
+  returns FALSE if arg is not such a number
+*/
+
+uint32_t commandNanoseconds(halrtcnt_t cycles);
+/*
+  convert CPU cycles to nanoseconds
+*/
+
+#endif /* COMMAND_H */
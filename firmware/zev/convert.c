@@ -0,0 +1,92 @@
+/**********************  convert.c  ************************
+*
+*  Fixed point conversion of filtered ADC counts to engineering units
+*
+*  Amps = ampVnom/Vcc2 * (ampScale + ampTscale*dT) * (current + ampToffset*dT)
+*    where dT = temp - ampTnom
+*
+*  The current sum is first rescaled to the ampDepth rows the factors were
+*  calibrated for, using a 24 bit fraction computed by hardware divide.
+*
+*  The scale factor is tiny (~2e-4), so it is carried with 40 fraction bits.
+*  The current sum is carried with 8 fraction bits so that the temperature
+*  offset correction is not truncated.  The Vcc/2 ratio has 20 fraction
+*  bits, the most that ampVnom allows in a 32 bit hardware divide.
+*  Intermediate products are 64 bits, which the M3 computes with SMULL.
+*
+***************************************************************/
+
+#include "convert.h"
+
+#define ampScaleQ40   Qconst(ampScale, 40)
+#define ampTscaleQ40  Qconst(ampTscale, 40)
+#define ampToffsetQ8  Qconst(ampToffset, 8)
+
+#define hvScaleQ16    Qconst(hvScale, 16)
+#define hvOffsetQ16   Q16(hvOffset)
+
+#define tempNomQ16    Q16(tempNom)
+#define tempScaleQ16  Qconst(tempScale, 16)
+
+
+q16 ampsQ16(int32_t current, unsigned depth, uint32_t vccHalf, uint32_t temp)
+/*
+  convert the sum of depth (Vcc/2 - sense) differences to Amps
+  vccHalf is the averaged Vcc/2 reference, temp the averaged sensor reading
+  returns 0 if vccHalf or depth is zero
+*/
+{
+  if (!vccHalf || !depth)
+    return 0;
+  int32_t deltaT = (int32_t)temp - ampTnom;
+  int64_t ratio =                                                 //Q20
+    (((uint32_t)ampVnom << 20) + vccHalf/2) / vccHalf;
+  int64_t gain = ampScaleQ40 + ampTscaleQ40 * deltaT;           //Q40
+  gain = (ratio * gain + (1<<19)) >> 20;                         //Q40
+  int64_t counts = (int64_t)current << 8;                        //Q8
+  if (depth != ampDepth) {
+    uint32_t rescale = ((uint32_t)ampDepth << 24) / depth;      //Q24
+    counts = ((int64_t)current * rescale + (1<<15)) >> 16;
+  }
+  counts += (ampVoffset << 8) + ampToffsetQ8 * deltaT;
+  /* gain*counts overflows 64 bits only if the result would saturate */
+  int negative = (gain < 0) != (counts < 0);
+  uint64_t g = gain < 0 ? -(uint64_t)gain : (uint64_t)gain;
+  uint64_t c = counts < 0 ? -(uint64_t)counts : (uint64_t)counts;
+  if (g && c && __builtin_clzll(g) + __builtin_clzll(c) < 64)
+    return negative ? INT32_MIN : INT32_MAX;
+  uint64_t product = g * c;                                      //Q48
+  if (product >= (1ULL<<63) - (1ULL<<31))
+    return negative ? INT32_MIN : INT32_MAX;
+  int64_t amps = ((negative ? -(int64_t)product : (int64_t)product)
+                   + (1LL<<31)) >> 32;                           //Q16
+  if (amps > INT32_MAX)  //saturate, rather than wrap, out of range readings
+    return INT32_MAX;
+  if (amps < INT32_MIN)
+    return INT32_MIN;
+  return (q16)amps;
+}
+
+q16 voltsQ16(uint32_t hv)
+/*
+  convert averaged High Voltage counts to Volts
+*/
+{
+  return (q16)(hvOffsetQ16 + hvScaleQ16 * (int64_t)hv);
+}
+
+q16 degreesQ16(uint32_t temp)
+/*
+  convert averaged temperature sensor counts to degrees C
+*/
+{
+  return (q16)(tempNomQ16 + tempScaleQ16 * ((int32_t)temp - ampTnom));
+}
+
+int32_t q16milli(q16 x)
+/*
+  return x * 1000 rounded to the nearest integer
+*/
+{
+  return (int32_t)(((int64_t)x * 1000 + (1<<15)) >> 16);
+}
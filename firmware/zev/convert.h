@@ -0,0 +1,71 @@
+/**********************  convert.h  ************************
+*
+*  Fixed point conversion of filtered ADC counts to engineering units
+*
+*  The Cortex-M3 has no FPU, so every float operation in the frame loop
+*  is a libgcc soft-float call.  The calibration factors below are still
+*  written as floats, but they are folded into integer constants at
+*  compile time.  At run time only integer multiplies, shifts and a single
+*  hardware divide are used.
+*
+*  All results are signed 16.16 fixed point (q16)
+*
+***************************************************************/
+
+#ifndef CONVERT_H
+#define CONVERT_H
+
+#include <stdint.h>
+
+typedef int32_t q16;  //signed 16.16 fixed point
+
+#define Q16one      (1L<<16)
+
+/* round float constant x to a fixed point integer with the given fraction bits */
+#define Qconst(x, bits) \
+  ((int64_t)((x) * (float)(1LL<<(bits)) + ((x) < 0 ? -0.5f : 0.5f)))
+
+#define Q16(x)  ((q16)Qconst(x, 16))
+
+
+/* ADC counts to Amps converison factors */
+#define ampDepth   64       /* ADCdepth these factors were calibrated for */
+#define ampScale   1.89e-4f /* ADC counts per amp / ADCdepth */
+#define ampVoffset 0        /* ADCdepth * (ADC counts @ zero current - Vcc/2) */
+#define ampVnom    3124     /* nominal Vcc/2 ADC counts */
+#define ampTnom    611      /* nominal temperature ADC counts */
+#define ampToffset 0.0f     /* offset change per temperature count */
+#define ampTscale  0.0f     /* scale gain change per temperature count */
+
+/* High Voltage (PC0) counts to Volts -- uncalibrated */
+#define hvScale    1.0f     /* Volts per averaged ADC count */
+#define hvOffset   0.0f     /* Volts @ zero ADC counts */
+
+/* Internal temperature sensor counts to degrees C (~1.6mV/C) */
+#define tempNom    25.0f    /* degrees C @ ampTnom counts */
+#define tempScale  0.5f     /* degrees C per ADC count */
+
+
+q16 ampsQ16(int32_t current, unsigned depth, uint32_t vccHalf, uint32_t temp);
+/*
+  convert the sum of depth (Vcc/2 - sense) differences to Amps
+  vccHalf is the averaged Vcc/2 reference, temp the averaged sensor reading
+  returns 0 if vccHalf or depth is zero
+*/
+
+q16 voltsQ16(uint32_t hv);
+/*
+  convert averaged High Voltage counts to Volts
+*/
+
+q16 degreesQ16(uint32_t temp);
+/*
+  convert averaged temperature sensor counts to degrees C
+*/
+
+int32_t q16milli(q16 x);
+/*
+  return x * 1000 rounded to the nearest integer
+*/
+
+#endif /* CONVERT_H */
@@ -0,0 +1,157 @@
+/**********************  decimate.c  ************************
+*
+*  Multi-rate decimation of the raw interleaved ADC samples
+*
+*  A CIC decimator of ratio R has a DC gain of R^3.  Its integrators may
+*  wrap, as long as they are wide enough to hold the comb output, because
+*  the combs difference away any overflow.  The fast stage's 12 bit inputs
+*  therefore need 12 + 3*log2(R) bits, so R is limited to fastMaxRatio.
+*  The slow stage runs 1000/20 times less often, so it uses 64 bit
+*  integrators, which wrap in the same way.  Their comb output, at most
+*  16 bits times slowMaxRatio^3, is converted to signed only after the
+*  combs have differenced away the wrap.
+*
+*  Gain is normalized by multiplying by a reciprocal of R^3 computed once
+*  at initialization.
+*
+*  The CIC response droops as sinc(f/Fout)^3, about -2.7dB at Fout/4.
+*  The compensator [-3, 22, -3]/16 restores unity gain there (and at DC).
+*  With R == 2 the droop is only -2.1dB, so [-2, 20, -2]/16 is used
+*  instead.  A stage with R == 1 has no droop, so it is not compensated.
+*
+***************************************************************/
+
+#include <string.h>
+
+#include "decimate.h"
+
+#define recipBits  40
+
+static int32_t compensate(int32_t fir[2], int32_t x, int32_t tap)
+/*
+  3 tap droop compensation FIR [-tap, 16+2*tap, -tap]/16
+*/
+{
+  int32_t y = ((16+2*tap)*fir[0] - tap*(x + fir[1]) + 8) >> 4;
+  fir[1] = fir[0];
+  fir[0] = x;
+  return y;
+}
+
+static unsigned ratioFor(unsigned inRate, unsigned outRate, unsigned max)
+{
+  unsigned ratio = (inRate + outRate/2) / outRate;
+  if (ratio < 1)
+    return 1;
+  return ratio > max ? max : ratio;
+}
+
+static int32_t tapFor(unsigned ratio)
+{
+  return ratio == 2 ? 2 : 3;
+}
+
+static int64_t recipCube(unsigned ratio, unsigned extraBits)
+{
+  int64_t cube = (int64_t)ratio * ratio * ratio;
+  return ((1LL << (recipBits+extraBits)) + cube/2) / cube;
+}
+
+
+void decimatorInit(Decimator *d, unsigned rowRate,
+                   DecimatedSink fastSink, DecimatedSink slowSink)
+/*
+  reset decimator for inputs arriving at rowRate rows per second
+  choose decimation ratios nearest the target fast and slow rates
+  either sink may be NULL
+*/
+{
+  memset(d, 0, sizeof(*d));
+  d->fastRatio = ratioFor(rowRate, decimFastRate, fastMaxRatio);
+  d->slowRatio =
+    ratioFor(rowRate / d->fastRatio, decimSlowRate, slowMaxRatio);
+  d->fastRecip = recipCube(d->fastRatio, 2);  //scale to 1/4 ADC counts
+  d->slowRecip = recipCube(d->slowRatio, 0);
+  d->fastTap = tapFor(d->fastRatio);
+  d->slowTap = tapFor(d->slowRatio);
+  d->fastSink = fastSink;
+  d->slowSink = slowSink;
+}
+
+
+static void slowStep(Decimator *d)
+/*
+  feed the latest fast output to the slow stage
+*/
+{
+  unsigned chan;
+  for (chan = 0; chan < ADCchannels; chan++) {
+    SlowCIC *c = d->slow + chan;
+    c->integ[0] += (uint64_t)(int64_t)d->fastOut.chan[chan];
+    c->integ[1] += c->integ[0];
+    c->integ[2] += c->integ[1];
+  }
+  if (++d->slowPhase < d->slowRatio)
+    return;
+  d->slowPhase = 0;
+  for (chan = 0; chan < ADCchannels; chan++) {
+    SlowCIC *c = d->slow + chan;
+    uint64_t u = c->integ[2], t;
+    unsigned stage;
+    for (stage = 0; stage < cicOrder; stage++) {
+      t = u;
+      u -= c->comb[stage];
+      c->comb[stage] = t;
+    }
+    int64_t y = (int64_t)u;
+    y = (y * d->slowRecip + (1LL<<(recipBits-1))) >> recipBits;
+    d->slowOut.chan[chan] = d->slowRatio > 1 ?
+      compensate(c->fir, (int32_t)y, d->slowTap) : (int32_t)y;
+  }
+  d->slowOut.current = d->slowOut.chan[4] - d->slowOut.chan[5];
+  if (d->slowSink)
+    d->slowSink(&d->slowOut);
+  d->slowOut.seq++;
+}
+
+
+void decimate(Decimator *d, const adcsample_t *row, size_t depth)
+/*
+  filter depth rows of interleaved samples
+  sinks are called with each new output sample
+*/
+{
+  const adcsample_t *end = row + depth*ADCchannels;
+  while (row < end) {
+    unsigned chan;
+    for (chan = 0; chan < ADCchannels; chan++) {
+      FastCIC *c = d->fast + chan;
+      c->integ[0] += row[chan];
+      c->integ[1] += c->integ[0];
+      c->integ[2] += c->integ[1];
+    }
+    row += ADCchannels;
+    if (++d->fastPhase < d->fastRatio)
+      continue;
+    d->fastPhase = 0;
+    for (chan = 0; chan < ADCchannels; chan++) {
+      FastCIC *c = d->fast + chan;
+      uint32_t y = c->integ[2], t;
+      unsigned stage;
+      for (stage = 0; stage < cicOrder; stage++) {
+        t = y;
+        y -= c->comb[stage];
+        c->comb[stage] = t;
+      }
+      int64_t scaled =
+        ((int64_t)y * d->fastRecip + (1LL<<(recipBits-1))) >> recipBits;
+      d->fastOut.chan[chan] = d->fastRatio > 1 ?
+        compensate(c->fir, (int32_t)scaled, d->fastTap) : (int32_t)scaled;
+    }
+    d->fastOut.current = d->fastOut.chan[4] - d->fastOut.chan[5];
+    if (d->fastSink)
+      d->fastSink(&d->fastOut);
+    d->fastOut.seq++;
+    slowStep(d);
+  }
+}
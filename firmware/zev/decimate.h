@@ -0,0 +1,84 @@
+/**********************  decimate.h  ************************
+*
+*  Multi-rate decimation of the raw interleaved ADC samples
+*
+*  Every channel is filtered by a 3rd order CIC decimator followed by a
+*  3 tap FIR that compensates for CIC passband droop, producing a fast
+*  stream (~decimFastRate).  The fast stream is filtered again by a
+*  second CIC and FIR to produce a slow stream (~decimSlowRate).
+*
+*  Both streams are for display and logging only.  The fast stream feeds
+*  just the peak current shown in the debug summary (pipeline.h).
+*  Protection is by the analog watchdog and frame scans (awd.h), and the
+*  charge controller works from each frame's average.  At the default
+*  sampling profile's 1280 rows/s, the fast ratio nearest decimFastRate
+*  is 1, so the fast stream is then the unfiltered rows.
+*
+*  Outputs are in units of 1/4 ADC count, so the extra resolution gained
+*  by filtering is not discarded.
+*
+***************************************************************/
+
+#ifndef DECIMATE_H
+#define DECIMATE_H
+
+#include <hal.h>
+#include "accum.h"
+
+#define decimFastRate  1000  //target fast stream samples per second
+#define decimSlowRate  20    //target slow stream samples per second
+
+#define cicOrder       3
+#define fastMaxRatio   64   //12 bit inputs grow 18 bits in 32 bit integrators
+#define slowMaxRatio   256
+
+typedef struct {
+  uint32_t integ[cicOrder];  //integrators (modulo 2^32)
+  uint32_t comb[cicOrder];   //previous input of each comb
+  int32_t  fir[2];           //previous CIC outputs
+} FastCIC;
+
+typedef struct {
+  uint64_t integ[cicOrder];  //integrators (modulo 2^64)
+  uint64_t comb[cicOrder];   //previous input of each comb
+  int32_t  fir[2];           //previous CIC outputs
+} SlowCIC;
+
+typedef struct {
+  int32_t  chan[ADCchannels];  //filtered channels, 1/4 ADC counts
+  int32_t  current;            //filtered Vcc/2 - sense, 1/4 ADC counts
+  uint32_t seq;                //sample number within its stream
+} DecimatedSample;
+
+typedef void (*DecimatedSink)(const DecimatedSample *sample);
+
+typedef struct {
+  unsigned fastRatio, slowRatio;  //input samples per output
+  unsigned fastPhase, slowPhase;  //inputs since last output
+  int64_t  fastRecip, slowRecip;  //output scale, 40 fraction bits
+  int32_t  fastTap, slowTap;      //outer taps of droop compensators, /16
+  DecimatedSink fastSink, slowSink;
+  DecimatedSample fastOut, slowOut;
+  FastCIC fast[ADCchannels];
+  SlowCIC slow[ADCchannels];
+} Decimator;
+
+void decimatorInit(Decimator *d, unsigned rowRate,
+                   DecimatedSink fastSink, DecimatedSink slowSink);
+/*
+  reset decimator for inputs arriving at rowRate rows per second
+  choose decimation ratios nearest the target fast and slow rates
+  either sink may be NULL
+*/
+
+void decimate(Decimator *d, const adcsample_t *samples, size_t depth);
+/*
+  filter depth rows of interleaved samples
+  sinks are called with each new output sample
+*/
+
+#define decimatorFastRate(d, rowRate)  ((rowRate) / (d)->fastRatio)
+#define decimatorSlowRate(d, rowRate) \
+          ((rowRate) / ((d)->fastRatio * (d)->slowRatio))
+
+#endif /* DECIMATE_H */
@@ -0,0 +1,231 @@
+/**********************  fault.c  ************************
+*
+*  Capture the raw frames before and after a fault
+*
+*  Frame i of the ring occupies ring[i*depth*ADCchannels] onward.
+*  next is the frame to be overwritten, so the oldest frame held is
+*  next itself once the ring has wrapped.
+*
+*  The ADC refills a half of its buffer only after the other half
+*  completes, so the copy of each half has a whole frame time to finish.
+*
+*  Triggers fired in the frame loop measure their latency from the
+*  completion of the frame in which the fault was seen.
+*
+***************************************************************/
+
+#include "fault.h"
+#include "pins.h"
+#include "sampling.h"
+
+#define copyStream  STM32_DMA1_STREAM7  /* unused by any peripheral */
+#define copyMode    (STM32_DMA_CR_PSIZE_HWORD | STM32_DMA_CR_MSIZE_HWORD | \
+                     STM32_DMA_CR_PL(0))
+
+static adcsample_t ring[faultRingSamples] __attribute__((aligned(4)));
+
+typedef struct {
+  uint32_t   seq;
+  halrtcnt_t stamp;     //CPU cycle counter when it completed
+  uint16_t   dac;       //DAC output then
+  bool_t     charging;  //CHARGER then
+} FrameInfo;
+
+static FrameInfo info[faultMaxFrames];
+static unsigned depth;        //rows per frame in the ring
+static unsigned next;         //frame to be overwritten next
+static unsigned postLeft;     //frames to record before freezing
+static uint32_t lastSeq;      //sequence # of last frame completed
+static FaultCapture capture;
+
+static uint16_t low[ADCchannels], high[ADCchannels];  //threshold windows
+
+
+static void freezeI(halrtcnt_t now)
+{
+  capture.frozen = TRUE;
+  capture.latency = now - capture.stamp;
+}
+
+
+void faultInit(unsigned post, unsigned triggers)
+/*
+  allocate the copying DMA stream and arm the given triggers
+  with post frames to be recorded after the trigger
+*/
+{
+  unsigned column;
+  for (column = 0; column < ADCchannels; column++) {
+    low[column] = 1;
+    high[column] = 0;
+  }
+  dmaStreamAllocate(copyStream, 0, NULL, NULL);
+  faultArm(post, triggers);
+}
+
+
+bool_t faultArm(unsigned post, unsigned triggers)
+/*
+  empty the ring and arm the given triggers
+  with post frames to be recorded after the trigger
+  returns FALSE if post is not less than the ring's capacity
+  (faultMaxFrames until the first frame sets the depth)
+*/
+{
+  chSysLock();
+  if (post >= (depth ? capture.capacity : faultMaxFrames)) {
+    chSysUnlock();
+    return FALSE;
+  }
+  capture.triggers = triggers & faultAllTriggers;
+  capture.post = post;
+  capture.frames = next = 0;
+  capture.cause = 0;
+  capture.frozen = FALSE;
+  chSysUnlock();
+  return TRUE;
+}
+
+
+void faultWindow(unsigned column, uint16_t lowest, uint16_t highest)
+/*
+  trigger when any sample in column is outside [low, high]
+  disable column's trigger if low > high
+*/
+{
+  chSysLock();  //faultScan() reads both together
+  low[column] = lowest;
+  high[column] = highest;
+  chSysUnlock();
+}
+
+
+void faultFrameI(const adcsample_t *samples, size_t rows, uint32_t seq)
+/*
+  record a completed frame in the ring unless it is frozen
+  (from the ADC's end of conversion callback)
+*/
+{
+  lastSeq = seq;
+  if (capture.frozen)
+    return;
+  halrtcnt_t now = halGetCounterValue();
+  if (rows != depth) {  //sampling profile changed
+    unsigned capacity = faultRingSamples / (rows * ADCchannels);
+    capture.capacity = capacity < faultMaxFrames ? capacity : faultMaxFrames;
+    capture.rate = samplingProfile()->rate;
+    capture.frames = next = 0;
+    depth = rows;
+    if (capture.post >= capture.capacity)  //post frames must not fill the ring
+      capture.post = capture.capacity ? capture.capacity-1 : 0;
+    if (postLeft > capture.capacity)  //fired already, so record a ringful
+      postLeft = capture.capacity;
+  }
+  if (!capture.capacity)
+    return;
+  size_t count = rows * ADCchannels;
+  dmaStreamDisable(copyStream);
+  dmaStartMemCopy(copyStream, copyMode, samples, ring + next*count, count);
+  FrameInfo *f = info + next;
+  f->seq = seq;
+  f->stamp = now;
+  f->dac = DAC->DOR1;
+  f->charging = padLatched(CHARGER);
+  if (++next == capture.capacity)
+    next = 0;
+  if (capture.frames < capture.capacity)
+    capture.frames++;
+  if (capture.cause && !--postLeft)
+    freezeI(now);
+}
+
+
+void faultTriggerI(unsigned cause, unsigned column, halrtcnt_t stamp)
+/*
+  fire trigger cause, if armed, for an event at CPU cycle count stamp
+  (from within a kernel lock)
+*/
+{
+  if (capture.cause || !(capture.triggers & cause))
+    return;
+  capture.cause = cause;
+  capture.column = column;
+  capture.seq = lastSeq;
+  capture.stamp = stamp;
+  postLeft = capture.post;
+  if (!postLeft)
+    freezeI(halGetCounterValue());
+}
+
+
+void faultTrigger(unsigned cause, unsigned column, halrtcnt_t stamp)
+/*
+  fire trigger cause, if armed, for an event at CPU cycle count stamp
+*/
+{
+  chSysLock();
+  faultTriggerI(cause, column, stamp);
+  chSysUnlock();
+}
+
+
+void faultScan(const AnalogFrame *frame)
+/*
+  fire the threshold trigger if any sample is outside its column's window
+*/
+{
+  if (capture.cause || !(capture.triggers & faultThreshold))
+    return;
+  unsigned column;
+  for (column = 0; column < ADCchannels; column++) {
+    chSysLock();
+    uint16_t lo = low[column], hi = high[column];
+    chSysUnlock();
+    if (lo <= hi) {
+      const adcsample_t *sample = frame->samples + column;
+      const adcsample_t *end = sample + frame->depth * ADCchannels;
+      for (; sample < end; sample += ADCchannels)
+        if (*sample < lo || *sample > hi) {
+          faultTrigger(faultThreshold, column, frame->stamp);
+          return;
+        }
+    }
+  }
+}
+
+
+unsigned faultLastCapture(FaultCapture *status)
+/*
+  copy the current capture's status
+  returns the trigger that fired, or 0
+*/
+{
+  chSysLock();
+  *status = capture;
+  chSysUnlock();
+  return status->cause;
+}
+
+
+bool_t faultFrame(unsigned i, AnalogFrame *frame,
+                  uint16_t *dac, bool_t *charging)
+/*
+  return the ith frame held by the frozen ring, oldest first,
+  with the DAC output and CHARGER state when it completed
+  returns FALSE if the ring is not frozen or does not hold that frame
+*/
+{
+  if (!capture.frozen || i >= capture.frames)
+    return FALSE;
+  unsigned slot = capture.frames < capture.capacity ? i : next + i;
+  if (slot >= capture.capacity)
+    slot -= capture.capacity;
+  const FrameInfo *f = info + slot;
+  frame->samples = ring + slot * depth * ADCchannels;
+  frame->depth = depth;
+  frame->seq = f->seq;
+  frame->stamp = f->stamp;
+  *dac = f->dac;
+  *charging = f->charging;
+  return TRUE;
+}
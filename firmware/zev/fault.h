@@ -0,0 +1,108 @@
+/**********************  fault.h  ************************
+*
+*  Capture the raw frames before and after a fault
+*
+*  A RAM ring holds the most recent raw ADC frames.  When an armed trigger
+*  fires, the ring keeps recording a configured number of post-trigger
+*  frames, then freezes until rearmed, holding the waveform that led up
+*  to the fault and what followed.  The frozen ring may be downloaded
+*  as raw frame records (rawframe.h) with reportCapture().
+*
+*  Each frame is copied into the ring by a memory to memory DMA transfer
+*  started from the ADC's end of conversion interrupt, so recording
+*  costs the CPU only the few register writes that start it.
+*
+*  The ring's frames share faultRingSamples, so it holds more shallow
+*  frames than deep ones.  Changing the sampling depth empties it and
+*  reduces post, if need be, to less than the new capacity.
+*
+***************************************************************/
+
+#ifndef FAULT_H
+#define FAULT_H
+
+#include "frameq.h"
+
+#define faultRingSamples  2048  /* samples shared by the ring's frames */
+#define faultMaxFrames    32    /* most frames the ring holds */
+
+/*
+ * Triggers
+ */
+#define faultThreshold   0x01  /* a sample outside its column's window */
+#define faultAdcError    0x02  /* ADC or its DMA failed */
+#define faultTrip        0x04  /* fast protection tripped (awd.h) */
+#define faultCommand     0x08  /* requested by serial command */
+#define faultAllTriggers 0x0f
+
+typedef struct {
+  unsigned   triggers;   //triggers armed
+  unsigned   post;       //frames to record after the trigger
+  unsigned   capacity;   //frames the ring holds at the current depth
+  unsigned   rate;       //frames/second being recorded
+  unsigned   frames;     //frames now held
+  unsigned   cause;      //trigger that fired, or 0
+  unsigned   column;     //row column of a threshold trigger
+  uint32_t   seq;        //sequence # of last frame completed when it fired
+  halrtcnt_t stamp;      //CPU cycle counter at the triggering event
+  halrtcnt_t latency;    //CPU cycles from that event until the ring froze
+  bool_t     frozen;     //ring holds its frames until rearmed
+} FaultCapture;
+
+void faultInit(unsigned post, unsigned triggers);
+/*
+  allocate the copying DMA stream and arm the given triggers
+  with post frames to be recorded after the trigger
+*/
+
+bool_t faultArm(unsigned post, unsigned triggers);
+/*
+  empty the ring and arm the given triggers
+  with post frames to be recorded after the trigger
+  returns FALSE if post is not less than the ring's capacity
+  (faultMaxFrames until the first frame sets the depth)
+*/
+
+void faultWindow(unsigned column, uint16_t low, uint16_t high);
+/*
+  trigger when any sample in column is outside [low, high]
+  disable column's trigger if low > high
+*/
+
+void faultFrameI(const adcsample_t *samples, size_t depth, uint32_t seq);
+/*
+  record a completed frame in the ring unless it is frozen
+  (from the ADC's end of conversion callback)
+*/
+
+void faultTriggerI(unsigned cause, unsigned column, halrtcnt_t stamp);
+/*
+  fire trigger cause, if armed, for an event at CPU cycle count stamp
+  (from within a kernel lock)
+*/
+
+void faultTrigger(unsigned cause, unsigned column, halrtcnt_t stamp);
+/*
+  fire trigger cause, if armed, for an event at CPU cycle count stamp
+*/
+
+void faultScan(const AnalogFrame *frame);
+/*
+  fire the threshold trigger if any sample is outside its column's window
+*/
+
+unsigned faultLastCapture(FaultCapture *capture);
+/*
+  copy the current capture's status
+  returns the trigger that fired, or 0
+*/
+
+bool_t faultFrame(unsigned i, AnalogFrame *frame,
+                  uint16_t *dac, bool_t *charging);
+/*
+  return the ith frame held by the frozen ring, oldest first,
+  with the DAC output and CHARGER state when it completed
+  returns FALSE if the ring is not frozen or does not hold that frame
+*/
+
+#endif /* FAULT_H */
@@ -0,0 +1,101 @@
+/**********************  frameq.c  ************************
+*
+*  Single producer / single consumer queue of completed ADC frames
+*
+*  The ADC fills the two halves of its sample buffer alternately.
+*  So, when frame N+1 completes, the DMA starts refilling frame N's half.
+*  A frame is therefore intact only while the producer's next sequence
+*  number is less than two beyond its own.
+*
+***************************************************************/
+
+#include "frameq.h"
+#include "trace.h"
+
+#define frameQmask  (frameQsize-1)
+
+#if frameQsize & frameQmask
+#error  frameQsize must be a power of two
+#endif
+
+#define isStale(q, f)  ((q)->seq - (f)->seq >= 2)
+
+
+void frameqInit(FrameQueue *q)
+{
+  q->head = q->tail = q->seq = 0;
+  q->overruns = q->stale = q->torn = 0;
+  q->waiting = NULL;
+}
+
+
+void frameqPutI(FrameQueue *q, adcsample_t *samples, size_t depth)
+/*
+  queue a completed frame (from within a kernel lock)
+  discard it if the queue is full
+*/
+{
+  uint32_t head = q->head;
+  uint32_t seq = q->seq;
+  if (head - q->tail < frameQsize) {
+    AnalogFrame *f = q->frame + (head & frameQmask);
+    f->samples = samples;
+    f->depth = depth;
+    f->seq = seq;
+    f->stamp = halGetCounterValue();
+    q->head = head+1;
+  }else
+    q->overruns++;
+  q->seq = seq+1;
+  if (q->waiting) {
+    trace(traceWakeup, q->waiting->p_prio);
+    chSchReadyI(q->waiting);
+    q->waiting = NULL;
+  }
+}
+
+
+const AnalogFrame *frameqGet(FrameQueue *q)
+/*
+  wait for the oldest frame whose buffer is not already being refilled
+  The frame remains valid until it is released
+*/
+{
+  while (TRUE) {
+    if (q->head == q->tail) {
+      chSysLock();
+      while (q->head == q->tail) {
+        q->waiting = chThdSelf();
+        chSchGoSleepS(THD_STATE_SUSPENDED);
+      }
+      chSysUnlock();
+    }
+    AnalogFrame *f = q->frame + (q->tail & frameQmask);
+    if (!isStale(q, f))
+      return f;
+    q->stale++;  //its buffer is already being refilled
+    q->tail++;
+  }
+}
+
+void frameqFlushI(FrameQueue *q)
+/*
+  make every frame queued or being processed stale (from within a kernel lock)
+  for when the DMA buffer layout they point into changes
+*/
+{
+  q->seq += 2;  //so frameqGet() skips them, and frameqRelease() finds torn
+}
+
+bool_t frameqRelease(FrameQueue *q, const AnalogFrame *frame)
+/*
+  release a frame returned by frameqGet()
+  returns FALSE if the DMA overwrote any of its samples before release
+*/
+{
+  bool_t intact = !isStale(q, frame);
+  if (!intact)
+    q->torn++;
+  q->tail++;
+  return intact;
+}
@@ -0,0 +1,71 @@
+/**********************  frameq.h  ************************
+*
+*  Single producer / single consumer queue of completed ADC frames
+*
+*  The ADC end of conversion callback puts each completed half of the
+*  circular DMA buffer; the analog processing thread gets them in order.
+*  Every frame carries a sequence number, so that frames that are lost
+*  and frames whose buffer was overwritten by the DMA while they were
+*  being processed can be counted.
+*
+*  Producer and consumer each own one index, so no lock is needed to
+*  move frames.  The kernel is entered only to put the consumer to sleep
+*  when the queue is empty and to wake it up again.
+*
+***************************************************************/
+
+#ifndef FRAMEQ_H
+#define FRAMEQ_H
+
+#include <ch.h>
+#include <hal.h>
+
+#define frameQsize  4  //must be a power of two
+
+typedef struct {
+  adcsample_t *samples;  //first sample of this frame's rows
+  size_t      depth;     //# of rows in this frame
+  uint32_t    seq;       //sequence number of this frame
+  halrtcnt_t  stamp;     //CPU cycle counter when frame completed
+} AnalogFrame;
+
+typedef struct {
+  AnalogFrame frame[frameQsize];
+  volatile uint32_t head;     //advanced only by producer
+  volatile uint32_t tail;     //advanced only by consumer
+  volatile uint32_t seq;      //sequence number of next frame produced
+  volatile unsigned overruns; //frames discarded because the queue was full
+  unsigned stale;    //queued frames skipped because DMA was overwriting them
+  unsigned torn;     //frames overwritten by DMA while being processed
+  Thread *waiting;   //consumer awaiting next frame
+} FrameQueue;
+
+void frameqInit(FrameQueue *q);
+
+void frameqPutI(FrameQueue *q, adcsample_t *samples, size_t depth);
+/*
+  queue a completed frame (from within a kernel lock)
+  discard it if the queue is full
+*/
+
+const AnalogFrame *frameqGet(FrameQueue *q);
+/*
+  wait for the oldest frame whose buffer is not already being refilled
+  The frame remains valid until it is released
+*/
+
+bool_t frameqRelease(FrameQueue *q, const AnalogFrame *frame);
+/*
+  release a frame returned by frameqGet()
+  returns FALSE if the DMA overwrote any of its samples before release
+*/
+
+void frameqFlushI(FrameQueue *q);
+/*
+  make every frame queued or being processed stale (from within a kernel lock)
+  for when the DMA buffer layout they point into changes
+*/
+
+#define frameqDropped(q)  ((q)->overruns + (q)->stale)
+
+#endif /* FRAMEQ_H */
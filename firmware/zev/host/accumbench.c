@@ -0,0 +1,130 @@
+/**********************  host/accumbench.c  ************************
+*
+*  Compare the channel summing kernels with the loop they replaced
+*
+*  The frame loop once walked the interleaved buffer in one strided pass
+*  per channel, then a seventh pass for the (Vcc/2 - sense) differential.
+*  That loop is reproduced here without its averaging divide.  At each
+*  of several depths, it sums random frames along with accumulateScalar()
+*  and accumulateSWAR().  The bench checks that all three agree, then
+*  reports the time and, on x86, the time stamp counter cycles that
+*  each takes per frame.
+*
+*  Host timings show the relative cost of the memory access patterns.
+*  Set accumCheck in zev.c to measure the kernels on the target.
+*
+*  usage:  zevaccumbench {frames}
+*
+***************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "accum.h"
+#include "sampling.h"
+
+#define buffers  64  /* distinct frames summed in turn */
+
+static const unsigned depths[] = {16, 32, 64, 128};
+
+static adcsample_t frame[buffers][ADCchannels*ADCmaxDepth]
+  __attribute__((aligned(4)));
+static volatile int32_t sink;  //so the sums are not optimized away
+
+
+__attribute__((noinline))
+static void accumulateStrided(ChannelSums *sums,
+                              const adcsample_t *samples, size_t depth)
+/*
+  sum each channel in a pass of its own, as zev.c's frame loop did
+*/
+{
+  unsigned chan;
+  const adcsample_t *end = samples + depth*ADCchannels;
+  for(chan=0; chan < ADCchannels; chan++) {
+    const adcsample_t *row = samples+chan;
+    uint32_t *cursor = sums->sum+chan;
+    *cursor=0;
+    do {
+      *cursor += *row;
+      row += ADCchannels;
+    } while (row < end);
+  }
+  int32_t current = 0;
+  {
+    const adcsample_t *currentRow = samples+5;
+    do {
+      current += currentRow[-1] - currentRow[0]; /* vcc/2 - current */
+      currentRow += ADCchannels;
+    } while (currentRow < end);
+  }
+  sums->current = current;
+}
+
+static uint64_t nanoseconds(void)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+static uint64_t cycles(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+  return __builtin_ia32_rdtsc();
+#else
+  return 0;
+#endif
+}
+
+typedef void kernel(ChannelSums *sums, const adcsample_t *samples, size_t depth);
+
+static void bench(const char *name, kernel *accumulate,
+                  size_t depth, unsigned long frames)
+{
+  ChannelSums sums;
+  unsigned long i;
+  uint64_t ns = nanoseconds(), tsc = cycles();
+  for (i = 0; i < frames; i++) {
+    accumulate(&sums, frame[i % buffers], depth);
+    sink = sums.current;
+  }
+  tsc = cycles() - tsc;
+  ns = nanoseconds() - ns;
+  printf("  %-8s %7.1f ns/frame", name, (double)ns / frames);
+  if (tsc)
+    printf(", %7.1f cycles/frame", (double)tsc / frames);
+  printf("\n");
+}
+
+
+int main(int argc, char **argv)
+{
+  unsigned long frames = argc > 1 ? strtoul(argv[1], NULL, 0) : 1000000;
+  unsigned b, d, mismatches = 0;
+  size_t i;
+  for (b = 0; b < buffers; b++)
+    for (i = 0; i < ADCchannels*ADCmaxDepth; i++)
+      frame[b][i] = rand() & 0xfff;
+  for (d = 0; d < sizeof depths / sizeof *depths; d++)
+    for (b = 0; b < buffers; b++) {
+      ChannelSums strided, scalar, swar;
+      accumulateStrided(&strided, frame[b], depths[d]);
+      accumulateScalar(&scalar, frame[b], depths[d]);
+      accumulateSWAR(&swar, frame[b], depths[d]);
+      if (memcmp(&strided, &scalar, sizeof scalar) ||
+          memcmp(&strided, &swar, sizeof swar))
+        mismatches++;
+    }
+  printf("%u mismatches in %u frames\n",
+         mismatches, buffers * (unsigned)(sizeof depths / sizeof *depths));
+  for (d = 0; d < sizeof depths / sizeof *depths; d++) {
+    printf("depth %u:\n", depths[d]);
+    bench("strided", accumulateStrided, depths[d], frames);
+    bench("scalar", accumulateScalar, depths[d], frames);
+    bench("SWAR", accumulateSWAR, depths[d], frames);
+  }
+  return mismatches != 0;
+}
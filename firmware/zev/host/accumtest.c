@@ -0,0 +1,88 @@
+/**********************  host/accumtest.c  ************************
+*
+*  Check accumulateSWAR() against accumulateScalar() at every depth
+*
+*  Full scale (0xfff) samples are the worst case for the SWAR lanes,
+*  since each must then hold SWARspan (16) rows without carrying into
+*  its neighbor.  Frames of all 0xfff, of 0xfff in alternate lanes
+*  and of random 12-bit samples are summed both ways at every depth
+*  from 1 to ADCmaxDepth rows.  Any sum that differs is a mismatch.
+*
+*  usage:  zevaccumtest
+*  exits with status 1 if any sum differs
+*
+***************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "accum.h"
+#include "sampling.h"
+
+#define ADCmaxSample  0xfff
+
+static adcsample_t frame[ADCchannels*ADCmaxDepth] __attribute__((aligned(4)));
+
+
+static unsigned compare(const char *pattern, size_t depth)
+/*
+  sum depth rows of frame both ways
+  returns 1 if they differ, 0 if not
+*/
+{
+  ChannelSums swar, scalar;
+  accumulateSWAR(&swar, frame, depth);
+  accumulateScalar(&scalar, frame, depth);
+  if (!memcmp(&swar, &scalar, sizeof swar))
+    return 0;
+  unsigned chan;
+  printf("%s frame, depth %u:", pattern, (unsigned)depth);
+  for (chan = 0; chan < ADCchannels; chan++)
+    if (swar.sum[chan] != scalar.sum[chan])
+      printf("  ch%u %u != %u", chan, swar.sum[chan], scalar.sum[chan]);
+  if (swar.current != scalar.current)
+    printf("  current %d != %d", swar.current, scalar.current);
+  printf("\n");
+  return 1;
+}
+
+
+int main(void)
+{
+  unsigned mismatches = 0, checked = 0;
+  size_t depth, i;
+  for (depth = 1; depth <= ADCmaxDepth; depth++) {
+    for (i = 0; i < ADCchannels*depth; i++)
+      frame[i] = ADCmaxSample;
+    mismatches += compare("full scale", depth);
+    ChannelSums sums;
+    accumulateSWAR(&sums, frame, depth);
+    for (i = 0; i < ADCchannels; i++)
+      if (sums.sum[i] != depth*ADCmaxSample) {
+        printf("full scale frame, depth %u: ch%u summed to %u\n",
+               (unsigned)depth, (unsigned)i, sums.sum[i]);
+        mismatches++;
+        break;
+      }
+
+    for (i = 0; i < ADCchannels*depth; i++)
+      frame[i] = i & 1 ? 0 : ADCmaxSample;
+    mismatches += compare("low lanes full scale", depth);
+
+    for (i = 0; i < ADCchannels*depth; i++)
+      frame[i] = i & 1 ? ADCmaxSample : 0;
+    mismatches += compare("high lanes full scale", depth);
+
+    unsigned trial;
+    for (trial = 0; trial < 100; trial++) {
+      for (i = 0; i < ADCchannels*depth; i++)
+        frame[i] = rand() & ADCmaxSample;
+      mismatches += compare("random", depth);
+    }
+    checked += 103;
+  }
+  printf("%u frames checked at depths 1 to %u, %u mismatches\n",
+         checked, ADCmaxDepth, mismatches);
+  return mismatches != 0;
+}
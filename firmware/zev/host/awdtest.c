@@ -0,0 +1,157 @@
+/**********************  host/awdtest.c  ************************
+*
+*  Check that the protection drops CHARGER and records each trip
+*
+*  awd.c is linked with stand-ins for the registers it touches.  Frames
+*  are scanned with a PC2 celltop sample over its limit, as zev.c's
+*  adcDone() scans them, and the analog watchdog's interrupt is raised
+*  for an over-limit conversion of the current sensor, as simadc.c does.
+*  Each trip must drop CHARGER, chain to the ADC driver's handler (for
+*  the watchdog), and leave awdLastTrip() and the flight recorder
+*  holding its source, column or channel, and latency.  Frames within
+*  limits, or scanned with CHARGER off, must not trip.
+*
+*  Stamps advance 100 cycles per read of the counter.
+*
+*  usage:  zevawdtest
+*  exits with status 1 if any check fails
+*
+***************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "awd.h"
+#include "irqhook.h"
+#include "pins.h"
+#include "sampling.h"
+#include "trace.h"
+
+#define celltopColumn  3     /* PC2 position in each sample row, as zev.c */
+#define celltopLimit   2048
+#define depth          64
+#define triggerTicks   100   /* timer ticks from trigger to watchdog */
+
+GPIO_TypeDef hostGPIOC;
+ADC_TypeDef hostADC1;
+SCB_Type hostSCB;
+stm32_tim_t hostTIM6;
+RCC_TypeDef hostRCC;
+
+static halrtcnt_t now;
+static unsigned driverIrqs, failures;
+static uint32_t groupCR1;  //as sampling.c stores it for every start
+
+halrtcnt_t halGetCounterValue(void)
+{
+  return now += 100;
+}
+
+void samplingSetCR1(uint32_t cr1)
+{
+  ADC1->CR1 = groupCR1 = cr1;
+}
+
+void samplingClearCR1I(uint32_t bits)
+{
+  groupCR1 &= ~bits;
+  ADC1->CR1 &= ~bits;
+}
+
+static void adcDriverIrq(void)
+{
+  driverIrqs++;
+}
+
+void (*const hostVectors[64])(void) = {
+  [16+ADC1_IRQn] = adcDriverIrq
+};
+
+
+static void check(int ok, const char *what)
+{
+  if (!ok) {
+    printf("FAILED:  %s\n", what);
+    failures++;
+  }
+}
+
+static uint32_t lastEvent(void)
+{
+  return traceRing.event[(traceRing.head-1) & (traceEvents-1)].what;
+}
+
+
+static void scan(const adcsample_t *frame, const char *what)
+/*
+  scan frame as zev.c does and report any trip
+*/
+{
+  AwdTrip trip;
+  unsigned before = awdLastTrip(&trip);
+  bool_t tripped = awdScanI(frame, depth, celltopColumn, 0, celltopLimit);
+  unsigned after = awdLastTrip(&trip);
+  printf("%s:  %s", what, tripped ? "tripped" : "no trip");
+  if (after != before)
+    printf(" #%u, source %u, column %u, %u cycles, %uns latency",
+           trip.trips, trip.source, trip.channel, trip.isrCycles, trip.latency);
+  printf(", CHARGER %s\n", padLatched(CHARGER) ? "on" : "off");
+}
+
+
+int main(void)
+{
+  static adcsample_t frame[depth*ADCchannels];
+  AwdTrip trip;
+  unsigned i;
+  for (i = 0; i < depth*ADCchannels; i++)
+    frame[i] = 1000;
+  awdInit();
+  setPad(CHARGER);
+
+  scan(frame, "PC2 within limit");
+  check(padLatched(CHARGER) && !awdLastTrip(&trip),
+        "a frame within limits left CHARGER on");
+
+  frame[40*ADCchannels + celltopColumn] = celltopLimit+1;
+  scan(frame, "PC2 over limit");
+  awdLastTrip(&trip);
+  check(!padLatched(CHARGER), "PC2 over its limit dropped CHARGER");
+  check(trip.trips == 1 && trip.source == awdSoftware &&
+        trip.channel == celltopColumn, "the scan recorded its source and column");
+  check(trip.isrCycles == 100 && !trip.latency,
+        "the scan recorded its cycles and no trigger latency");
+  check(lastEvent() == (traceTrip | (awdSoftware << 8 | celltopColumn) << 8),
+        "the flight recorder holds the scan's trip");
+
+  scan(frame, "PC2 over limit, CHARGER off");
+  check(awdLastTrip(&trip) == 1, "a scan with CHARGER off did not trip");
+
+  setPad(CHARGER);
+  awdArm(ADC_CHANNEL_IN2, 1500, 0xfff);
+  check((ADC1->CR1 & (ADC_CR1_AWDEN | ADC_CR1_AWDIE | ADC_CR1_AWDCH)) ==
+        (ADC_CR1_AWDEN | ADC_CR1_AWDIE | ADC_CHANNEL_IN2),
+        "awdArm() enabled the watchdog on the current sensor");
+  ADC1->SR |= ADC_SR_AWD;  //a conversion of IN2 below 1500
+  STM32_TIM6->CNT = triggerTicks;
+  ((irqHandler *)SCB->VTOR)[16+ADC1_IRQn]();
+  awdLastTrip(&trip);
+  printf("watchdog:  #%u, source %u, channel %u, %u cycles, %uns latency, "
+         "CHARGER %s\n", trip.trips, trip.source, trip.channel,
+         trip.isrCycles, trip.latency, padLatched(CHARGER) ? "on" : "off");
+  check(!padLatched(CHARGER), "the watchdog dropped CHARGER");
+  check(driverIrqs == 1, "the watchdog chained to the ADC driver");
+  check(!(ADC1->SR & ADC_SR_AWD) && !(ADC1->CR1 & ADC_CR1_AWDIE),
+        "the watchdog was cleared and disabled until rearmed");
+  check(!(groupCR1 & ADC_CR1_AWDIE),
+        "the watchdog stays disabled if sampling is restarted");
+  check(trip.trips == 2 && trip.source == awdHardware &&
+        trip.channel == ADC_CHANNEL_IN2, "the watchdog recorded its source");
+  check(trip.latency == triggerTicks * (1000000000 / adcTimeBase),
+        "the watchdog recorded its latency from the trigger");
+  check(lastEvent() == (traceTrip | (awdHardware << 8 | ADC_CHANNEL_IN2) << 8),
+        "the flight recorder holds the watchdog's trip");
+
+  printf("%u failures\n", failures);
+  return failures != 0;
+}
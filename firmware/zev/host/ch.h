@@ -0,0 +1,138 @@
+/**********************  host/ch.h  ************************
+*
+*  Minimal stand-in for the ChibiOS/RT kernel API used by the
+*  ZEV charger signal path, so it may be built and run natively on the host.
+*
+*  Threads are scheduled cooperatively, by priority, whenever the running
+*  thread goes to sleep or wakes a higher priority thread.  When no thread
+*  is ready, the simulated hardware (simadc.c) runs until an interrupt
+*  handler readies one.  Kernel locks are therefore unnecessary.
+*
+***************************************************************/
+
+#ifndef _CH_H_
+#define _CH_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdarg.h>
+
+#define CH_FREQUENCY  100  /* as in stm32l-discovery/chconf.h */
+
+#define TRUE   1
+#define FALSE  0
+
+#define INLINE inline
+
+typedef int32_t  bool_t;
+typedef int32_t  msg_t;
+typedef uint32_t systime_t;
+typedef uint8_t  tprio_t;
+
+typedef msg_t (*tfunc_t)(void *);
+
+typedef struct Thread {
+  const char *p_name;
+  tprio_t     p_prio;
+  uint8_t     p_state;
+  union {
+    msg_t rdymsg;
+  } p_u;
+  tfunc_t     p_func;     //host only -- thread's function
+  void        *p_arg;     //host only -- and its argument
+  void        *p_context; //host only -- saved ucontext
+  systime_t   p_wake;     //host only -- end of chThdSleep()
+} Thread;
+
+#define THD_STATE_READY       0
+#define THD_STATE_CURRENT     1
+#define THD_STATE_SUSPENDED   2
+#define THD_STATE_SLEEPING    8
+#define THD_STATE_WTQUEUE     13
+#define THD_STATE_FINAL       14
+
+#define NORMALPRIO  64
+#define LOWPRIO     2
+
+#define RDY_OK       0
+#define RDY_TIMEOUT  -1
+#define RDY_RESET    -2
+
+#define Q_OK         RDY_OK
+#define Q_TIMEOUT    RDY_TIMEOUT
+#define Q_RESET      RDY_RESET
+#define Q_EMPTY      -3
+#define Q_FULL       -4
+
+#define TIME_IMMEDIATE  ((systime_t)0)
+#define TIME_INFINITE   ((systime_t)-1)
+
+#define S2ST(sec)   ((systime_t)((sec) * CH_FREQUENCY))
+#define MS2ST(msec) ((systime_t)(((msec) * CH_FREQUENCY - 1L) / 1000L + 1L))
+
+#define chSysInit()
+#define chSysLock()
+#define chSysUnlock()
+#define chSysLockFromIsr()
+#define chSysUnlockFromIsr()
+
+#define chRegSetThreadName(name)  (chThdSelf()->p_name = (name))
+
+/* host threads need far more stack than the target's to call the C library */
+#define WORKING_AREA(s, n)  uint64_t s[((n) + 65536) / sizeof(uint64_t)]
+
+Thread *chThdCreateStatic(void *wsp, size_t size,
+                          tprio_t prio, tfunc_t pf, void *arg);
+Thread *chThdSelf(void);
+systime_t chTimeNow(void);
+void chThdSleep(systime_t time);
+#define chThdSleepMilliseconds(msec)  chThdSleep(MS2ST(msec))
+
+void chSchReadyI(Thread *tp);
+void chSchWakeupS(Thread *ntp, msg_t msg);
+void chSchGoSleepS(uint8_t newstate);
+/*
+  switch to the highest priority ready thread, if necessary
+  running the simulation until some event readies one
+*/
+
+/*
+ * Sequential streams, just enough for chprintf()
+ */
+#define _base_sequential_stream_methods                                     \
+  size_t (*write)(void *instance, const uint8_t *bp, size_t n);             \
+  size_t (*read)(void *instance, uint8_t *bp, size_t n);                    \
+  msg_t (*put)(void *instance, uint8_t b);                                  \
+  msg_t (*get)(void *instance);
+
+struct BaseSequentialStreamVMT {
+  _base_sequential_stream_methods
+};
+
+typedef struct {
+  const struct BaseSequentialStreamVMT *vmt;
+} BaseSequentialStream;
+
+#define chSequentialStreamWrite(ip, bp, n)  ((ip)->vmt->write(ip, bp, n))
+#define chSequentialStreamPut(ip, b)        ((ip)->vmt->put(ip, b))
+
+/*
+ * Stand-ins for the debug core register through which dccput.c passes
+ * messages to the debugger, and for the one that shows it is attached
+ * (see host/dccbench.c)
+ */
+volatile uint16_t *hostDCRDR(void);
+volatile uint32_t *hostDHCSR(void);
+
+/*
+ * Mutexes, just enough for debugput.c
+ */
+typedef struct {
+  Thread *m_owner;
+} Mutex;
+
+#define MUTEX_DECL(name)  Mutex name = {NULL}
+#define chMtxLock(mp)     ((void)(mp))
+#define chMtxUnlock()
+
+#endif /* _CH_H_ */
@@ -0,0 +1,84 @@
+/**********************  host/chprintf.c  ************************
+*
+*  chprintf() and memory streams for the host
+*
+*  Formatting is done by the C library, then written to the stream
+*  in one block.
+*
+***************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+
+#include <chprintf.h>
+#include <memstreams.h>
+
+/*
+ * Formatted output
+ */
+void chvprintf(BaseSequentialStream *chp, const char *fmt, va_list ap)
+{
+  char line[512];
+  int len = vsnprintf(line, sizeof line, fmt, ap);
+  if (len > 0) {
+    if ((size_t)len >= sizeof line)
+      len = sizeof line - 1;
+    chSequentialStreamWrite(chp, (const uint8_t *)line, len);
+  }
+}
+
+/*
+ * Memory streams
+ */
+static size_t msWrite(void *instance, const uint8_t *bp, size_t n)
+{
+  MemoryStream *msp = instance;
+  if (n > msp->size - msp->eos)
+    n = msp->size - msp->eos;
+  memcpy(msp->buffer + msp->eos, bp, n);
+  msp->eos += n;
+  return n;
+}
+
+static size_t msRead(void *instance, uint8_t *bp, size_t n)
+{
+  MemoryStream *msp = instance;
+  if (n > msp->eos - msp->offset)
+    n = msp->eos - msp->offset;
+  memcpy(bp, msp->buffer + msp->offset, n);
+  msp->offset += n;
+  return n;
+}
+
+static msg_t msPut(void *instance, uint8_t b)
+{
+  return msWrite(instance, &b, 1) ? RDY_OK : RDY_RESET;
+}
+
+static msg_t msGet(void *instance)
+{
+  uint8_t b;
+  return msRead(instance, &b, 1) ? b : RDY_RESET;
+}
+
+static const struct BaseSequentialStreamVMT msVMT = {
+  msWrite, msRead, msPut, msGet
+};
+
+void msObjectInit(MemoryStream *msp, uint8_t *buffer, size_t size, size_t eos)
+{
+  msp->vmt = &msVMT;
+  msp->buffer = buffer;
+  msp->size = size;
+  msp->eos = eos;
+  msp->offset = 0;
+}
+
+
+void chprintf(BaseSequentialStream *chp, const char *fmt, ...)
+{
+  va_list ap;
+  va_start(ap, fmt);
+  chvprintf(chp, fmt, ap);
+  va_end(ap);
+}
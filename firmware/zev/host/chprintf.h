@@ -0,0 +1,15 @@
+/**********************  host/chprintf.h  ************************
+*
+*  chprintf() for the host, formatted by the C library
+*
+***************************************************************/
+
+#ifndef _CHPRINTF_H_
+#define _CHPRINTF_H_
+
+#include "ch.h"
+
+void chvprintf(BaseSequentialStream *chp, const char *fmt, va_list ap);
+void chprintf(BaseSequentialStream *chp, const char *fmt, ...);
+
+#endif /* _CHPRINTF_H_ */
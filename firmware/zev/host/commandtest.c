@@ -0,0 +1,165 @@
+/**********************  host/commandtest.c  ************************
+*
+*  Check that an immediate shutdown cannot be undone by its own line
+*
+*  command.c is linked with a serial port that types each case's keys
+*  in turn, and a table whose "1" turns CHARGER on, as zev.c's does.
+*  After each case's last key, CHARGER and the command statistics
+*  must be as expected.  A '0' starting a line must turn CHARGER off
+*  at once and discard the rest of the line, however it continues,
+*  while the lines after it are executed as usual.
+*
+*  usage:  zevcommandtest
+*  exits with status 1 if any check fails
+*
+***************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "command.h"
+#include "irqhook.h"
+#include "pins.h"
+
+GPIO_TypeDef hostGPIOC;
+USART_TypeDef hostUSART1;
+SCB_Type hostSCB;
+RCC_TypeDef hostRCC;
+SerialDriver SD1;
+
+static const struct {
+  const char *keys;       //typed, ending with the line's terminator
+  bool_t      charger;    //CHARGER after the last key
+  unsigned    shutdowns;  //commandStats after the last key
+  unsigned    cancelled;
+  unsigned    lines;
+} cases[] = {
+  {"1\r",         TRUE,  0, 0, 1},
+  {"0\r",         FALSE, 1, 0, 1},
+  {"1\r",         TRUE,  1, 0, 2},
+  {"0;1\r",       FALSE, 2, 1, 2},
+  {"01\n",        FALSE, 3, 2, 2},
+  {"0 ;  1;1\r",  FALSE, 4, 3, 2},
+  {"1\r",         TRUE,  4, 3, 3},
+  {"00\r",        FALSE, 5, 4, 3},
+  {"0111111111111111111111111111111111111111111111111111111111111111"
+   "11111111111111111111111111111111111111111111111111111111111111\r",
+                  FALSE, 6, 5, 3},
+  {"1;0\r",       FALSE, 6, 5, 4}
+};
+
+static unsigned current, next, failures;
+static Thread commander;
+
+
+static void serialIrq(void)
+{
+}
+
+void (*const hostVectors[64])(void) = {
+  [16+USART1_IRQn] = serialIrq
+};
+
+halrtcnt_t halGetCounterValue(void)
+{
+  static halrtcnt_t now;
+  return now += 100;
+}
+
+Thread *chThdSelf(void)
+{
+  return &commander;
+}
+
+Thread *chThdCreateStatic(void *wsp, size_t size,
+                          tprio_t prio, tfunc_t pf, void *arg)
+/*
+  run the command thread until it has read every case's keys
+*/
+{
+  (void)wsp; (void)size;
+  commander.p_prio = prio;
+  pf(arg);
+  return &commander;
+}
+
+bool_t reportReply(const char *text, size_t len)
+{
+  printf("  %.*s\n", (int)len, text);
+  return TRUE;
+}
+
+
+static void check(void)
+/*
+  check the state after the current case's last key
+*/
+{
+  char keys[16];
+  snprintf(keys, sizeof keys, "%.*s", (int)strcspn(cases[current].keys, "\r\n"),
+           cases[current].keys);
+  bool_t charger = padLatched(CHARGER) != 0;
+  int ok = charger == cases[current].charger &&
+           commandStats.shutdowns == cases[current].shutdowns &&
+           commandStats.cancelled == cases[current].cancelled &&
+           commandStats.lines == cases[current].lines;
+  printf("\"%s%s\":  CHARGER %s, %u shutdowns, %u cancelled, %u lines%s\n",
+         keys, strlen(keys) < 15 ? "" : "...", charger ? "on" : "off",
+         commandStats.shutdowns, commandStats.cancelled, commandStats.lines,
+         ok ? "" : "  FAILED");
+  failures += !ok;
+}
+
+msg_t chnGetTimeout(SerialDriver *sdp, systime_t time)
+/*
+  type the next key, checking each case after its last
+  exits after the last case
+*/
+{
+  (void)sdp; (void)time;
+  while (!cases[current].keys[next]) {
+    check();
+    if (++current >= sizeof cases / sizeof *cases) {
+      printf("%u failures\n", failures);
+      exit(failures != 0);
+    }
+    next = 0;
+  }
+  USART1->SR |= USART_SR_RXNE;
+  ((irqHandler *)SCB->VTOR)[16+USART1_IRQn]();
+  return (uint8_t)cases[current].keys[next++];
+}
+
+
+static void shutdownNow(void)
+{
+  clearPad(CHARGER);
+}
+
+static const char *offCmd(const char *args)
+{
+  (void)args;
+  clearPad(CHARGER);
+  return NULL;
+}
+
+static const char *onCmd(const char *args)
+{
+  (void)args;
+  setPad(CHARGER);
+  return NULL;
+}
+
+static const Command commands[] = {
+  {"0", offCmd},
+  {"1", onCmd},
+  {NULL}
+};
+
+
+int main(void)
+{
+  commandInit(commands, shutdownNow, NORMALPRIO+1);
+  return 1;  //commandInit() never returns
+}
@@ -0,0 +1,76 @@
+/**********************  host/convtest.c  ************************
+*
+*  Check ampsQ16() against the float formula it replaced
+*
+*  Sweeps every 12-bit Vcc/2 reading against current sums spanning the
+*  full +/- depth*4095 range at several depths and temperatures.  The
+*  reference is the convert.c formula in double precision, saturated to
+*  the q16 range as ampsQ16() is.  Any result more than maxError LSB
+*  away from it is a mismatch.
+*
+*  usage:  zevconvtest
+*  exits with status 1 if any result is out of bounds
+*
+***************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "convert.h"
+
+#define maxError  2       /* q16 LSBs */
+#define steps     1000    /* current sums per Vcc/2 reading */
+
+static const unsigned depths[] = {1, 16, 64, 128};
+static const uint32_t temps[] = {ampTnom, 0, 4095};
+
+
+static double reference(int32_t current, unsigned depth,
+                        uint32_t vccHalf, uint32_t temp)
+/*
+  ampsQ16() in double precision, in q16 LSBs
+*/
+{
+  double deltaT = (double)temp - ampTnom;
+  double amps = (double)ampVnom / vccHalf * (ampScale + ampTscale*deltaT) *
+    ((double)current*ampDepth/depth + ampVoffset + ampToffset*deltaT);
+  double lsbs = floor(amps * Q16one + 0.5);
+  if (lsbs > INT32_MAX)
+    return INT32_MAX;
+  if (lsbs < INT32_MIN)
+    return INT32_MIN;
+  return lsbs;
+}
+
+
+int main(void)
+{
+  unsigned long checked = 0, mismatches = 0;
+  double worst = 0;
+  unsigned d, t;
+  for (d = 0; d < sizeof depths / sizeof *depths; d++) {
+    unsigned depth = depths[d];
+    int32_t span = depth * 4095;
+    for (t = 0; t < sizeof temps / sizeof *temps; t++) {
+      uint32_t vccHalf;
+      for (vccHalf = 1; vccHalf <= 4095; vccHalf++) {
+        int step;
+        for (step = -steps; step <= steps; step++) {
+          int32_t current = (int64_t)span * step / steps;
+          double error = ampsQ16(current, depth, vccHalf, temps[t]) -
+                         reference(current, depth, vccHalf, temps[t]);
+          if (fabs(error) > fabs(worst))
+            worst = error;
+          if (fabs(error) > maxError && mismatches++ < 10)
+            printf("depth=%u temp=%u vcc/2=%u current=%d:  off by %.0f LSB\n",
+                   depth, temps[t], vccHalf, current, error);
+          checked++;
+        }
+      }
+    }
+  }
+  printf("%lu conversions checked, worst error %+.0f LSB, %lu over %d LSB\n",
+         checked, worst, mismatches, maxError);
+  return mismatches != 0;
+}
@@ -0,0 +1,473 @@
+/**********************  host/dccbench.c  ************************
+*
+*  Measure how the debug output reader feeds each transport
+*
+*  The target's debugput.c, debugtransport.c and dccput.c are built against
+*  mocks of each link, and the messages received are reassembled and
+*  checked against the lines output as the ring wraps around.
+*    DCC:     a stand-in for the debug core's DCRDR register that plays
+*             openocd's part of its handshake, taking each byte as soon
+*             as it is written, as would a debugger polling infinitely fast
+*    serial:  a sequential stream that takes bytes as fast as they come
+*    RAM:     the ring itself, read out after each drain, as by gdb,
+*             in time not counted as the target's
+*
+*  First, text lines are output through the ring by debugPut(), and
+*  through DCCputsQ() by a fetcher that takes the kernel lock for each
+*  byte, as the reader did with its ChibiOS output queue.  Then, half
+*  are output in binary by debugLog() to each transport.
+*
+*  Each drain is timed.  Per byte of text the lines hold, it reports the
+*  host CPU time taken, the bytes sent over the link, the target's DCRDR
+*  accesses, the fetcher calls and kernel locks taken, and the releases
+*  of ring space.  The mocks take little time, so the CPU time is close
+*  to the target's share and bounds the sustained throughput of each
+*  transport, as its link would were it slower.
+*
+*  Last, DCC output is timed against simulated hosts that poll DCRDR
+*  periodically and take a message's bytes at a finite rate, and against
+*  a detached one, to measure how awaitReady() backs off while it waits.
+*  Simulated time advances as the target polls DCRDR and as it sleeps.
+*  The time the target waited for the host is reported, with the share
+*  of it spent spinning, rather than sleeping, the sustained throughput
+*  and the bytes dropped for want of a debugger.
+*
+*  usage:  zevdccbench {lines}
+*
+***************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <setjmp.h>
+
+#include "hal.h"
+#include "debugput.h"
+#include "dccput.h"
+#include "logdecode.h"
+
+static char outq[512];
+
+/*
+ * The reader thread runs only when drain() calls its function,
+ * which returns to drain() when it would sleep
+ */
+static Thread reader;
+static tfunc_t readerMain;
+static jmp_buf readerSleep;
+
+Thread *chThdCreateStatic(void *wsp, size_t size,
+                          tprio_t prio, tfunc_t pf, void *arg)
+{
+  (void)wsp; (void)size; (void)arg;
+  reader.p_prio = prio;
+  readerMain = pf;
+  return &reader;
+}
+
+Thread *chThdSelf(void)
+{
+  return &reader;
+}
+
+/*
+ * Simulated time, advanced by the target's polls and sleeps
+ * when the host is slow
+ */
+#define pollNs  1000  //for a poll of DCRDR on the target
+#define tickNs  (1000000000 / CH_FREQUENCY)
+
+typedef struct {
+  const char *name;
+  uint32_t   periodNs;  //between the host's polls of DCRDR while it is idle
+  uint32_t   byteNs;    //to take each byte, once it has found one
+  bool_t     attached;
+} Host;
+
+static const Host *host;  //NULL for one infinitely fast
+static uint64_t simNs, hostNext;  //simulated time, and of host's next poll
+static bool_t awaiting;  //last poll found the last byte not yet taken
+
+systime_t chTimeNow(void)
+{
+  return simNs / tickNs;
+}
+
+halrtcnt_t halGetCounterValue(void)
+{
+  return (halrtcnt_t)simNs;
+}
+
+
+void chSchGoSleepS(uint8_t newstate)  //only as logPanic() halts
+{
+  (void)newstate;
+  abort();
+}
+
+void chThdSleep(systime_t time)
+/*
+  a sleep awaiting a slow host passes simulated time,
+  any other ends the drain
+*/
+{
+  if (host && awaiting) {
+    simNs += (uint64_t)time * tickNs;
+    return;
+  }
+  longjmp(readerSleep, 1);
+}
+
+static uint64_t nanoseconds(void)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+static unsigned long records, fetches, locks;  //for the current run
+static unsigned long long payload, linkBytes, dcrdrAccesses;
+static uint64_t drainNs;
+
+static void drain(void)
+/*
+  run the reader until the ring is empty
+*/
+{
+  uint64_t start = nanoseconds();
+  if (!setjmp(readerSleep))
+    readerMain(NULL);
+  drainNs += nanoseconds() - start;
+}
+
+
+/*
+ * Lines output, awaiting their messages
+ */
+#define pending  64
+static char expected[pending][128];
+static unsigned long sent, checked, mismatches;
+
+static const char *const formats[] = {
+  "Filtered: %dmA, fast peak %dmA, %d slow samples, %d/%d",
+  "Reports: %d queued, %d decimated, %d dropped, %d unsent, %d cycles/line"
+};
+
+static const char *lookup(uint32_t address)
+/*
+  the format at the address debugLog() output, as found in zev.elf
+*/
+{
+  unsigned i;
+  for (i = 0; i < sizeof formats / sizeof *formats; i++)
+    if (address == (uint32_t)(uintptr_t)formats[i])
+      return formats[i];
+  return NULL;
+}
+
+static void received(const char *line, size_t len)
+{
+  const char *want = expected[checked++ % pending];
+  if (len != strlen(want) || memcmp(line, want, len))
+    if (!mismatches++)
+      fprintf(stderr, "Expected: %s\nReceived: %.*s\n", want, (int)len, line);
+}
+
+
+/*
+ * The debugger's side of DCRDR
+ */
+#define TARGET_REQ_DEBUGMSG_ASCII   0x01
+#define TARGET_REQ_DEBUGMSG_HEXMSG4 0x0401
+
+static uint16_t dcrdr;
+static uint32_t word;      //bytes received of the next word
+static unsigned wordBytes;
+static uint32_t msg[64];   //words received of the current message
+static size_t msgWords, msgLen;
+static uint32_t msgHeader;
+
+static void receiveWord(uint32_t w)
+{
+  if (!msgLen) {  //a new message
+    msgHeader = w;
+    msgWords = 0;
+    if ((w & 0xffff) == TARGET_REQ_DEBUGMSG_ASCII)
+      msgLen = ((w >> 16) + 3) / 4;
+    else if ((w & 0xffff) == TARGET_REQ_DEBUGMSG_HEXMSG4)
+      msgLen = w >> 16;
+    else{  //a debug char or trace point
+      received("", 0);
+      return;
+    }
+    if (msgLen > sizeof msg / sizeof *msg) {
+      mismatches++;
+      msgLen = 0;
+    }
+    return;
+  }
+  msg[msgWords++] = w;
+  if (--msgLen)
+    return;
+  if ((msgHeader & 0xffff) == TARGET_REQ_DEBUGMSG_ASCII)
+    received((const char *)msg, msgHeader >> 16);
+  else{
+    char line[256];
+    if (logDecode(line, sizeof line, msg, msgWords, lookup) == (int)msgWords)
+      received(line, strlen(line));
+    else
+      received("<undecodable>", 13);
+  }
+}
+
+volatile uint16_t *hostDCRDR(void)
+/*
+  take any byte written before the target sees the register again
+*/
+{
+  dcrdrAccesses++;
+  if (host) {
+    simNs += pollNs;
+    awaiting = host->attached && dcrdr & 1;
+    if (!host->attached || simNs < hostNext)
+      return &dcrdr;
+    hostNext = simNs + (awaiting ? host->byteNs : host->periodNs);
+    awaiting = FALSE;
+  }
+  if (dcrdr & 1) {
+    word |= (uint32_t)(dcrdr >> 8) << 8*wordBytes;
+    linkBytes++;
+    if (++wordBytes == 4) {
+      receiveWord(word);
+      word = wordBytes = 0;
+    }
+    dcrdr = 0;
+  }
+  return &dcrdr;
+}
+
+volatile uint32_t *hostDHCSR(void)
+{
+  static uint32_t dhcsr;
+  dhcsr = !host || host->attached;  //C_DEBUGEN
+  return &dhcsr;
+}
+
+
+/*
+ * Lines of text received by the serial and RAM transports,
+ * debugLog() messages as lines of hex words
+ */
+static char text[1024];
+static size_t textLen;
+
+static void receiveText(const uint8_t *data, size_t n)
+{
+  while (n--) {
+    char c = *data++;
+    if (c == '\r')
+      continue;
+    if (c != '\n') {
+      if (textLen < sizeof text - 1)
+        text[textLen++] = c;
+      continue;
+    }
+    text[textLen] = 0;
+    uint32_t words[64];
+    size_t count = 0;
+    char *cursor = text, *end;
+    while (count < 64 && *cursor) {
+      words[count] = strtoul(cursor, &end, 16);
+      if (end - cursor != 8 || *end != ' ')
+        break;
+      count++;
+      cursor = end+1;
+    }
+    char line[256];
+    if (count && !*cursor &&
+        logDecode(line, sizeof line, words, count, lookup) == (int)count)
+      received(line, strlen(line));
+    else
+      received(text, textLen);
+    textLen = 0;
+  }
+}
+
+static size_t serialWrites(void *ip, const uint8_t *bp, size_t n)
+{
+  (void)ip;
+  linkBytes += n;
+  receiveText(bp, n);
+  return n;
+}
+
+static msg_t serialPut(void *ip, uint8_t b)
+{
+  (void)ip;
+  linkBytes++;
+  receiveText(&b, 1);
+  return RDY_OK;
+}
+
+static const struct BaseSequentialStreamVMT serialVmt =
+  {serialWrites, NULL, serialPut, NULL};
+static BaseSequentialStream serial = {&serialVmt};
+
+static char ramLog[4096];
+static uint32_t ramRead;  //bytes of ramLog read
+
+static void readRAM(void)
+/*
+  read what is new in the RAM transport's ring, as gdb's debuglog would
+*/
+{
+  extern volatile uint32_t debugRAMhead;
+  uint32_t head = debugRAMhead;
+  while (ramRead != head) {
+    uint8_t c = ramLog[ramRead++ % sizeof ramLog];
+    linkBytes++;
+    receiveText(&c, 1);
+  }
+}
+
+
+/*
+ * The reader as it was, fetching each byte from its queue
+ * under the kernel lock
+ */
+static uint8_t queue[sizeof outq];
+
+static uint8_t lockedFetcher(void *link)
+{
+  uint32_t *pos = link;
+  chSysLock();
+  locks++;
+  uint8_t b = queue[(*pos)++ % sizeof queue];
+  chSysUnlock();
+  fetches++;
+  return b;
+}
+
+
+static uint32_t random32(void)
+{
+  static uint32_t state = 1;
+  state = state * 1664525 + 1013904223;
+  return state;
+}
+
+static void report(const char *name)
+{
+  if (host) {
+    double waitedNs = DCCstats.spinCycles + (double)DCCstats.slept * tickNs;
+    printf("%-16s waited %7.1f ms, %5.1f%% spinning, %5.2f spins/byte, "
+           "%7.0f bytes/s, %u bytes dropped\n", name, waitedNs / 1e6,
+           waitedNs ? 100.0 * DCCstats.spinCycles / waitedNs : 0,
+           (double)DCCstats.spins / payload, payload * 1e9 / simNs,
+           DCCstats.detached);
+    memset(&DCCstats, 0, sizeof DCCstats);
+    simNs = hostNext = 0;
+    payload = linkBytes = dcrdrAccesses = records = fetches = locks = 0;
+    drainNs = 0;
+    return;
+  }
+  printf("%-16s %5.2f ns, %5.2f link bytes, %5.2f DCRDR, %.3f fetches, "
+         "%.3f locks, %.3f releases/byte\n", name,
+         (double)drainNs / payload, (double)linkBytes / payload,
+         (double)dcrdrAccesses / payload, (double)fetches / payload,
+         (double)locks / payload, (double)records / payload);
+  drainNs = payload = linkBytes = dcrdrAccesses = records = fetches = locks = 0;
+}
+
+typedef enum {byteFetcher, spans, mixed} Path;
+
+static uint32_t queued, head;  //positions in the old reader's queue
+
+static void drainQueue(void)
+/*
+  empty the queue as the old reader did
+*/
+{
+  uint64_t start = nanoseconds();
+  while (queued != head) {
+    size_t n = queue[queued++ % sizeof queue];
+    DCCputsQ(lockedFetcher, &queued, n);
+  }
+  drainNs += nanoseconds() - start;
+}
+
+static void run(const char *name, Path path,
+                const DebugTransport *transport, unsigned long lines)
+{
+  unsigned long i;
+  size_t inRing = 0;  //bytes of records since the ring was drained
+  debugPrintInit(outq);
+  debugTransport(transport);
+  for (i = 0; i < lines; i++) {
+    unsigned a[5], j;
+    for (j = 0; j < 5; j++)
+      a[j] = random32() >> (i % 24);
+    const char *fmt = formats[i & 1];
+    char scratch[128], *line = host && !host->attached ?
+      scratch : expected[sent++ % pending];  //none will arrive if detached
+    size_t len = sprintf(line, fmt, a[0], a[1], a[2], a[3], a[4]);
+    payload += len;
+    if (path == byteFetcher) {
+      if (sizeof queue - (head - queued) <= len)
+        drainQueue();
+      queue[head++ % sizeof queue] = len;
+      for (j = 0; j < len; j++)
+        queue[head++ % sizeof queue] = line[j];
+      continue;
+    }
+    if (inRing + 3 + len > sizeof outq) {  //no room for the line
+      drain();
+      readRAM();
+      inRing = 0;
+    }
+    size_t out = path == mixed && i & 1 ?
+      debugLog(fmt, a[0], a[1], a[2], a[3], a[4]) :
+      debugPut((const uint8_t *)line, len) - 1;
+    if (out < len && !(path == mixed && i & 1))
+      mismatches++;
+    inRing += 3 + out;
+  }
+  drain();
+  readRAM();
+  drainQueue();
+  if (host && host->attached)  //wait for the host to poll
+    simNs = hostNext;
+  hostDCRDR();  //take the last byte
+  dcrdrAccesses--;  //which is not the target's
+  records = path == byteFetcher ? fetches : lines;  //each released its space
+  report(name);
+}
+
+
+int main(int argc, char **argv)
+{
+  unsigned long lines = argc > 1 ? strtoul(argv[1], NULL, 0) : 200000;
+  debugStreamInit(&serial);
+  debugRAMInit(ramLog, sizeof ramLog);
+  printf("per byte of text:\n");
+  run("DCC byte fetcher", byteFetcher, &debugDCC, lines);
+  run("DCC", spans, &debugDCC, lines);
+  run("DCC+binary", mixed, &debugDCC, lines);
+  run("serial", spans, &debugStream, lines);
+  run("serial+binary", mixed, &debugStream, lines);
+  run("RAM", spans, &debugRAM, lines);
+  run("RAM+binary", mixed, &debugRAM, lines);
+  static const Host hosts[] = {
+    {"polling host",   1000000,   20000, TRUE},
+    {"slow host",     10000000,  200000, TRUE},
+    {"stalled host", 500000000, 5000000, TRUE},
+    {"detached host",        0,       0, FALSE}
+  };
+  printf("DCC to a simulated host, %d ns per poll:\n", pollNs);
+  for (host = hosts; host < hosts + sizeof hosts / sizeof *hosts; host++)
+    run(host->name, spans, &debugDCC, lines / 100);
+  host = NULL;
+  printf("%lu lines, %lu received, %lu mismatches\n", sent, checked, mismatches);
+  return mismatches || checked != sent;
+}
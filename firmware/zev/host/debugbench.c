@@ -0,0 +1,313 @@
+/**********************  host/debugbench.c  ************************
+*
+*  Measure the cost of debugPrint() formatting into the debug output ring
+*
+*  The target's debugput.c is built against a chprintf() formatted by
+*  the C library.  Typical lines are printed into the ring, which is
+*  reset whenever it fills.
+*
+*  debugPrint() formats each line once, in place.  It is compared with
+*  the two passes it used to make:  one to measure the line, then one
+*  into the queue (here, debugPrint() itself), and with debugLog(),
+*  which leaves the formatting to the host.  The bytes each line
+*  costs on the DCC link, headers included, are reported too.
+*
+*  First, the reader thread's function is run after each line until
+*  the ring is empty, and the lines it outputs are checked against the
+*  C library's formatting as the ring wraps around.  So is the rollback
+*  of a line that would overflow the ring, which must leave its free
+*  space zeroed and whole.  debugLog()'s messages are formatted by
+*  logDecode() and checked in the same way.
+*
+*  usage:  zevdebugbench {lines}
+*
+***************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <setjmp.h>
+
+#include <chprintf.h>
+
+#include "debugput.h"
+#include "dccput.h"
+#include "logdecode.h"
+
+static char outq[4096];
+
+/*
+ * The reader thread runs only when drain() calls its function,
+ * which returns to drain() when it would sleep
+ */
+static Thread reader;
+static tfunc_t readerMain;
+static jmp_buf readerSleep;
+
+static char received[256];  //last line output by the reader
+static size_t receivedLen;
+static uint32_t receivedWords[64];  //last hex message output by the reader
+static size_t receivedWordsLen;
+
+Thread *chThdCreateStatic(void *wsp, size_t size,
+                          tprio_t prio, tfunc_t pf, void *arg)
+{
+  (void)wsp; (void)size; (void)arg;
+  reader.p_prio = prio;
+  reader.p_state = THD_STATE_SUSPENDED;
+  readerMain = pf;
+  return &reader;
+}
+
+Thread *chThdSelf(void)
+{
+  return &reader;
+}
+
+void chSchGoSleepS(uint8_t newstate)  //only as logPanic() halts
+{
+  (void)newstate;
+  abort();
+}
+
+void chThdSleep(systime_t time)
+{
+  (void)time;
+  longjmp(readerSleep, 1);
+}
+
+static void drain(void)
+/*
+  run the reader until the ring is empty
+*/
+{
+  if (!setjmp(readerSleep))
+    readerMain(NULL);
+}
+
+void DCCputc(const int msg)
+{
+  received[0] = msg;
+  receivedLen = 1;
+}
+
+void DCCputsSpans(const uint8_t *first, size_t firstLen,
+                  const uint8_t *second, size_t secondLen)
+{
+  memcpy(received, first, firstLen);
+  memcpy(received+firstLen, second, secondLen);
+  receivedLen = firstLen + secondLen;
+}
+
+void DCCputU32Spans(const uint8_t *first, size_t firstLen,
+                    const uint8_t *second, size_t secondLen)
+{
+  memcpy(receivedWords, first, firstLen);
+  memcpy((uint8_t *)receivedWords+firstLen, second, secondLen);
+  receivedWordsLen = (firstLen + secondLen) / 4;
+}
+
+
+/*
+ * Counts the characters written, as debugPrint()'s first pass did
+ */
+typedef struct {
+  const struct BaseSequentialStreamVMT *vmt;
+  size_t len;
+} CountStream;
+
+static size_t countWrites(void *ip, const uint8_t *bp, size_t n)
+{
+  (void)bp;
+  ((CountStream *)ip)->len += n;
+  return n;
+}
+
+static msg_t countPut(void *ip, uint8_t b)
+{
+  (void)b;
+  ((CountStream *)ip)->len++;
+  return RDY_OK;
+}
+
+static const struct BaseSequentialStreamVMT countVmt =
+  {countWrites, NULL, countPut, NULL};
+
+static size_t measure(const char *fmt, ...)
+{
+  CountStream count = {&countVmt, 0};
+  va_list ap;
+  va_start(ap, fmt);
+  chvprintf((BaseSequentialStream *)&count, fmt, ap);
+  va_end(ap);
+  return count.len;
+}
+
+
+static uint32_t random32(void)
+{
+  static uint32_t state = 1;
+  state = state * 1664525 + 1013904223;
+  return state;
+}
+
+static uint64_t nanoseconds(void)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+static uint64_t cycles(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+  return __builtin_ia32_rdtsc();
+#else
+  return 0;
+#endif
+}
+
+#define args  8
+
+static unsigned arg[256][args];  //pseudo random values of each line printed
+
+/*
+ * Typical lines from zev.c, each with five arguments,
+ * and one with every kind of conversion
+ */
+static const char *const formats[] = {
+  "Filtered: %dmA, fast peak %dmA, %d slow samples, %d/%d",
+  "Reports: %d queued, %d decimated, %d dropped, %d unsent, %d cycles/line",
+  "Trip #%d: %s ch%c, %-6dns, %*d, %x, %lu%% %s|"
+};
+
+#define format(a)  formats[(a)[7] & 1]
+
+#define printLine(print, a)  (print)(format(a), (a)[0], (a)[1], (a)[2], (a)[3], (a)[4])
+
+static const char *lookup(uint32_t address)
+/*
+  the format at the address debugLog() output, as found in zev.elf
+*/
+{
+  unsigned i;
+  for (i = 0; i < sizeof formats / sizeof *formats; i++)
+    if (address == (uint32_t)(uintptr_t)formats[i])
+      return formats[i];
+  return NULL;
+}
+
+static size_t twoPass(unsigned i)
+{
+  printLine(measure, arg[i]);
+  return printLine(debugPrint, arg[i]);
+}
+
+static size_t onePass(unsigned i)
+{
+  return printLine(debugPrint, arg[i]);
+}
+
+static size_t binary(unsigned i)
+{
+  return printLine(debugLog, arg[i]);
+}
+
+
+static void bench(const char *name, size_t (*print)(unsigned),
+                  unsigned long lines, bool_t text)
+{
+  size_t queued = 0, total = 0;
+  unsigned long i;
+  debugPrintInit(outq);
+  uint64_t ns = nanoseconds(), tsc = cycles();
+  for (i = 0; i < lines; i++) {
+    if (queued > sizeof outq - 128) {  //empty the ring
+      debugPrintInit(outq);
+      queued = 0;
+    }
+    size_t len = print(i % 256);
+    queued += len + 3;  //with its record's header
+    if (text)  //characters, less newline, in words
+      len = (len+2) & ~3;
+    total += 4 + len;  //with its DCC message header
+  }
+  tsc = cycles() - tsc;
+  ns = nanoseconds() - ns;
+  printf("%-10s %6.1f ns/line", name, (double)ns / lines);
+  if (tsc)
+    printf(", %6.1f cycles/line", (double)tsc / lines);
+  printf(", %.1f DCC bytes/line\n", (double)total / lines);
+}
+
+
+int main(int argc, char **argv)
+{
+  unsigned long lines = argc > 1 ? strtoul(argv[1], NULL, 0) : 1000000;
+  unsigned i, j, mismatches = 0;
+  for (i = 0; i < 256; i++)
+    for (j = 0; j < args; j++)
+      arg[i][j] = random32() >> (i % 32);
+
+  /* check each line output, as the ring wraps around */
+  debugPrintInit(outq);
+  for (i = 0; i < 256; i++) {
+    char expected[256];
+    const unsigned *a = arg[i];
+    size_t len = sprintf(expected, format(a), a[0], a[1], a[2], a[3], a[4]);
+    receivedLen = 0;
+    size_t out = printLine(debugPrint, a);
+    drain();
+    if (out != len+1 || receivedLen != len || memcmp(received, expected, len))
+      if (!mismatches++)
+        fprintf(stderr, "Expected: %s\nActual:   %.*s\n",
+                expected, (int)receivedLen, received);
+  }
+
+  /* check each message decoded by the host */
+  for (i = 0; i < 256; i++) {
+    char expected[256], actual[256];
+    const unsigned *a = arg[i];
+    size_t len = sprintf(expected, format(a), a[0], a[1], a[2], a[3], a[4]);
+    receivedWordsLen = 0;
+    size_t out = printLine(debugLog, a);
+    drain();
+    if (out != receivedWordsLen*4 ||
+        logDecode(actual, sizeof actual, receivedWords, receivedWordsLen,
+                  lookup) != (int)receivedWordsLen || strcmp(actual, expected))
+      if (!mismatches++)
+        fprintf(stderr, "Expected: %s\nDecoded:  %.*s\n",
+                expected, (int)len, actual);
+  }
+  {
+    const char *expected =
+      "Trip #-7: short ch3, 250   ns,    42, 3E8, 65536% longer than a word|";
+    char actual[256];
+    debugLog(formats[2], -7, "short", '3', 250, 5, 42, 1000, 65536u,
+             "longer than a word");
+    drain();
+    if (logDecode(actual, sizeof actual, receivedWords, receivedWordsLen,
+                  lookup) != (int)receivedWordsLen || strcmp(actual, expected))
+      if (!mismatches++)
+        fprintf(stderr, "Expected: %s\nDecoded:  %s\n", expected, actual);
+  }
+
+  /* a line that would overflow the ring is rolled back */
+  debugPutInit(outq, 128);
+  const char *line40 = "0123456789012345678901234567890123456789";
+  debugPuts(line40);
+  debugPuts(line40);  //leaves 42 bytes free
+  if (printLine(debugPrint, arg[1]) || debugDropped() != 1)
+    mismatches++;
+  for (j = 86; j < 128; j++)
+    if (outq[j])
+      mismatches++;
+  if (debugPuts(line40+1) != 40)
+    mismatches++;
+  printf("%u mismatches in %u lines\n", mismatches, 2*256+2);
+  bench("one pass", onePass, lines, TRUE);
+  bench("two pass", twoPass, lines, TRUE);
+  bench("binary", binary, lines, FALSE);
+  return mismatches != 0;
+}
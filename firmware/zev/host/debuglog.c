@@ -0,0 +1,181 @@
+/**********************  host/debuglog.c  ************************
+*
+*  Format the binary debug messages in an openocd log or console capture
+*
+*  debugLog() (see debugput.h) outputs the address of its format and the
+*  raw words of its arguments as a DCC hex message.  The formats are
+*  looked up in the firmware's ELF file.
+*
+*  openocd logs hex messages at debug level (-d3) as lines ending
+*  "target_hexmsg(): " followed by up to 8 words, and text messages as
+*  lines ending "target_asciimsg(): " followed by the text.  After
+*  "monitor target_request debugmsgs enable", the gdb or telnet console
+*  shows the same, as lines of bare words and of text.  The messages are
+*  output in order, one per line, and other openocd log lines are ignored.
+*
+*  Words that do not begin a message are skipped and counted on stderr.
+*
+*  usage:  zevdebuglog zev.elf {log}
+*    reads the log from stdin if none is given
+*
+***************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <elf.h>
+
+#include "logdecode.h"
+
+static uint8_t *elf;
+static size_t elfSize;
+
+static const char *lookup(uint32_t address)
+/*
+  return the string at address in the ELF file's loaded sections
+*/
+{
+  const Elf32_Ehdr *eh = (const Elf32_Ehdr *)elf;
+  unsigned i;
+  for (i = 0; i < eh->e_shnum; i++) {
+    const Elf32_Shdr *sh =
+      (const Elf32_Shdr *)(elf + eh->e_shoff + i * eh->e_shentsize);
+    if (sh->sh_type == SHT_PROGBITS && sh->sh_flags & SHF_ALLOC &&
+        address >= sh->sh_addr && address < sh->sh_addr + sh->sh_size) {
+      const char *str = (const char *)elf + sh->sh_offset + address - sh->sh_addr;
+      size_t maxLen = sh->sh_addr + sh->sh_size - address;
+      return memchr(str, 0, maxLen) ? str : NULL;
+    }
+  }
+  return NULL;
+}
+
+static uint8_t *readELF(const char *name)
+{
+  FILE *f = fopen(name, "rb");
+  if (!f)
+    return NULL;
+  fseek(f, 0, SEEK_END);
+  long len = ftell(f);
+  rewind(f);
+  uint8_t *data = len > (long)sizeof(Elf32_Ehdr) ? malloc(len) : NULL;
+  if (data && fread(data, 1, len, f) != (size_t)len) {
+    free(data);
+    data = NULL;
+  }
+  fclose(f);
+  elfSize = len;
+  return data;
+}
+
+static int validELF(void)
+{
+  const Elf32_Ehdr *eh = (const Elf32_Ehdr *)elf;
+  return !memcmp(eh->e_ident, ELFMAG, SELFMAG) &&
+    eh->e_ident[EI_CLASS] == ELFCLASS32 && eh->e_ident[EI_DATA] == ELFDATA2LSB &&
+    eh->e_shentsize >= sizeof(Elf32_Shdr) &&
+    eh->e_shoff + (size_t)eh->e_shnum * eh->e_shentsize <= elfSize;
+}
+
+
+static uint32_t words[4096];
+static size_t queued;
+static unsigned long messages, skipped;
+
+static void flush(void)
+/*
+  output each complete message queued
+*/
+{
+  size_t first = 0;
+  while (first < queued) {
+    char line[1024];
+    int used = logDecode(line, sizeof line, words+first, queued-first, lookup);
+    if (!used)
+      break;
+    if (used < 0) {
+      skipped++;
+      first++;
+    }else{
+      puts(line);
+      messages++;
+      first += used;
+    }
+  }
+  memmove(words, words+first, (queued-first) * sizeof *words);
+  queued -= first;
+}
+
+static int hexWords(const char *text)
+/*
+  queue the words in text
+  returns 0 if text is not only words of 8 hex digits
+*/
+{
+  uint32_t found[8];
+  unsigned n = 0;
+  for (;;) {
+    while (*text == ' ')
+      text++;
+    if (!*text || *text == '\n' || *text == '\r')
+      break;
+    char *end;
+    unsigned long word = strtoul(text, &end, 16);
+    if (end - text != 8 || n == 8 || (*end && *end != ' ' && *end != '\n' && *end != '\r'))
+      return 0;
+    found[n++] = word;
+    text = end;
+  }
+  if (!n)
+    return 0;
+  if (queued + n > sizeof words / sizeof *words) {  //no message is this long
+    skipped += queued;
+    queued = 0;
+  }
+  memcpy(words+queued, found, n * sizeof *found);
+  queued += n;
+  flush();
+  return 1;
+}
+
+
+int main(int argc, char **argv)
+{
+  if (argc < 2 || argc > 3) {
+    fprintf(stderr, "usage: %s zev.elf {log}\n", argv[0]);
+    return 1;
+  }
+  if (!(elf = readELF(argv[1])) || !validELF()) {
+    fprintf(stderr, "%s: not a readable 32 bit little endian ELF file\n", argv[1]);
+    return 2;
+  }
+  FILE *log = stdin;
+  if (argc > 2 && !(log = fopen(argv[2], "r"))) {
+    perror(argv[2]);
+    return 2;
+  }
+  static const char hexTag[] = "target_hexmsg(): ",
+                    asciiTag[] = "target_asciimsg(): ";
+  static const char *const openocdPrefix[] =
+    {"Debug: ", "Info : ", "Warn : ", "Error: ", "User : ", NULL};
+  char text[4096];
+  while (fgets(text, sizeof text, log)) {
+    const char *tag;
+    if ((tag = strstr(text, hexTag)))
+      hexWords(tag + sizeof hexTag - 1);
+    else if ((tag = strstr(text, asciiTag)))
+      fputs(tag + sizeof asciiTag - 1, stdout);
+    else if (!hexWords(text)) {
+      const char *const *prefix;
+      for (prefix = openocdPrefix; *prefix; prefix++)
+        if (!strncmp(text, *prefix, strlen(*prefix)))
+          break;
+      if (!*prefix)
+        fputs(text, stdout);
+    }
+  }
+  if (queued)
+    skipped += queued;
+  fprintf(stderr, "%lu messages, %lu words skipped\n", messages, skipped);
+  return 0;
+}
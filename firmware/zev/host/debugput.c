@@ -0,0 +1,96 @@
+/**********************  host/debugput.c  ************************
+*
+*  Debug output on the host goes directly to stderr,
+*  prefixed by the simulated time in ms
+*
+***************************************************************/
+
+#include <stdio.h>
+
+#include "debugput.h"
+#include "dccput.h"
+
+#include "simadc.h"
+
+Thread *debugPutInit(char *outq, size_t outqSize)
+{
+  (void)outq; (void)outqSize;
+  return chThdSelf();
+}
+
+int debugPutc(int c)
+{
+  return fputc(c, stderr) == EOF ? -1 : c;
+}
+
+size_t debugPut(const uint8_t *block, size_t n)
+{
+  if (n > 255)
+    n = 255;
+  fprintf(stderr, "%8lu: %.*s\n",
+          (unsigned long)(simNanoseconds() / 1000000), (int)n, block);
+  return n+1;
+}
+
+size_t debugPuts(const char *str)
+{
+  size_t len = 0;
+  while (str[len] && len < 255)
+    len++;
+  return debugPut((const uint8_t *)str, len);
+}
+
+static size_t vlog(const char *fmt, va_list ap)
+{
+  char line[256];
+  int len = vsnprintf(line, sizeof line, fmt, ap);
+  if (len < 0)
+    return 0;
+  if ((size_t)len >= sizeof line)
+    len = sizeof line - 1;
+  return debugPut((const uint8_t *)line, len);
+}
+
+size_t debugLog(const char *fmt, ...)
+{
+  va_list ap;
+  va_start(ap, fmt);
+  size_t len = vlog(fmt, ap);
+  va_end(ap);
+  return len;
+}
+
+#if !debugPrintBinary
+size_t debugPrint(const char *fmt, ...)
+{
+  va_list ap;
+  va_start(ap, fmt);
+  size_t len = vlog(fmt, ap);
+  va_end(ap);
+  return len;
+}
+#endif
+
+const DebugTransport debugDCC, debugStream, debugRAM;
+
+void debugTransport(const DebugTransport *transport)
+{
+  (void)transport;
+}
+
+void debugStreamInit(BaseSequentialStream *out)
+{
+  (void)out;
+}
+
+void debugRAMInit(char *ring, size_t size)
+{
+  (void)ring; (void)size;
+}
+
+DCCStats DCCstats;  //no debugger to wait for
+
+unsigned debugDropped(void)
+{
+  return 0;
+}
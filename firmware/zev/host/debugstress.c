@@ -0,0 +1,307 @@
+/**********************  host/debugstress.c  ************************
+*
+*  Stress the debug output ring with many concurrent producers
+*
+*  The target's debugput.c is built against host threads.  Each producer
+*  thread outputs numbered lines, alternately with debugPrint() and
+*  debugPut(), and a timer signal interrupts the first producer to output
+*  lines of its own from the handler, as an interrupt handler would.
+*  The reader thread's function runs in a thread of its own, "sleeping"
+*  by yielding the CPU.  Producers yield when their line is dropped,
+*  so the reader gets a share of even a single CPU.
+*
+*  Each line carries its producer, sequence number, the time it was
+*  output and a run of filler characters unique to its producer.
+*  Lines output by debugPut() begin with Q, those by debugPrint() with P.
+*  The lines received are checked for corruption and that each producer's
+*  arrive in order.  Lines may be dropped when the ring is full, but
+*  none may be truncated.
+*
+*  A summary of the throughput, the lines dropped, and the latency from
+*  output until received follows.
+*
+*  usage:  zevdebugstress {producers {lines {ring size}}}
+*
+***************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <signal.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+#include "debugput.h"
+#include "dccput.h"
+
+#define maxProducers  32
+#define maxFill       48
+#define isrProducer   maxProducers  /* the timer signal handler */
+
+static char outq[1<<16];
+
+static Thread reader;
+static tfunc_t readerMain;
+
+Thread *chThdCreateStatic(void *wsp, size_t size,
+                          tprio_t prio, tfunc_t pf, void *arg)
+{
+  (void)wsp; (void)size; (void)arg;
+  reader.p_prio = prio;
+  readerMain = pf;
+  return &reader;
+}
+
+Thread *chThdSelf(void)
+{
+  return &reader;
+}
+
+void chSchGoSleepS(uint8_t newstate)  //only as logPanic() halts
+{
+  (void)newstate;
+  abort();
+}
+
+void chThdSleep(systime_t time)
+{
+  (void)time;
+  sched_yield();
+}
+
+
+static uint64_t nanoseconds(void)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+static char filler[maxProducers+1][maxFill];
+
+static volatile unsigned sent[maxProducers+1];  //lines output by each
+
+/*
+ * Updated only by the reader
+ */
+static unsigned lastSeq[maxProducers+1];
+static unsigned long received, errors, chars;
+static unsigned long long bytes;
+static uint64_t latencySum, latencyMax;
+static unsigned long latencyCount;   //complete lines timed
+static unsigned long latencies[64];  //by log2 of nanoseconds
+
+static void error(const char *why, const char *line, size_t len)
+{
+  if (!errors++)
+    fprintf(stderr, "%s: %.*s\n", why, (int)len, line);
+}
+
+static void check(const char *line, size_t len)
+/*
+  check a line received and account for it
+  lines output by debugPut() begin with Q, those by debugPrint() with P
+*/
+{
+  char text[256], kind;
+  unsigned producer, seq, fill;
+  unsigned long long stamp;
+  int start = 0;
+  memcpy(text, line, len);
+  text[len] = 0;
+  received++;
+  bytes += len;
+  if (sscanf(text, "%c%u %u %llu %u %n",
+             &kind, &producer, &seq, &stamp, &fill, &start) < 5 || !start) {
+    error("Malformed", line, len);
+    return;
+  }
+  if ((kind != 'P' && kind != 'Q') || producer > maxProducers ||
+      fill > maxFill) {
+    error("Malformed", line, len);
+    return;
+  }
+  if (seq <= lastSeq[producer])
+    error("Out of order", line, len);
+  lastSeq[producer] = seq;
+  size_t got = len - start;
+  if (got > fill || memcmp(text+start, filler[producer], got))
+    error("Corrupt", line, len);
+  else if (got < fill)
+    error("Truncated", line, len);
+  else{
+    uint64_t latency = nanoseconds() - stamp;
+    latencySum += latency;
+    latencyCount++;
+    if (latency > latencyMax)
+      latencyMax = latency;
+    latencies[63 - __builtin_clzll(latency | 1)]++;
+  }
+}
+
+void DCCputsSpans(const uint8_t *first, size_t firstLen,
+                  const uint8_t *second, size_t secondLen)
+{
+  char line[256];
+  memcpy(line, first, firstLen);
+  memcpy(line+firstLen, second, secondLen);
+  check(line, firstLen + secondLen);
+}
+
+void DCCputc(const int msg)
+{
+  (void)msg;
+  chars++;
+}
+
+void DCCputU32Spans(const uint8_t *first, size_t firstLen,
+                    const uint8_t *second, size_t secondLen)
+{
+  (void)first; (void)firstLen; (void)second; (void)secondLen;
+}
+
+static void *readerThread(void *arg)
+{
+  (void)arg;
+  readerMain(NULL);
+  return NULL;
+}
+
+
+static char *utoa(char *s, unsigned long long n)
+/*
+  async signal safe decimal formatting
+*/
+{
+  char digits[24];
+  int i = 0;
+  do
+    digits[i++] = '0' + n % 10;
+  while (n /= 10);
+  while (i)
+    *s++ = digits[--i];
+  *s++ = ' ';
+  return s;
+}
+
+static void interrupt(int sig)
+/*
+  output a line from the timer signal handler
+*/
+{
+  (void)sig;
+  char line[128], *s = line;
+  unsigned seq = ++sent[isrProducer];
+  unsigned fill = seq % maxFill;
+  *s++ = 'Q';
+  s = utoa(s, isrProducer);
+  s = utoa(s, seq);
+  s = utoa(s, nanoseconds());
+  s = utoa(s, fill);
+  memcpy(s, filler[isrProducer], fill);
+  debugPut((const uint8_t *)line, s - line + fill);
+}
+
+static unsigned long lines;
+
+static void *producer(void *arg)
+{
+  unsigned id = (uintptr_t)arg;
+  sigset_t alarm;
+  sigemptyset(&alarm);
+  sigaddset(&alarm, SIGALRM);
+  pthread_sigmask(id ? SIG_BLOCK : SIG_UNBLOCK, &alarm, NULL);
+  unsigned long i;
+  for (i = 1; i <= lines; i++) {
+    unsigned fill = (i * 7 + id) % maxFill;
+    unsigned long long stamp = nanoseconds();
+    sent[id] = i;
+    size_t out;
+    if (i & 1)
+      out = debugPrint("P%u %lu %llu %u %.*s",
+                       id, i, stamp, fill, fill, filler[id]);
+    else{
+      char line[128];
+      int len = snprintf(line, sizeof line, "Q%u %lu %llu %u %.*s",
+                         id, i, stamp, fill, fill, filler[id]);
+      out = debugPut((const uint8_t *)line, len);
+    }
+    if (!out)  //ring full, let the reader catch up
+      sched_yield();
+  }
+  return NULL;
+}
+
+
+int main(int argc, char **argv)
+{
+  unsigned producers = argc > 1 ? strtoul(argv[1], NULL, 0) : 8;
+  lines = argc > 2 ? strtoul(argv[2], NULL, 0) : 200000;
+  size_t ringSize = argc > 3 ? strtoul(argv[3], NULL, 0) : 512;
+  if (!producers || producers > maxProducers || ringSize < 64 ||
+      ringSize > sizeof outq) {
+    fprintf(stderr, "usage: %s {producers {lines {ring size}}}\n"
+                    "  at most %u producers and a %u byte ring\n",
+            argv[0], maxProducers, (unsigned)sizeof outq);
+    return 1;
+  }
+  unsigned i;
+  for (i = 0; i <= maxProducers; i++)
+    memset(filler[i], i == isrProducer ? '!' : 'a' + i % 26, maxFill);
+
+  sigset_t alarm;
+  sigemptyset(&alarm);
+  sigaddset(&alarm, SIGALRM);
+  pthread_sigmask(SIG_BLOCK, &alarm, NULL);  //inherited by all but producer 0
+  signal(SIGALRM, interrupt);
+  while (ringSize & (ringSize-1))
+    ringSize &= ringSize-1;
+  debugPutInit(outq, ringSize);
+  pthread_t readerId, producerId[maxProducers];
+  pthread_create(&readerId, NULL, readerThread, NULL);
+
+  uint64_t start = nanoseconds();
+  struct itimerval tick = {{0, 100}, {0, 100}};
+  setitimer(ITIMER_REAL, &tick, NULL);
+  for (i = 0; i < producers; i++)
+    pthread_create(producerId+i, NULL, producer, (void *)(uintptr_t)i);
+  for (i = 0; i < producers; i++)
+    pthread_join(producerId[i], NULL);
+  struct itimerval stop = {{0, 0}, {0, 0}};
+  setitimer(ITIMER_REAL, &stop, NULL);
+
+  unsigned long total = 0;
+  for (i = 0; i <= maxProducers; i++)
+    total += sent[i];
+  uint64_t deadline = nanoseconds() + 5000000000ULL;
+  while (received + debugDropped() < total && nanoseconds() < deadline)
+    sched_yield();
+  double seconds = (nanoseconds() - start) / 1e9;
+
+  unsigned long dropped = debugDropped();
+  if (received + dropped != total)
+    errors++;
+  printf("%u producers + interrupts, %zu byte ring: %lu lines output "
+         "(%u from interrupts), %lu received, %lu dropped, %lu errors\n",
+         producers, ringSize, total,
+         sent[isrProducer], received, dropped, errors);
+  printf("%.0f lines/s, %.0f bytes/s received over %.2f s\n",
+         received / seconds, bytes / seconds, seconds);
+  if (latencyCount) {
+    unsigned long sum = 0;
+    int b, p50 = -1, p99 = -1;
+    for (b = 0; b < 64; b++) {
+      sum += latencies[b];
+      if (p50 < 0 && sum * 2 >= latencyCount)
+        p50 = b;
+      if (p99 < 0 && sum * 100 >= latencyCount * 99)
+        p99 = b;
+    }
+    printf("latency: %.0f ns average, median < %llu ns, 99%% < %llu ns, "
+           "max %llu ns\n", (double)latencySum / latencyCount,
+           2ULL << p50, 2ULL << p99, (unsigned long long)latencyMax);
+  }
+  return errors != 0;
+}
@@ -0,0 +1,175 @@
+/**********************  host/decimtest.c  ************************
+*
+*  Check the decimator's frequency response and time decimate()
+*
+*  At each row rate, of the sampling profiles and some faster ones:
+*    DC gain:  constant rows must settle to exactly 4x their value
+*              (1/4 ADC count units) in both streams, to within 1 LSB.
+*    Droop:    a sine at a quarter of a stage's output rate must pass
+*              with its CIC droop compensated to within maxFlatness dB.
+*              The droop itself, the measured gain less the compensator's
+*              gain there, must be within maxDroopErr dB of the CIC's
+*              (sin(pi/4) / (R sin(pi/4R)))^3, about -2.7dB for large R.
+*  A stage with ratio 1 has neither droop nor compensation.
+*
+*  Gains are the amplitude of the sine fitted to the output at the
+*  known frequency, relative to that of the input.  Then decimate() is
+*  timed on random rows.
+*
+*  usage:  zevdecimtest {rows}
+*  exits with status 1 if any check fails
+*
+***************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+
+#include "decimate.h"
+
+#define maxFlatness  0.5     /* dB from unity gain after compensation */
+#define maxDroopErr  0.05    /* dB */
+#define amplitude    1000.0  /* input sine, ADC counts */
+#define midScale     2048
+#define outputs      400     /* fitted, a multiple of 4 */
+#define settling     8       /* outputs discarded first */
+
+static const unsigned rowRates[] = {640, 1280, 1600, 16000, 64000};
+
+static int32_t fastOut[outputs+settling], slowOut[outputs+settling];
+static unsigned fastN, slowN;
+static adcsample_t row[ADCchannels];
+static unsigned failures;
+
+
+static void fastSink(const DecimatedSample *s)
+{
+  if (fastN < outputs+settling)
+    fastOut[fastN++] = s->chan[0];
+}
+
+static void slowSink(const DecimatedSample *s)
+{
+  if (slowN < outputs+settling)
+    slowOut[slowN++] = s->chan[0];
+}
+
+static void feed(Decimator *d, adcsample_t x)
+{
+  unsigned chan;
+  for (chan = 0; chan < ADCchannels; chan++)
+    row[chan] = x;
+  decimate(d, row, 1);
+}
+
+
+static void checkDC(unsigned rowRate)
+{
+  Decimator d;
+  decimatorInit(&d, rowRate, fastSink, slowSink);
+  const adcsample_t x = 1234;
+  fastN = slowN = 0;
+  while (slowN < settling+1)
+    feed(&d, x);
+  int32_t fast = fastOut[fastN-1], slow = slowOut[slowN-1];
+  int ok = abs(fast - 4*x) <= 1 && abs(slow - 4*x) <= 1;
+  printf("  DC gain:  fast %.4f, slow %.4f%s\n",
+         fast / (4.0*x), slow / (4.0*x), ok ? "" : "  FAILED");
+  failures += !ok;
+}
+
+
+static double gainDB(const int32_t *y)
+/*
+  gain of the sine at a quarter of the output rate in y[settling..]
+*/
+{
+  double a = 0, b = 0;
+  unsigned n;
+  for (n = 0; n < outputs; n++) {
+    static const int cosine[4] = {1, 0, -1, 0}, sine[4] = {0, 1, 0, -1};
+    double v = y[settling+n] / 4.0 - midScale;
+    a += v * cosine[(settling+n) & 3];
+    b += v * sine[(settling+n) & 3];
+  }
+  return 20*log10(2*sqrt(a*a + b*b) / outputs / amplitude);
+}
+
+static void checkDroop(const char *stage, unsigned ratio, int32_t tap,
+                       unsigned rowsPerOut, unsigned rowRate,
+                       const int32_t *y, unsigned *count)
+/*
+  feed a sine at a quarter of the stage's output rate (rowsPerOut rows)
+  and check its gain, given the stage's ratio and compensator tap
+*/
+{
+  Decimator d;
+  decimatorInit(&d, rowRate, fastSink, slowSink);
+  fastN = slowN = 0;
+  unsigned long k;
+  for (k = 0; *count < outputs+settling; k++)
+    feed(&d, midScale + lrint(amplitude * sin(2*M_PI * k / (4.0*rowsPerOut))));
+  double gain = gainDB(y);
+  if (ratio == 1) {
+    int ok = fabs(gain) <= maxFlatness;
+    printf("  %s ratio 1:  %+.2fdB at Fout/4%s\n", stage, gain,
+           ok ? "" : "  FAILED");
+    failures += !ok;
+    return;
+  }
+  double droop = gain - 20*log10((16 + 2*tap) / 16.0);
+  double cicDroop = 60*log10(sin(M_PI/4) / (ratio * sin(M_PI/4/ratio)));
+  int ok = fabs(gain) <= maxFlatness && fabs(droop - cicDroop) <= maxDroopErr;
+  printf("  %s ratio %u:  CIC droop %+.2fdB (%+.2fdB) at Fout/4, "
+         "%+.2fdB compensated%s\n", stage, ratio, droop, cicDroop, gain,
+         ok ? "" : "  FAILED");
+  failures += !ok;
+}
+
+
+static uint64_t nanoseconds(void)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+static void bench(unsigned rowRate, unsigned long rows)
+{
+  static Decimator d;
+  static adcsample_t frame[ADCchannels*64];
+  unsigned i;
+  for (i = 0; i < ADCchannels*64; i++)
+    frame[i] = rand() & 0xfff;
+  decimatorInit(&d, rowRate, NULL, NULL);
+  unsigned long n;
+  uint64_t ns = nanoseconds();
+  for (n = 0; n < rows; n += 64)
+    decimate(&d, frame, 64);
+  ns = nanoseconds() - ns;
+  printf("  decimate():  %.1f ns/row\n", (double)ns / n);
+}
+
+
+int main(int argc, char **argv)
+{
+  unsigned long rows = argc > 1 ? strtoul(argv[1], NULL, 0) : 10000000;
+  unsigned r;
+  for (r = 0; r < sizeof rowRates / sizeof *rowRates; r++) {
+    Decimator d;
+    unsigned rate = rowRates[r];
+    decimatorInit(&d, rate, NULL, NULL);
+    printf("%u rows/s:  fast ratio %u (%u/s), slow ratio %u (%u/s)\n",
+           rate, d.fastRatio, decimatorFastRate(&d, rate),
+           d.slowRatio, decimatorSlowRate(&d, rate));
+    checkDC(rate);
+    checkDroop("fast", d.fastRatio, d.fastTap, d.fastRatio, rate,
+               fastOut, &fastN);
+    checkDroop("slow", d.slowRatio, d.slowTap, d.fastRatio*d.slowRatio, rate,
+               slowOut, &slowN);
+    bench(rate, rows);
+  }
+  printf("%u failures\n", failures);
+  return failures != 0;
+}
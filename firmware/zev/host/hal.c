@@ -0,0 +1,412 @@
+/**********************  host/hal.c  ************************
+*
+*  Host stand-ins for the ChibiOS kernel and HAL services
+*  used by the ZEV charger signal path
+*
+*  SD1 output goes to stdout.  Its input is the key script
+*  supplied on the simulator's command line.
+*
+***************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <ucontext.h>
+
+#include <ch.h>
+#include <hal.h>
+
+#include "simadc.h"
+
+GPIO_TypeDef hostGPIOA, hostGPIOB, hostGPIOC;
+DAC_TypeDef hostDAC;
+ADC_TypeDef hostADC1;
+SCB_Type hostSCB;
+USART_TypeDef hostUSART1;
+RCC_TypeDef hostRCC = {0x0c000000};  //PORRSTF and PINRSTF
+ADCDriver ADCD1 = {ADC_STOP, NULL, NULL, 0, &hostADC1};
+
+static void adcLldIrq(void)
+/*
+  the ChibiOS ADC driver handler only checks for overruns
+*/
+{
+}
+
+static void serialLldIrq(void)
+/*
+  the host's serial driver has nothing to do
+*/
+{
+}
+
+void (*const hostVectors[64])(void) = {  //only these are ever invoked
+  [16+ADC1_IRQn] = adcLldIrq,
+  [16+USART1_IRQn] = serialLldIrq
+};
+
+void hostIrq(IRQn_Type irq)
+/*
+  invoke the handler for irq through the vector table
+*/
+{
+  void (*const *vectors)(void) =
+    SCB->VTOR ? (void (*const *)(void))SCB->VTOR : hostVectors;
+  vectors[16+irq]();
+}
+
+
+halrtcnt_t halGetCounterValue(void)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (halrtcnt_t)(now.tv_sec * 1000000000ULL + now.tv_nsec);
+}
+
+
+/*
+ * Cooperative threads
+ */
+#define maxThreads  4
+
+static ucontext_t mainContext;
+static Thread mainThread = {
+  "main", NORMALPRIO, THD_STATE_CURRENT, {RDY_OK}, NULL, NULL, &mainContext, 0
+};
+static Thread *thread[maxThreads] = {&mainThread};
+static unsigned threads = 1;
+static Thread *current = &mainThread;
+
+static Thread *highestReady(void)
+{
+  Thread *best = NULL;
+  unsigned i;
+  for (i = 0; i < threads; i++) {
+    Thread *tp = thread[i];
+    if (tp->p_state == THD_STATE_SLEEPING &&
+        (int32_t)(chTimeNow() - tp->p_wake) >= 0)
+      tp->p_state = THD_STATE_READY;
+    if (tp->p_state == THD_STATE_READY && (!best || tp->p_prio > best->p_prio))
+      best = tp;
+  }
+  return best;
+}
+
+static void switchTo(Thread *tp)
+/*
+  run tp, leaving the current thread in whatever state it's in
+*/
+{
+  Thread *self = current;
+  current = tp;
+  tp->p_state = THD_STATE_CURRENT;
+  if (tp != self)
+    swapcontext(self->p_context, tp->p_context);
+}
+
+static void threadStart(void)
+{
+  current->p_func(current->p_arg);
+  chSchGoSleepS(THD_STATE_FINAL);
+}
+
+Thread *chThdCreateStatic(void *wsp, size_t size,
+                          tprio_t prio, tfunc_t pf, void *arg)
+/*
+  the Thread and its context are allocated at the base of wsp
+*/
+{
+  if (threads >= maxThreads) {
+    fprintf(stderr, "Too many threads!\n");
+    exit(2);
+  }
+  Thread *tp = wsp;
+  ucontext_t *context = (ucontext_t *)(((uintptr_t)(tp+1) + 63) & ~63);
+  uint8_t *stack = (uint8_t *)(((uintptr_t)(context+1) + 63) & ~63);
+  tp->p_name = NULL;
+  tp->p_prio = prio;
+  tp->p_state = THD_STATE_SUSPENDED;
+  tp->p_func = pf;
+  tp->p_arg = arg;
+  tp->p_context = context;
+  getcontext(context);
+  context->uc_stack.ss_sp = stack;
+  context->uc_stack.ss_size = (uint8_t *)wsp + size - stack;
+  context->uc_link = NULL;
+  makecontext(context, threadStart, 0);
+  thread[threads++] = tp;
+  chSchWakeupS(tp, RDY_OK);
+  return tp;
+}
+
+Thread *chThdSelf(void)
+{
+  return current;
+}
+
+systime_t chTimeNow(void)
+{
+  return (systime_t)(simNanoseconds() / (1000000000 / CH_FREQUENCY));
+}
+
+void chThdSleep(systime_t time)
+{
+  current->p_wake = chTimeNow() + time;
+  chSchGoSleepS(THD_STATE_SLEEPING);
+}
+
+void chSchReadyI(Thread *tp)
+{
+  tp->p_state = THD_STATE_READY;
+  tp->p_u.rdymsg = RDY_OK;
+}
+
+void chSchWakeupS(Thread *ntp, msg_t msg)
+{
+  ntp->p_u.rdymsg = msg;
+  if (ntp->p_prio > current->p_prio) {
+    current->p_state = THD_STATE_READY;
+    switchTo(ntp);
+  }else
+    ntp->p_state = THD_STATE_READY;
+}
+
+void chSchGoSleepS(uint8_t newstate)
+/*
+  switch to the highest priority ready thread, if necessary
+  running the simulation until some event readies one
+*/
+{
+  Thread *next;
+  current->p_state = newstate;
+  while (!(next = highestReady()))
+    simAdvance();
+  switchTo(next);
+}
+
+
+/*
+ * ADC driver
+ */
+void adcStart(ADCDriver *adcp, const void *config)
+{
+  (void)config;
+  if (adcp->state == ADC_STOP)
+    adcp->state = ADC_READY;
+}
+
+void adcStartConversion(ADCDriver *adcp, const ADCConversionGroup *grpp,
+                        adcsample_t *samples, size_t depth)
+{
+  adcp->grpp = grpp;
+  adcp->samples = samples;
+  adcp->depth = depth;
+  adcp->adc->SR = 0;
+  adcp->adc->CR1 = grpp->cr1 | ADC_CR1_OVRIE | ADC_CR1_SCAN;
+  adcp->adc->CR2 = grpp->cr2;
+  adcp->state = ADC_ACTIVE;
+  simRestart();
+}
+
+void adcStopConversion(ADCDriver *adcp)
+{
+  if (adcp->state == ADC_ACTIVE) {
+    adcp->adc->CR1 = 0;
+    adcp->adc->CR2 = 0;
+    adcp->grpp = NULL;
+    adcp->state = ADC_READY;
+  }
+}
+
+
+/*
+ * Serial driver 1
+ */
+static uint32_t bitrate = SERIAL_DEFAULT_BITRATE;
+
+void sdStart(SerialDriver *sdp, const SerialConfig *config)
+{
+  (void)sdp;
+  bitrate = config ? config->sc_speed : SERIAL_DEFAULT_BITRATE;
+  USART1->CR3 = config ? config->sc_cr3 : 0;
+}
+
+/*
+ * Characters written to SD1 are queued, as by the serial driver,
+ * and transmitted at the bit rate unless the host holds off (CTS)
+ */
+static uint8_t outq[SERIAL_BUFFERS_SIZE];
+static unsigned outHead, outCount;
+static Thread *outWriter;       //awaiting room in outq
+static uint64_t outCredit;      //bit times elapsed * 1e9
+static uint64_t lastPoll;       //simulated time of last hostSerialPoll()
+
+static size_t streamWrite(void *instance, const uint8_t *bp, size_t n)
+{
+  size_t i;
+  for (i = 0; i < n; i++) {
+    while (outCount >= SERIAL_BUFFERS_SIZE) {
+      outWriter = current;
+      chSchGoSleepS(THD_STATE_WTQUEUE);
+    }
+    outq[(outHead + outCount++) % SERIAL_BUFFERS_SIZE] = bp[i];
+  }
+  (void)instance;
+  return n;
+}
+
+static Thread *inReader;        //awaiting a received character
+static msg_t received = Q_TIMEOUT;
+
+void hostSerialPoll(void)
+/*
+  receive the next scripted key, if due, and
+  transmit characters due by the current simulated time
+*/
+{
+  if (received < 0 && (received = simKey()) >= 0) {
+    USART1->SR |= USART_SR_RXNE;
+    hostIrq(USART1_IRQn);
+    USART1->SR &= ~USART_SR_RXNE;
+    if (inReader) {
+      chSchReadyI(inReader);
+      inReader = NULL;
+    }
+  }
+  uint64_t now = simNanoseconds();
+  uint64_t elapsed = now - lastPoll;
+  lastPoll = now;
+  stm32_dma_stream_t *s = STM32_DMA1_STREAM4;
+  if (simSerialHeld()) {  //transmission postponed
+    s->doneNs += elapsed;
+    return;
+  }
+  if (!outCount) {
+    outCredit = 0;
+    return;
+  }
+  outCredit += elapsed * bitrate;
+  while (outCount && outCredit >= 10 * 1000000000ULL) {
+    outCredit -= 10 * 1000000000ULL;
+    hostIrq(USART1_IRQn);  //to transmit each character
+    if (!simQuiet)
+      putchar(outq[outHead]);
+    outHead = (outHead + 1) % SERIAL_BUFFERS_SIZE;
+    outCount--;
+  }
+  if (outWriter) {
+    chSchReadyI(outWriter);
+    outWriter = NULL;
+  }
+}
+
+
+/*
+ * DMA1 channel 4 to USART1, channel 7 memory to memory
+ */
+static DMA_Channel_TypeDef hostDMA1channel4, hostDMA1channel7;
+stm32_dma_stream_t hostDMA1stream4 = {&hostDMA1channel4, NULL, NULL, 0};
+stm32_dma_stream_t hostDMA1stream7 = {&hostDMA1channel7, NULL, NULL, 0};
+
+bool_t dmaStreamAllocate(stm32_dma_stream_t *dmastp, uint32_t priority,
+                         stm32_dmaisr_t func, void *param)
+{
+  (void)priority;
+  dmastp->func = func;
+  dmastp->param = param;
+  return FALSE;
+}
+
+void dmaStreamEnable(stm32_dma_stream_t *dmastp)
+{
+  DMA_Channel_TypeDef *ch = dmastp->channel;
+  ch->CCR |= STM32_DMA_CR_EN;
+  dmastp->doneNs = simNanoseconds() +
+                     (uint64_t)ch->CNDTR * 10 * 1000000000 / bitrate;
+}
+
+void dmaStartMemCopy(stm32_dma_stream_t *dmastp, uint32_t mode,
+                     const void *src, void *dst, size_t n)
+/*
+  memory to memory transfers complete at once
+*/
+{
+  DMA_Channel_TypeDef *ch = dmastp->channel;
+  ch->CPAR = (uintptr_t)src;
+  ch->CMAR = (uintptr_t)dst;
+  ch->CCR = mode | STM32_DMA_CR_MINC | STM32_DMA_CR_PINC |
+                   STM32_DMA_CR_DIR_M2M;
+  memcpy(dst, src, n * (mode & STM32_DMA_CR_PSIZE_HWORD ? 2 : 1));
+  ch->CNDTR = 0;
+}
+
+
+void hostDmaPoll(void)
+/*
+  complete any DMA transfer due by the current simulated time
+  (after hostSerialPoll() has postponed it while transmission is held)
+*/
+{
+  stm32_dma_stream_t *s = STM32_DMA1_STREAM4;
+  DMA_Channel_TypeDef *ch = s->channel;
+  if ((ch->CCR & STM32_DMA_CR_EN) && simNanoseconds() >= s->doneNs) {
+    if (USART1->CR3 & USART_CR3_DMAT && !simQuiet)
+      fwrite((const uint8_t *)ch->CMAR, 1, ch->CNDTR, stdout);
+    ch->CNDTR = 0;
+    if (ch->CCR & STM32_DMA_CR_TCIE)
+      s->func(s->param, STM32_DMA_ISR_TCIF);
+  }
+}
+
+static msg_t getKey(void)
+{
+  msg_t key = received;
+  received = Q_TIMEOUT;
+  return key;
+}
+
+static size_t streamRead(void *instance, uint8_t *bp, size_t n)
+{
+  size_t i;
+  for (i = 0; i < n; i++) {
+    msg_t key = getKey();
+    if (key < 0)
+      break;
+    bp[i] = (uint8_t)key;
+  }
+  (void)instance;
+  return i;
+}
+
+static msg_t streamPut(void *instance, uint8_t b)
+{
+  streamWrite(instance, &b, 1);
+  return Q_OK;
+}
+
+static msg_t streamGet(void *instance)
+{
+  (void)instance;
+  return getKey();
+}
+
+static const struct BaseSequentialStreamVMT sdVMT = {
+  streamWrite, streamRead, streamPut, streamGet
+};
+
+SerialDriver SD1 = {&sdVMT};
+
+msg_t chnGetTimeout(SerialDriver *sdp, systime_t time)
+/*
+  waits only if time is TIME_INFINITE
+*/
+{
+  (void)sdp;
+  if (time == TIME_INFINITE)
+    while (received < 0) {
+      inReader = current;
+      chSchGoSleepS(THD_STATE_WTQUEUE);
+    }
+  return getKey();
+}
@@ -0,0 +1,346 @@
+/**********************  host/hal.h  ************************
+*
+*  Minimal stand-in for the ChibiOS HAL and STM32L1xx registers
+*  used by the ZEV charger signal path, so it may be built and run
+*  natively on the host.
+*
+*  Peripheral registers are plain memory.  The simulated ADC and DMA
+*  (simadc.c) read the trigger timer, DAC and GPIO latches from them
+*  and write conversion results and watchdog status into them.
+*
+***************************************************************/
+
+#ifndef _HAL_H_
+#define _HAL_H_
+
+#include "ch.h"
+
+/*
+ * Free running counter -- host nanoseconds stand in for CPU cycles
+ */
+typedef uint32_t halrtcnt_t;
+
+halrtcnt_t halGetCounterValue(void);
+#define halGetCounterFrequency()  1000000000
+
+#define halInit()
+
+/*
+ * Cortex-M core
+ */
+typedef enum {
+  ADC1_IRQn = 18,
+  USART1_IRQn = 37
+} IRQn_Type;
+
+typedef struct {
+  uintptr_t VTOR;
+} SCB_Type;
+
+extern SCB_Type hostSCB;
+#define SCB  (&hostSCB)
+
+extern void (*const hostVectors[])(void);  /* stands in for flash vectors */
+#define FLASH_BASE  ((uintptr_t)hostVectors)
+
+#define __DSB()
+
+void hostIrq(IRQn_Type irq);
+/*
+  invoke the handler for irq through the vector table
+*/
+
+/*
+ * PAL
+ */
+typedef struct {
+  uint32_t ODR;
+  uint32_t IDR;
+} GPIO_TypeDef;
+
+typedef GPIO_TypeDef *ioportid_t;
+
+extern GPIO_TypeDef hostGPIOA, hostGPIOB, hostGPIOC;
+#define GPIOA  (&hostGPIOA)
+#define GPIOB  (&hostGPIOB)
+#define GPIOC  (&hostGPIOC)
+
+#define GPIOB_LED3  7
+#define GPIOB_LED4  6
+
+#define PAL_PORT_BIT(n)  ((uint32_t)1 << (n))
+
+#define PAL_MODE_INPUT_ANALOG       3
+#define PAL_MODE_OUTPUT_PUSHPULL    6
+#define PAL_MODE_OUTPUT_OPENDRAIN   7
+#define PAL_MODE_ALTERNATE(n)       (8 | ((n) << 8))
+
+#define palSetPad(port, pad)    ((port)->ODR |= PAL_PORT_BIT(pad))
+#define palClearPad(port, pad)  ((port)->ODR &= ~PAL_PORT_BIT(pad))
+#define palTogglePad(port, pad) ((port)->ODR ^= PAL_PORT_BIT(pad))
+#define palReadLatch(port)      ((port)->ODR)
+#define palSetPadMode(port, pad, mode)          ((void)(mode))
+#define palSetGroupMode(port, mask, offs, mode) ((void)(mode))
+
+/*
+ * RCC
+ */
+#define STM32_PCLK1  32000000
+#define STM32_PCLK2  32000000
+
+#define RCC_APB1ENR_TIM6EN  (1 << 4)
+#define RCC_APB1ENR_DACEN   (1 << 29)
+
+#define rccEnableAPB1(mask, lp)
+#define rccDisableAPB1(mask, lp)
+
+typedef struct {
+  uint32_t CSR;  //reset flags, as after power on
+} RCC_TypeDef;
+
+extern RCC_TypeDef hostRCC;
+#define RCC  (&hostRCC)
+
+#define RCC_CSR_RMVF  (1 << 24)
+
+/*
+ * DAC -- DOR1 follows DHR12R1 as each conversion is triggered
+ */
+typedef struct {
+  uint32_t CR;
+  uint32_t DHR12R1;
+  uint32_t DOR1;
+} DAC_TypeDef;
+
+extern DAC_TypeDef hostDAC;
+#define DAC  (&hostDAC)
+
+#define DAC_CR_EN1  1
+
+/*
+ * ADC
+ */
+typedef struct {
+  uint32_t SR;
+  uint32_t CR1;
+  uint32_t CR2;
+  uint32_t HTR;
+  uint32_t LTR;
+  uint32_t DR;
+  uint32_t CCR;
+} ADC_TypeDef;
+
+extern ADC_TypeDef hostADC1;
+#define ADC1  (&hostADC1)
+
+#define ADC_SR_AWD          (1 << 0)
+
+#define ADC_CR1_AWDCH       0x1f
+#define ADC_CR1_AWDIE       (1 << 6)
+#define ADC_CR1_SCAN        (1 << 8)
+#define ADC_CR1_AWDSGL      (1 << 9)
+#define ADC_CR1_AWDEN       (1 << 23)
+#define ADC_CR1_OVRIE       (1 << 26)
+
+#define ADC_CR2_EXTSEL_0    (1 << 24)
+#define ADC_CR2_EXTSEL_1    (1 << 25)
+#define ADC_CR2_EXTSEL_2    (1 << 26)
+#define ADC_CR2_EXTSEL_3    (1 << 27)
+#define ADC_CR2_EXTEN_0     (1 << 28)
+
+#define ADC_CHANNEL_IN1     1
+#define ADC_CHANNEL_IN2     2
+#define ADC_CHANNEL_IN10    10
+#define ADC_CHANNEL_IN11    11
+#define ADC_CHANNEL_IN12    12
+#define ADC_CHANNEL_SENSOR  16
+
+#define ADC_SAMPLE_4        0
+#define ADC_SAMPLE_9        1
+#define ADC_SAMPLE_16       2
+#define ADC_SAMPLE_24       3
+#define ADC_SAMPLE_48       4
+#define ADC_SAMPLE_96       5
+#define ADC_SAMPLE_192      6
+#define ADC_SAMPLE_384      7
+
+#define ADC_SMPR2_SMP_AN10(n)    ((n) << 0)
+#define ADC_SMPR2_SMP_AN11(n)    ((n) << 3)
+#define ADC_SMPR2_SMP_AN12(n)    ((n) << 6)
+#define ADC_SMPR2_SMP_SENSOR(n)  ((n) << 18)
+#define ADC_SMPR3_SMP_AN1(n)     ((n) << 3)
+#define ADC_SMPR3_SMP_AN2(n)     ((n) << 6)
+
+#define ADC_SQR1_NUM_CH(n)  (((n) - 1) << 20)
+#define ADC_SQR5_SQ1_N(n)   ((n) << 0)
+#define ADC_SQR5_SQ2_N(n)   ((n) << 5)
+#define ADC_SQR5_SQ3_N(n)   ((n) << 10)
+#define ADC_SQR5_SQ4_N(n)   ((n) << 15)
+#define ADC_SQR5_SQ5_N(n)   ((n) << 20)
+#define ADC_SQR5_SQ6_N(n)   ((n) << 25)
+
+typedef uint16_t adcsample_t;
+typedef uint16_t adc_channels_num_t;
+
+typedef enum {
+  ADC_UNINIT, ADC_STOP, ADC_READY, ADC_ACTIVE, ADC_COMPLETE, ADC_ERROR
+} adcstate_t;
+
+typedef enum {
+  ADC_ERR_DMAFAILURE, ADC_ERR_OVERFLOW
+} adcerror_t;
+
+typedef struct ADCDriver ADCDriver;
+
+typedef void (*adccallback_t)(ADCDriver *adcp, adcsample_t *buffer, size_t n);
+typedef void (*adcerrorcallback_t)(ADCDriver *adcp, adcerror_t err);
+
+typedef struct {
+  bool_t              circular;
+  adc_channels_num_t  num_channels;
+  adccallback_t       end_cb;
+  adcerrorcallback_t  error_cb;
+  uint32_t            cr1;
+  uint32_t            cr2;
+  uint32_t            smpr1;
+  uint32_t            smpr2;
+  uint32_t            smpr3;
+  uint32_t            sqr1;
+  uint32_t            sqr2;
+  uint32_t            sqr3;
+  uint32_t            sqr4;
+  uint32_t            sqr5;
+} ADCConversionGroup;
+
+struct ADCDriver {
+  adcstate_t                state;
+  const ADCConversionGroup  *grpp;
+  adcsample_t               *samples;
+  size_t                    depth;
+  ADC_TypeDef               *adc;
+};
+
+extern ADCDriver ADCD1;
+
+void adcStart(ADCDriver *adcp, const void *config);
+void adcStartConversion(ADCDriver *adcp, const ADCConversionGroup *grpp,
+                        adcsample_t *samples, size_t depth);
+void adcStopConversion(ADCDriver *adcp);
+#define adcSTM32EnableTSVREFE()
+
+/*
+ * USART1 -- only its receive status, flow control and DMA transmit request
+ * are used directly
+ */
+typedef struct {
+  uint32_t SR;
+  uint32_t DR;
+  uint32_t CR3;
+} USART_TypeDef;
+
+extern USART_TypeDef hostUSART1;
+#define USART1  (&hostUSART1)
+
+#define USART_SR_RXNE   (1 << 5)
+#define USART_CR3_DMAT  (1 << 7)
+#define USART_CR3_RTSE  (1 << 8)
+#define USART_CR3_CTSE  (1 << 9)
+
+/*
+ * DMA -- a transfer to USART1 completes after the time it takes to
+ * transmit its bytes, when its bytes are written to stdout.
+ * Memory to memory transfers complete as soon as they start.
+ */
+typedef struct {
+  uint32_t  CCR;
+  uint32_t  CNDTR;
+  uintptr_t CPAR;
+  uintptr_t CMAR;
+} DMA_Channel_TypeDef;
+
+typedef void (*stm32_dmaisr_t)(void *p, uint32_t flags);
+
+typedef struct {
+  DMA_Channel_TypeDef *channel;
+  stm32_dmaisr_t      func;
+  void                *param;
+  uint64_t            doneNs;  //simulated time transfer completes
+} stm32_dma_stream_t;
+
+extern stm32_dma_stream_t hostDMA1stream4, hostDMA1stream7;
+#define STM32_DMA1_STREAM4  (&hostDMA1stream4)
+#define STM32_DMA1_STREAM7  (&hostDMA1stream7)
+
+#define STM32_DMA_CR_EN          (1 << 0)
+#define STM32_DMA_CR_TCIE        (1 << 1)
+#define STM32_DMA_CR_DIR_M2P     (1 << 4)
+#define STM32_DMA_CR_PINC        (1 << 6)
+#define STM32_DMA_CR_MINC        (1 << 7)
+#define STM32_DMA_CR_PSIZE_BYTE  0
+#define STM32_DMA_CR_PSIZE_HWORD (1 << 8)
+#define STM32_DMA_CR_MSIZE_BYTE  0
+#define STM32_DMA_CR_MSIZE_HWORD (1 << 10)
+#define STM32_DMA_CR_DIR_M2M     (1 << 14)
+#define STM32_DMA_CR_PL(n)       ((n) << 12)
+#define STM32_DMA_ISR_TCIF       (1 << 1)
+
+#define STM32_SERIAL_USART1_PRIORITY  12
+
+bool_t dmaStreamAllocate(stm32_dma_stream_t *dmastp, uint32_t priority,
+                         stm32_dmaisr_t func, void *param);
+void dmaStreamEnable(stm32_dma_stream_t *dmastp);
+#define dmaStreamSetPeripheral(dmastp, addr) \
+          ((dmastp)->channel->CPAR = (uintptr_t)(addr))
+#define dmaStreamSetMemory0(dmastp, addr) \
+          ((dmastp)->channel->CMAR = (uintptr_t)(addr))
+#define dmaStreamSetTransactionSize(dmastp, size) \
+          ((dmastp)->channel->CNDTR = (size))
+#define dmaStreamSetMode(dmastp, mode)  ((dmastp)->channel->CCR = (mode))
+#define dmaStreamDisable(dmastp) \
+          ((dmastp)->channel->CCR &= ~(STM32_DMA_CR_TCIE | STM32_DMA_CR_EN))
+
+void dmaStartMemCopy(stm32_dma_stream_t *dmastp, uint32_t mode,
+                     const void *src, void *dst, size_t n);
+/*
+  memory to memory transfers complete at once
+*/
+
+void hostDmaPoll(void);
+/*
+  complete any DMA transfer due by the current simulated time
+  (after hostSerialPoll() has postponed it while transmission is held)
+*/
+
+/*
+ * Serial -- SD1 writes to stdout and reads scripted key presses
+ *           Each character transmitted or received
+ *           invokes the USART1 interrupt handler
+ */
+#define SERIAL_DEFAULT_BITRATE  115200  /* as in stm32l-discovery/halconf.h */
+#define SERIAL_BUFFERS_SIZE     64
+
+typedef struct {
+  uint32_t sc_speed;
+  uint16_t sc_cr1;
+  uint16_t sc_cr2;
+  uint16_t sc_cr3;
+} SerialConfig;
+
+typedef struct {
+  const struct BaseSequentialStreamVMT *vmt;
+} SerialDriver;
+
+extern SerialDriver SD1;
+
+void sdStart(SerialDriver *sdp, const SerialConfig *config);
+#define sdStop(sdp)
+#define sdWrite(sdp, b, n)  ((sdp)->vmt->write(sdp, b, n))
+msg_t chnGetTimeout(SerialDriver *sdp, systime_t time);
+
+void hostSerialPoll(void);
+/*
+  receive the next scripted key, if due, and
+  transmit characters due by the current simulated time
+*/
+
+#endif /* _HAL_H_ */
@@ -0,0 +1,242 @@
+##############################################################################
+# Host native build of the ZEV charger signal path
+#
+#   make host         builds the simulator and host tools in build/host
+#   make host-check   builds them and runs the host tests
+#   make host-clean   removes them
+#
+# The sampling, conversion, filtering, protection and control sources are
+# compiled unchanged against the stub kernel and HAL headers in host/.
+# A simulated ADC and DMA (host/simadc.c) feeds them from a signal model.
+# zevreplay feeds the frame processing pipeline from a raw frame recording.
+# zevtelem decodes binary telemetry to CSV.
+# zevtextbench compares the cost of formatting text lines two ways.
+# zevscope splits a scope mode capture into per channel sample files.
+# zevdebugbench measures the target's debugPrint() formatting into its ring.
+# zevdebugstress drives the target's debugput.c from many threads at once.
+# zevdebuglog formats debugLog()'s binary messages from an openocd log.
+# zevdccbench measures the debug output reader feeding each transport's mock.
+# zevflight formats the flight recorder ring saved by gdb's flightlog.
+# zevconvtest checks the fixed point Amps conversion against the float one.
+# zevaccumtest checks the SWAR channel sums against the scalar ones.
+# zevaccumbench compares the channel summing kernels with the old loop.
+# zevdecimtest checks the decimator's gain and droop, and times it.
+# zevtracetest checks the flight recorder across a simulated warm reset.
+# zevawdtest checks that protection trips drop CHARGER and are recorded.
+# zevcommandtest checks that an immediate shutdown discards its line.
+#
+
+HOSTCC ?= cc
+OVERLAY ?= ../chibios
+
+HOSTDIR = build/host
+HOSTOPT = -O2 -g
+HOSTWARN = -Wall -Wextra -Wstrict-prototypes
+HOSTINC = -Ihost -I. -I$(OVERLAY)/os
+
+HOSTSRC = convert.c \
+          accum.c \
+          frameq.c \
+          sampling.c \
+          decimate.c \
+          irqhook.c \
+          awd.c \
+          fault.c \
+          trace.c \
+          charge.c \
+          pipeline.c \
+          rawframe.c \
+          cobs.c \
+          telemetry.c \
+          uartdma.c \
+          textline.c \
+          report.c \
+          command.c \
+          zev.c \
+          host/hal.c \
+          host/chprintf.c \
+          host/debugput.c \
+          host/simadc.c
+
+REPLAYSRC = convert.c \
+            accum.c \
+            decimate.c \
+            charge.c \
+            pipeline.c \
+            rawframe.c \
+            host/zevreplay.c
+
+TELEMSRC = cobs.c \
+           telemetry.c \
+           host/zevtelem.c
+
+BENCHSRC = textline.c \
+           host/textbench.c
+
+SCOPESRC = rawframe.c \
+           host/zevscope.c
+
+DEBUGSRC = host/chprintf.c \
+           host/logdecode.c \
+           host/debugbench.c
+
+STRESSSRC = host/chprintf.c \
+            host/debugstress.c
+
+LOGSRC = host/logdecode.c \
+         host/debuglog.c
+
+FLIGHTSRC = host/zevflight.c
+
+CONVSRC = convert.c \
+          host/convtest.c
+
+ACCUMSRC = accum.c \
+           host/accumtest.c
+
+ACCBENCHSRC = accum.c \
+              host/accumbench.c
+
+DECIMSRC = decimate.c \
+           host/decimtest.c
+
+TRACESRC = trace.c \
+           host/tracetest.c
+
+AWDSRC = awd.c \
+         irqhook.c \
+         trace.c \
+         host/awdtest.c
+
+COMMANDSRC = command.c \
+             cobs.c \
+             irqhook.c \
+             trace.c \
+             host/chprintf.c \
+             host/commandtest.c
+
+DCCSRC = host/chprintf.c \
+         host/logdecode.c \
+         host/dccbench.c
+
+HOSTOBJ = $(addprefix $(HOSTDIR)/, $(notdir $(HOSTSRC:.c=.o)))
+REPLAYOBJ = $(addprefix $(HOSTDIR)/, $(notdir $(REPLAYSRC:.c=.o)))
+TELEMOBJ = $(addprefix $(HOSTDIR)/, $(notdir $(TELEMSRC:.c=.o)))
+BENCHOBJ = $(addprefix $(HOSTDIR)/, $(notdir $(BENCHSRC:.c=.o)))
+SCOPEOBJ = $(addprefix $(HOSTDIR)/, $(notdir $(SCOPESRC:.c=.o)))
+DEBUGOBJ = $(addprefix $(HOSTDIR)/, $(notdir $(DEBUGSRC:.c=.o))) \
+           $(HOSTDIR)/targetdebugput.o
+STRESSOBJ = $(addprefix $(HOSTDIR)/, $(notdir $(STRESSSRC:.c=.o))) \
+            $(HOSTDIR)/targetdebugput.o
+LOGOBJ = $(addprefix $(HOSTDIR)/, $(notdir $(LOGSRC:.c=.o)))
+FLIGHTOBJ = $(addprefix $(HOSTDIR)/, $(notdir $(FLIGHTSRC:.c=.o)))
+CONVOBJ = $(addprefix $(HOSTDIR)/, $(notdir $(CONVSRC:.c=.o)))
+ACCUMOBJ = $(addprefix $(HOSTDIR)/, $(notdir $(ACCUMSRC:.c=.o)))
+ACCBENCHOBJ = $(addprefix $(HOSTDIR)/, $(notdir $(ACCBENCHSRC:.c=.o)))
+DECIMOBJ = $(addprefix $(HOSTDIR)/, $(notdir $(DECIMSRC:.c=.o)))
+TRACEOBJ = $(addprefix $(HOSTDIR)/, $(notdir $(TRACESRC:.c=.o)))
+AWDOBJ = $(addprefix $(HOSTDIR)/, $(notdir $(AWDSRC:.c=.o)))
+COMMANDOBJ = $(addprefix $(HOSTDIR)/, $(notdir $(COMMANDSRC:.c=.o)))
+DCCOBJ = $(addprefix $(HOSTDIR)/, $(notdir $(DCCSRC:.c=.o))) \
+         $(HOSTDIR)/targetdebugput.o $(HOSTDIR)/targetdccput.o \
+         $(HOSTDIR)/targetdebugtransport.o
+
+vpath %.c . host
+
+.PHONY: host host-check host-clean
+
+HOSTTESTS = $(HOSTDIR)/zevconvtest $(HOSTDIR)/zevaccumtest \
+            $(HOSTDIR)/zevdecimtest $(HOSTDIR)/zevtracetest \
+            $(HOSTDIR)/zevawdtest $(HOSTDIR)/zevcommandtest
+
+host: $(HOSTDIR)/zevsim $(HOSTDIR)/zevreplay $(HOSTDIR)/zevtelem \
+      $(HOSTDIR)/zevtextbench $(HOSTDIR)/zevscope $(HOSTDIR)/zevdebugbench \
+      $(HOSTDIR)/zevdebugstress $(HOSTDIR)/zevdebuglog $(HOSTDIR)/zevdccbench \
+      $(HOSTDIR)/zevflight $(HOSTDIR)/zevaccumbench $(HOSTTESTS)
+
+host-check: host
+	@for test in $(HOSTTESTS); do echo $$test; $$test || exit 1; done
+
+$(HOSTDIR)/zevsim: $(HOSTOBJ)
+	$(HOSTCC) $(HOSTOPT) -o $@ $^ -lm
+
+$(HOSTDIR)/zevreplay: $(REPLAYOBJ)
+	$(HOSTCC) $(HOSTOPT) -o $@ $^
+
+$(HOSTDIR)/zevtelem: $(TELEMOBJ)
+	$(HOSTCC) $(HOSTOPT) -o $@ $^
+
+$(HOSTDIR)/zevtextbench: $(BENCHOBJ)
+	$(HOSTCC) $(HOSTOPT) -o $@ $^
+
+$(HOSTDIR)/zevscope: $(SCOPEOBJ)
+	$(HOSTCC) $(HOSTOPT) -o $@ $^
+
+$(HOSTDIR)/zevdebugbench: $(DEBUGOBJ)
+	$(HOSTCC) $(HOSTOPT) -o $@ $^
+
+$(HOSTDIR)/zevdebugstress: $(STRESSOBJ)
+	$(HOSTCC) $(HOSTOPT) -pthread -o $@ $^
+
+$(HOSTDIR)/zevdebuglog: $(LOGOBJ)
+	$(HOSTCC) $(HOSTOPT) -o $@ $^
+
+$(HOSTDIR)/zevdccbench: $(DCCOBJ)
+	$(HOSTCC) $(HOSTOPT) -o $@ $^
+
+$(HOSTDIR)/zevflight: $(FLIGHTOBJ)
+	$(HOSTCC) $(HOSTOPT) -o $@ $^
+
+$(HOSTDIR)/zevconvtest: $(CONVOBJ)
+	$(HOSTCC) $(HOSTOPT) -o $@ $^ -lm
+
+$(HOSTDIR)/zevaccumtest: $(ACCUMOBJ)
+	$(HOSTCC) $(HOSTOPT) -o $@ $^
+
+$(HOSTDIR)/zevaccumbench: $(ACCBENCHOBJ)
+	$(HOSTCC) $(HOSTOPT) -o $@ $^
+
+$(HOSTDIR)/zevdecimtest: $(DECIMOBJ)
+	$(HOSTCC) $(HOSTOPT) -o $@ $^ -lm
+
+# decodes the ring it saves with zevflight
+$(HOSTDIR)/zevtracetest: $(TRACEOBJ) | $(HOSTDIR)/zevflight
+	$(HOSTCC) $(HOSTOPT) -o $@ $^
+
+$(HOSTDIR)/zevawdtest: $(AWDOBJ)
+	$(HOSTCC) $(HOSTOPT) -o $@ $^
+
+$(HOSTDIR)/zevcommandtest: $(COMMANDOBJ)
+	$(HOSTCC) $(HOSTOPT) -o $@ $^
+
+# zev.c's main() is invoked by the simulator's
+$(HOSTDIR)/zev.o: HOSTDEFS = -Dmain=zevMain
+
+# the target's debugput.c, as opposed to the simulator's host/debugput.c
+$(HOSTDIR)/targetdebugput.o: $(OVERLAY)/os/debugput.c | $(HOSTDIR)
+	$(HOSTCC) $(HOSTOPT) $(HOSTWARN) $(HOSTINC) -MMD -c -o $@ $<
+
+$(HOSTDIR)/targetdebugtransport.o: $(OVERLAY)/os/debugtransport.c | $(HOSTDIR)
+	$(HOSTCC) $(HOSTOPT) $(HOSTWARN) $(HOSTINC) -MMD -c -o $@ $<
+
+# the target's dccput.c, writing to host/dccbench.c's stand-ins for DCRDR and DHCSR
+$(HOSTDIR)/targetdccput.o: $(OVERLAY)/os/dccput.c | $(HOSTDIR)
+	$(HOSTCC) $(HOSTOPT) $(HOSTWARN) $(HOSTINC) '-DDCRDR=(*hostDCRDR())' \
+	  '-DDHCSR=(*hostDHCSR())' \
+	  -MMD -c -o $@ $<
+
+$(HOSTDIR)/%.o: %.c | $(HOSTDIR)
+	$(HOSTCC) $(HOSTOPT) $(HOSTWARN) $(HOSTDEFS) $(HOSTINC) -MMD -c -o $@ $<
+
+$(HOSTDIR):
+	mkdir -p $@
+
+host-clean:
+	rm -rf $(HOSTDIR)
+
+-include $(HOSTOBJ:.o=.d) $(REPLAYOBJ:.o=.d) $(TELEMOBJ:.o=.d) \
+         $(BENCHOBJ:.o=.d) $(SCOPEOBJ:.o=.d) $(DEBUGOBJ:.o=.d) \
+         $(STRESSOBJ:.o=.d) $(LOGOBJ:.o=.d) $(FLIGHTOBJ:.o=.d) \
+         $(DCCOBJ:.o=.d) $(CONVOBJ:.o=.d) $(ACCUMOBJ:.o=.d) \
+         $(ACCBENCHOBJ:.o=.d) $(DECIMOBJ:.o=.d) $(TRACEOBJ:.o=.d) \
+         $(AWDOBJ:.o=.d) $(COMMANDOBJ:.o=.d)
@@ -0,0 +1,105 @@
+/**********************  host/logdecode.c  ************************
+*
+*  Format the binary messages output by debugLog() (see debugput.h)
+*
+*  chprintf() prints the hex digits of both %x and %X in upper case,
+*  takes upper case conversions and the l modifier as long (32 bits on
+*  the target) and knows no other modifiers.
+*
+***************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+
+#include "logdecode.h"
+
+int logDecode(char *line, size_t size, const uint32_t *words, size_t n,
+              LogFormatLookup *lookup)
+/*
+  format the message beginning n words into line of size bytes
+  returns # of words in the message, 0 if it extends beyond n words,
+  or -1 if its first word is not the address of a format
+*/
+{
+  if (!n)
+    return 0;
+  const char *fmt = lookup(words[0]);
+  if (!fmt)
+    return -1;
+  size_t used = 1, len = 0;
+  char c;
+#define room   (len < size ? size - len : 0)
+#define need(k)  if (used + (k) > n) return 0
+  while ((c = *fmt++)) {
+    if (c != '%') {
+      if (len+1 < size)
+        line[len] = c;
+      len++;
+      continue;
+    }
+    char spec[32];
+    size_t specLen = 0;
+    spec[specLen++] = '%';
+    while ((c = *fmt)) {
+      fmt++;
+      if (c == '*') {
+        need(1);
+        specLen += snprintf(spec+specLen, sizeof spec - specLen - 2,
+                            "%d", (int32_t)words[used++]);
+      }else if ((c|' ') == 'l')
+        continue;
+      else if (((c|' ') >= 'a' && (c|' ') <= 'z') || c == '%')
+        break;
+      else if (specLen < sizeof spec - 2)
+        spec[specLen++] = c;
+    }
+    if (!c)
+      break;
+    char conv = c|' ';
+    if (conv == 'x')
+      conv = 'X';
+    else if (conv == 'i')
+      conv = 'd';
+    spec[specLen++] = c == '%' ? '%' : conv;
+    spec[specLen] = 0;
+    char *out = line + (len < size ? len : size);
+    switch (conv) {
+      case 's': {
+        need(1);
+        uint32_t strLen = words[used];
+        size_t strWords = (strLen + 3) / 4;
+        need(1 + strWords);
+        char str[256];
+        if (strLen >= sizeof str)
+          strLen = sizeof str - 1;
+        memcpy(str, words + used + 1, strLen);
+        str[strLen] = 0;
+        used += 1 + strWords;
+        len += snprintf(out, room, spec, str);
+        break;
+      }
+      case 'f': {
+        need(2);
+        double d;
+        memcpy(&d, words + used, sizeof d);
+        used += 2;
+        len += snprintf(out, room, spec, d);
+        break;
+      }
+      case 'd':
+        need(1);
+        len += snprintf(out, room, spec, (int32_t)words[used++]);
+        break;
+      case '%':
+        len += snprintf(out, room, "%%");
+        break;
+      default:  //c, u, X and o take an unsigned word
+        need(1);
+        len += snprintf(out, room, spec, words[used++]);
+    }
+  }
+#undef need
+#undef room
+  line[len < size ? len : size-1] = 0;
+  return used;
+}
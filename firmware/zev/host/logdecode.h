@@ -0,0 +1,31 @@
+/**********************  host/logdecode.h  ************************
+*
+*  Format the binary messages output by debugLog() (see debugput.h)
+*
+*  Each message is the address of its format string followed by the raw
+*  words of its arguments.  The host finds the format by its address,
+*  then walks it as debugLog() did, formatting each conversion
+*  approximately as the target's chprintf() would have.
+*
+***************************************************************/
+
+#ifndef LOGDECODE_H
+#define LOGDECODE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef const char *LogFormatLookup(uint32_t address);
+/*
+  return the format string at address, or NULL if there is none
+*/
+
+int logDecode(char *line, size_t size, const uint32_t *words, size_t n,
+              LogFormatLookup *lookup);
+/*
+  format the message beginning n words into line of size bytes
+  returns # of words in the message, 0 if it extends beyond n words,
+  or -1 if its first word is not the address of a format
+*/
+
+#endif /* LOGDECODE_H */
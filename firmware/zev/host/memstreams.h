@@ -0,0 +1,22 @@
+/**********************  host/memstreams.h  ************************
+*
+*  ChibiOS memory streams for the host
+*
+***************************************************************/
+
+#ifndef _MEMSTREAMS_H_
+#define _MEMSTREAMS_H_
+
+#include "ch.h"
+
+typedef struct {
+  const struct BaseSequentialStreamVMT *vmt;
+  uint8_t *buffer;  //stream data
+  size_t size;      //capacity of buffer
+  size_t eos;       //end of stream -- # of bytes written
+  size_t offset;    //next byte to read
+} MemoryStream;
+
+void msObjectInit(MemoryStream *msp, uint8_t *buffer, size_t size, size_t eos);
+
+#endif /* _MEMSTREAMS_H_ */
@@ -0,0 +1,302 @@
+/**********************  host/simadc.c  ************************
+*
+*  Simulated ADC, DMA and charger hardware for the host build
+*
+*  Whenever every thread is waiting, the simulated DMA converts the next
+*  row of the ADC driver's sample buffer from a signal model, invoking
+*  the driver's end callback after the last row of each half buffer.
+*  Simulated time advances by the trigger timer's period for each row.
+*
+*  The model is a battery with internal resistance, charged through
+*  CHARGER by a supply whose voltage follows the DAC output.
+*  Sample rows are in the conversion order set in the conversion group:
+*    SENSOR  -- internal temperature at its nominal reading
+*    IN10    -- PC0 High Voltage at the battery terminals
+*    IN11    -- PC1 DAC setpoint feedback
+*    IN12    -- PC2 celltop, half the battery's open circuit voltage
+*    IN1     -- PA1 current sensor's Vcc/2
+*    IN2     -- PA2 current sensor output
+*
+*  Characters queued for SD1 and DMA transfers to USART1 are transmitted
+*  at the serial bit rate as simulated time passes, unless held off
+*  as by deasserting CTS.
+*
+*  The analog watchdog compares every conversion of its channel and, when
+*  enabled, invokes the (possibly hooked) ADC vector with the trigger timer
+*  holding the time since the row's trigger.
+*
+*  usage:  zevsim {-n frames} {-k frame:keys} {-s frame} {-b counts}
+*                 {-c frame:frames} {-q}
+*    -n  exit after this many frames (default 2000)
+*    -k  type keys on the serial port when frame # is reached (repeatable)
+*    -s  short circuit the charger output from frame # on
+*    -b  initial battery High Voltage counts (default 2700)
+*    -c  hold off serial transmission for frames starting at frame #
+*    -q  discard the serial port's per frame output
+*
+***************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <hal.h>
+#include <stm32_tim.h>
+
+#include "simadc.h"
+#include "convert.h"
+#include "pins.h"
+#include "sampling.h"
+
+stm32_tim_t hostTIM6;
+
+bool_t simQuiet = FALSE;
+
+#define adcClkRate    16000000  /* HSI, as in sampling.c */
+
+#define chargerGain   0.9f      /* supply HV counts per DAC count */
+#define batteryR      40.0f     /* internal resistance in HV counts per Amp */
+#define batteryCap    0.5f      /* HV counts per Amp-second charge */
+#define shortAmps     40.0f     /* current into a short circuit */
+#define noiseCounts   3         /* peak noise on every conversion */
+
+static float battery = 2700.0f;   /* open circuit HV counts */
+static unsigned shortFrame = ~0u; /* short circuit from this frame on */
+static unsigned holdFrame = ~0u, holdFrames = 0;  /* serial held off */
+
+static unsigned frames = 0, maxFrames = 2000;
+static uint64_t simNs = 0;
+static unsigned half = 0;  /* half of sample buffer to convert next */
+static size_t rowIndex = 0;  /* row of that half to convert next */
+
+#define maxScript 32
+static struct {
+  unsigned frame;
+  const char *keys;
+} script[maxScript];
+static unsigned scriptLen = 0, scriptNext = 0;
+
+static uint32_t noiseState = 1;
+
+
+uint64_t simNanoseconds(void)
+{
+  return simNs;
+}
+
+
+void simRestart(void)
+{
+  half = 0;
+  rowIndex = 0;
+}
+
+
+msg_t simKey(void)
+{
+  while (scriptNext < scriptLen && script[scriptNext].frame <= frames) {
+    const char *key = script[scriptNext].keys;
+    if (*key) {
+      script[scriptNext].keys = key+1;
+      return (uint8_t)*key;
+    }
+    scriptNext++;
+  }
+  return Q_TIMEOUT;
+}
+
+
+static int noise(void)
+{
+  noiseState = noiseState * 1664525 + 1013904223;
+  return (int)((noiseState >> 16) % (2*noiseCounts+1)) - noiseCounts;
+}
+
+static adcsample_t counts(float x)
+{
+  int c = (int)(x + 0.5f) + noise();
+  return c < 0 ? 0 : c > 0xfff ? 0xfff : c;
+}
+
+static const uint16_t sampleClocks[8] = {4, 9, 16, 24, 48, 96, 192, 384};
+
+static unsigned conversionClocks(const ADCConversionGroup *grp, unsigned ch)
+{
+  uint32_t code = ch < 10 ? grp->smpr3 >> (3*ch) : grp->smpr2 >> (3*(ch-10));
+  return sampleClocks[code & 7] + 12;
+}
+
+
+static void convertRow(adcsample_t *row, float rowSeconds)
+/*
+  convert one row of samples at the current state of the model
+*/
+{
+  const ADCConversionGroup *grp = ADCD1.grpp;
+  ADC_TypeDef *adc = ADCD1.adc;
+  DAC->DOR1 = DAC->DHR12R1 & 0xfff;
+  unsigned clocks = 0, col;
+  for (col = 0; col < grp->num_channels; col++) {
+    float amps = 0.0f, hv = battery;
+    if (padLatched(CHARGER)) {
+      if (frames >= shortFrame) {
+        amps = shortAmps;
+        hv = 0.0f;
+      }else{
+        amps = (DAC->DOR1 * chargerGain - battery) / batteryR;
+        if (amps < 0.0f)
+          amps = 0.0f;
+        hv = battery + amps * batteryR;
+      }
+    }
+    unsigned ch = (grp->sqr5 >> (5*col)) & 0x1f;
+    float x;
+    switch (ch) {
+      case ADC_CHANNEL_SENSOR:
+        x = ampTnom;
+        break;
+      case ADC_CHANNEL_IN10:
+        x = hv;
+        break;
+      case ADC_CHANNEL_IN11:
+        x = DAC->DOR1;
+        break;
+      case ADC_CHANNEL_IN12:
+        x = battery / 2;
+        break;
+      case ADC_CHANNEL_IN1:
+        x = ampVnom;
+        break;
+      case ADC_CHANNEL_IN2:
+        x = ampVnom - amps / (ampScale * ampDepth);
+        break;
+      default:
+        x = 0.0f;
+    }
+    row[col] = adc->DR = counts(x);
+    clocks += conversionClocks(grp, ch);
+    if ((adc->CR1 & (ADC_CR1_AWDEN | ADC_CR1_AWDIE)) ==
+                    (ADC_CR1_AWDEN | ADC_CR1_AWDIE) &&
+        (adc->CR1 & ADC_CR1_AWDCH) == ch &&
+        (adc->DR < adc->LTR || adc->DR > adc->HTR)) {
+      adc->SR |= ADC_SR_AWD;
+      STM32_TIM6->CNT = clocks * adcTimeBase / adcClkRate;
+      hostIrq(ADC1_IRQn);
+    }
+    battery += amps * batteryCap * rowSeconds / grp->num_channels;
+  }
+}
+
+
+static void finish(void)
+{
+  static struct timespec start;
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  if (!frames) {
+    start = now;
+    return;
+  }
+  double wall = (now.tv_sec - start.tv_sec) + (now.tv_nsec - start.tv_nsec)*1e-9;
+  fprintf(stderr,
+    "%u frames, %.2f simulated s in %.3f s (%.0f frames/s), battery at %d counts\n",
+    frames, simNs*1e-9, wall, frames/wall, (int)(battery + 0.5f));
+  exit(0);
+}
+
+
+void simAdvance(void)
+/*
+  convert one more row, invoking the ADC driver's callback after
+  the last row of each half buffer
+  exits the simulation after the requested # of frames
+*/
+{
+  const ADCConversionGroup *grp = ADCD1.grpp;
+  if (ADCD1.state != ADC_ACTIVE || !grp) {
+    fprintf(stderr, "Awaiting frames with the ADC stopped!\n");
+    exit(2);
+  }
+  if (frames >= maxFrames)
+    finish();
+  size_t depth = ADCD1.depth / 2;
+  uint64_t rowNs = (uint64_t)(STM32_TIM6->PSC+1) * (STM32_TIM6->ARR+1) *
+                     1000000000 / STM32_PCLK1;
+  adcsample_t *buffer = ADCD1.samples + half*depth*grp->num_channels;
+  convertRow(buffer + rowIndex*grp->num_channels, rowNs * 1e-9f);
+  simNs += rowNs;
+  hostSerialPoll();
+  hostDmaPoll();
+  if (++rowIndex < depth)
+    return;
+  rowIndex = 0;
+  frames++;
+  half ^= 1;
+  if (grp->end_cb)
+    grp->end_cb(&ADCD1, buffer, depth);
+}
+
+
+bool_t simSerialHeld(void)
+/*
+  TRUE while serial transmission is held off
+*/
+{
+  return frames >= holdFrame && frames - holdFrame < holdFrames;
+}
+
+
+extern int zevMain(void);  //zev.c's main()
+
+int main(int argc, char **argv)
+{
+  int opt;
+  while ((opt = getopt(argc, argv, "n:k:s:b:c:q")) != -1) {
+    char *end;
+    switch (opt) {
+      case 'n':
+        maxFrames = strtoul(optarg, NULL, 0);
+        break;
+      case 'k':
+        if (scriptLen >= maxScript) {
+          fprintf(stderr, "At most %d -k options\n", maxScript);
+          return 1;
+        }
+        script[scriptLen].frame = strtoul(optarg, &end, 0);
+        if (*end != ':' || (scriptLen &&
+            script[scriptLen].frame < script[scriptLen-1].frame)) {
+          fprintf(stderr, "-k %s: expected ascending frame:keys\n", optarg);
+          return 1;
+        }
+        script[scriptLen++].keys = end+1;
+        break;
+      case 's':
+        shortFrame = strtoul(optarg, NULL, 0);
+        break;
+      case 'b':
+        battery = strtof(optarg, NULL);
+        break;
+      case 'c':
+        holdFrame = strtoul(optarg, &end, 0);
+        if (*end != ':') {
+          fprintf(stderr, "-c %s: expected frame:frames\n", optarg);
+          return 1;
+        }
+        holdFrames = strtoul(end+1, NULL, 0);
+        break;
+      case 'q':
+        simQuiet = TRUE;
+        break;
+      default:
+        fprintf(stderr,
+    "usage: %s {-n frames} {-k frame:keys} {-s frame} {-b counts}"
+    " {-c frame:frames} {-q}\n",
+          argv[0]);
+        return 1;
+    }
+  }
+  finish();  //note start time
+  return zevMain();
+}
@@ -0,0 +1,41 @@
+/**********************  host/simadc.h  ************************
+*
+*  Simulated ADC, DMA and charger hardware
+*
+***************************************************************/
+
+#ifndef SIMADC_H
+#define SIMADC_H
+
+#include <ch.h>
+
+extern bool_t simQuiet;  //TRUE to discard SD1 output
+
+uint64_t simNanoseconds(void);
+/*
+  simulated time since reset
+*/
+
+void simRestart(void);
+/*
+  restart DMA at the beginning of the ADC driver's sample buffer
+*/
+
+void simAdvance(void);
+/*
+  convert one more row, invoking the ADC driver's callback after
+  the last row of each half buffer
+  exits the simulation after the requested # of frames
+*/
+
+bool_t simSerialHeld(void);
+/*
+  TRUE while serial transmission is held off
+*/
+
+msg_t simKey(void);
+/*
+  returns next scripted key that is now due or Q_TIMEOUT
+*/
+
+#endif /* SIMADC_H */
@@ -0,0 +1,30 @@
+/**********************  host/stm32_tim.h  ************************
+*
+*  Stand-in for the STM32 timer registers used to trigger the ADC
+*
+***************************************************************/
+
+#ifndef _STM32_TIM_H_
+#define _STM32_TIM_H_
+
+#include "hal.h"
+
+typedef struct {
+  uint32_t CR1;
+  uint32_t CR2;
+  uint32_t DIER;
+  uint32_t EGR;
+  uint32_t CNT;
+  uint32_t PSC;
+  uint32_t ARR;
+} stm32_tim_t;
+
+extern stm32_tim_t hostTIM6;
+#define STM32_TIM6  (&hostTIM6)
+
+#define STM32_TIM_CR1_CEN     (1 << 0)
+#define STM32_TIM_CR1_URS     (1 << 2)
+#define STM32_TIM_CR2_MMS(n)  ((n) << 4)
+#define STM32_TIM_EGR_UG      (1 << 0)
+
+#endif /* _STM32_TIM_H_ */
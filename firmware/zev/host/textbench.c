@@ -0,0 +1,135 @@
+/**********************  host/textbench.c  ************************
+*
+*  Compare textLine() with printf style formatting of the same line
+*
+*  Formats pseudo random frames, with every subset of fields, both ways.
+*  Checks that the text is identical, then reports the time and, on x86,
+*  the time stamp counter cycles taken per line by each.
+*
+*  The host's chprintf() is the C library's vsnprintf(), which is far
+*  better optimized than ChibiOS's.  Set textCheck in report.h to
+*  compare with ChibiOS's chprintf() on the target.
+*
+*  usage:  zevtextbench {lines}
+*
+***************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "textline.h"
+
+#define frames  256
+
+static uint32_t random32(void)
+{
+  static uint32_t state = 1;
+  state = state * 1664525 + 1013904223;
+  return state;
+}
+
+static size_t printLine(char *line, const TelemetryFrame *t, unsigned fields)
+/*
+  format the line as report.c did with chprintf()
+*/
+{
+  static const char *const name[] =
+    {"Vcmd", "Vin", "VcmdIn", "Thres", "C", "Vcc/2", "curr", "A"};
+  const uint16_t *adc = t->adc;
+  const uint16_t value[] =
+    {t->dac, adc[1], adc[2], adc[3], adc[0], adc[4], adc[5]};
+  const char *sep = " ";
+  unsigned i;
+  int len = sprintf(line, "#%u:%s:", t->seq,
+                    t->flags & telCharging ? "ON " : "off");
+  for (i = 0; i < 8; i++)
+    if (fields & 1<<i) {
+      if (*sep != ' ' && 1<<i == reportC)
+        sep = ", ";
+      len += sprintf(line+len, "%s%s=", sep, name[i]);
+      if (i < 7)
+        len += sprintf(line+len, "%d", value[i]);
+      else{
+        int32_t mA = t->mA;
+        const char *sign = "";
+        if (mA < 0) {
+          sign = "-";
+          mA = -mA;
+        }
+        len += sprintf(line+len, "%s%d.%03d", sign, mA/1000, mA%1000);
+      }
+      sep = ",";
+    }
+  len += sprintf(line+len, "\r\n");
+  return len;
+}
+
+static uint64_t nanoseconds(void)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+static uint64_t cycles(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+  return __builtin_ia32_rdtsc();
+#else
+  return 0;
+#endif
+}
+
+typedef size_t formatter(char *line, const TelemetryFrame *t, unsigned fields);
+
+static void bench(const char *name, formatter *format,
+                  const TelemetryFrame *t, unsigned long lines)
+{
+  char line[textMaxLine];
+  size_t total = 0;
+  unsigned long i;
+  uint64_t ns = nanoseconds(), tsc = cycles();
+  for (i = 0; i < lines; i++)
+    total += format(line, t + i % frames, reportAllFields);
+  tsc = cycles() - tsc;
+  ns = nanoseconds() - ns;
+  printf("%-10s %6.1f ns/line", name, (double)ns / lines);
+  if (tsc)
+    printf(", %6.1f cycles/line", (double)tsc / lines);
+  printf(", %.1f chars/line\n", (double)total / lines);
+}
+
+
+int main(int argc, char **argv)
+{
+  unsigned long lines = argc > 1 ? strtoul(argv[1], NULL, 0) : 1000000;
+  static TelemetryFrame t[frames];
+  unsigned i, fields, mismatches = 0;
+  for (i = 0; i < frames; i++) {
+    unsigned chan;
+    t[i].seq = i < 8 ? i : random32() >> (i % 32);
+    t[i].time = random32();
+    for (chan = 0; chan < ADCchannels; chan++)
+      t[i].adc[chan] = random32() >> (20 + i % 12);
+    t[i].dac = random32() >> 20;
+    t[i].mA = (int32_t)random32() >> (i % 32);
+    t[i].flags = i & 1 ? telCharging : 0;
+  }
+  t[1].mA = INT32_MIN+1;
+  t[2].mA = -999;
+  for (i = 0; i < frames; i++)
+    for (fields = 0; fields <= reportAllFields; fields++) {
+      char expected[textMaxLine+32], actual[textMaxLine];
+      size_t len = printLine(expected, t+i, fields);
+      if (len != textLine(actual, t+i, fields) || memcmp(expected, actual, len))
+        if (!mismatches++)
+          fprintf(stderr, "Expected: %.*sActual:   %.*s",
+                  (int)len, expected, (int)textLine(actual, t+i, fields), actual);
+    }
+  printf("%u mismatches in %u lines\n", mismatches, frames*(reportAllFields+1));
+  bench("textLine", textLine, t, lines);
+  bench("sprintf", printLine, t, lines);
+  return mismatches != 0;
+}
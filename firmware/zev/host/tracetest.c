@@ -0,0 +1,151 @@
+/**********************  host/tracetest.c  ************************
+*
+*  Check that the flight recorder keeps its events across a warm reset
+*
+*  Records events until the ring wraps, then simulates a watchdog reset
+*  by running traceInit() again without clearing memory, as the startup
+*  code leaves .noinit.  The ring must hold every event recorded before
+*  the reset, followed by the reset itself.  The ring is then saved, as
+*  gdb's flightlog command saves it, and zevflight must decode it into
+*  the expected lines.  Finally, a ring with a corrupt magic word must be
+*  cleared by traceInit().
+*
+*  Stamps advance 320 cycles (10us at 32MHz) per event.
+*
+*  usage:  zevtracetest {zevflight}
+*    zevflight defaults to the one beside zevtracetest
+*  exits with status 1 if any check fails
+*
+***************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "trace.h"
+#include "awd.h"
+
+#define ringFile  "tracetest.bin"
+
+RCC_TypeDef hostRCC = {0x0c000000};  //PORRSTF and PINRSTF
+
+static halrtcnt_t now;
+static unsigned failures;
+
+halrtcnt_t halGetCounterValue(void)
+{
+  return now += 320;
+}
+
+
+static void check(int ok, const char *what)
+{
+  if (!ok) {
+    printf("FAILED:  %s\n", what);
+    failures++;
+  }
+}
+
+static const TraceEvent *event(uint32_t i)
+{
+  return traceRing.event + (i & (traceEvents-1));
+}
+
+
+static void decode(const char *zevflight)
+/*
+  save the ring and check zevflight's listing of it
+*/
+{
+  static const char *const expected[] = {
+    "command \"sta\"",
+    "CHARGER on",
+    "woke thread at priority 64",
+    "tripped by watchdog, column 5",
+    "CHARGER off",
+    "reset IWDG",
+    "70 events recorded, 64 held"
+  };
+  FILE *f = fopen(ringFile, "wb");
+  if (!f || fwrite(&traceRing, sizeof traceRing, 1, f) != 1 || fclose(f)) {
+    perror(ringFile);
+    failures++;
+    return;
+  }
+  char command[256 + sizeof ringFile];
+  snprintf(command, sizeof command, "%s %s", zevflight, ringFile);
+  FILE *listing = popen(command, "r");
+  if (!listing) {
+    perror(zevflight);
+    failures++;
+    return;
+  }
+  char line[128], last[sizeof expected / sizeof *expected][128];
+  unsigned lines = 0, i;
+  while (fgets(line, sizeof line, listing)) {
+    fputs(line, stdout);
+    memmove(last, last+1, sizeof last - sizeof *last);
+    strcpy(last[sizeof expected / sizeof *expected - 1], line);
+    lines++;
+  }
+  check(pclose(listing) == 0, "zevflight exited with an error");
+  check(lines == 1+traceEvents+1, "zevflight listed every event held");
+  for (i = 0; i < sizeof expected / sizeof *expected; i++)
+    if (lines <= i || !strstr(last[i], expected[i])) {
+      printf("FAILED:  expected \"%s\" in the listing\n", expected[i]);
+      failures++;
+    }
+  remove(ringFile);
+}
+
+
+int main(int argc, char **argv)
+{
+  char zevflight[256];
+  if (argc > 1)
+    snprintf(zevflight, sizeof zevflight, "%s", argv[1]);
+  else{
+    const char *slash = strrchr(argv[0], '/');
+    snprintf(zevflight, sizeof zevflight, "%.*szevflight",
+             slash ? (int)(slash+1 - argv[0]) : 0, argv[0]);
+  }
+
+  traceInit();  //power on reset
+  check(traceRing.magic == traceMagic && traceRing.size == traceEvents,
+        "traceInit() initialized the ring");
+  check(traceRing.head == 1 && event(0)->what == (traceReset | 0x0c << 8),
+        "the power on reset was recorded");
+  uint32_t seq;
+  for (seq = 0; seq < 63; seq++)
+    trace(traceFrame, seq);
+  trace(traceCommand, traceName("stats", 5));
+  trace(traceCharger, 1);
+  trace(traceWakeup, 64);
+  trace(traceTrip, awdHardware << 8 | 5);
+  trace(traceCharger, 0);
+  TraceRing before = traceRing;
+
+  hostRCC.CSR = 0x20000000;  //IWDGRSTF
+  traceInit();  //warm reset, leaving .noinit as it was
+  check(traceRing.head == before.head+1, "the ring survived the reset");
+  uint32_t i;
+  for (i = before.head+1 - traceEvents; i != before.head; i++)
+    if (memcmp(event(i), before.event + (i & (traceEvents-1)),
+               sizeof(TraceEvent))) {
+      check(0, "events before the reset were kept");
+      break;
+    }
+  check(event(before.head)->what == (traceReset | 0x20 << 8),
+        "the watchdog reset was recorded last");
+  check(hostRCC.CSR & RCC_CSR_RMVF, "the reset flags were cleared");
+
+  decode(zevflight);
+
+  traceRing.magic = ~traceMagic;
+  traceInit();
+  check(traceRing.magic == traceMagic && traceRing.head == 1,
+        "a corrupt ring was cleared");
+
+  printf("%u failures\n", failures);
+  return failures != 0;
+}
@@ -0,0 +1,121 @@
+/**********************  host/zevflight.c  ************************
+*
+*  Format the flight recorder ring (see trace.h) saved by gdb's flightlog
+*
+*  Events are listed oldest first, each with its number, the CPU cycles
+*  since the previous event and the microseconds since the last reset
+*  recorded (or the oldest event, if none is held).
+*
+*  usage:  zevflight {-f hz} flightlog.bin
+*    -f  CPU clock frequency (default 32000000)
+*
+***************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "trace.h"
+#include "awd.h"
+
+static TraceRing ring;
+
+
+static void describe(char *text, size_t size, uint32_t what)
+{
+  static const char *const resetFlag[8] =
+    {NULL, "OBL", "PIN", "POR", "SFT", "IWDG", "WWDG", "LPWR"};
+  unsigned type = what & 0xff, arg = what >> 8;
+  int len = 0;
+  unsigned bit;
+  switch (type) {
+    case traceReset:
+      len = snprintf(text, size, "reset");
+      for (bit = 1; bit < 8; bit++)  //not RMVF
+        if (arg & 1 << bit)
+          len += snprintf(text+len, size-len, " %s", resetFlag[bit]);
+      break;
+    case traceFrame:
+      snprintf(text, size, "ADC frame #%u done", arg);
+      break;
+    case traceAdcError:
+      snprintf(text, size, "ADC error: %s", arg == ADC_ERR_DMAFAILURE ?
+               "DMA failure" : arg == ADC_ERR_OVERFLOW ? "overflow" : "?");
+      break;
+    case traceWakeup:
+      snprintf(text, size, "woke thread at priority %u", arg);
+      break;
+    case traceCommand: {
+      char cmd[4] = {arg, arg >> 8, arg >> 16, 0};
+      snprintf(text, size, "command \"%s\"", cmd);
+      break;
+    }
+    case traceCharger:
+      snprintf(text, size, "CHARGER %s", arg ? "on" : "off");
+      break;
+    case traceTrip:
+      snprintf(text, size, "tripped by %s, column %u", (arg >> 8) == awdHardware ?
+               "watchdog" : "frame scan", arg & 0xff);
+      break;
+    default:
+      snprintf(text, size, "unknown event %u, arg %06x", type, arg);
+  }
+}
+
+
+int main(int argc, char **argv)
+{
+  double hz = 32000000;
+  int opt;
+  while ((opt = getopt(argc, argv, "f:")) != -1)
+    switch (opt) {
+      case 'f':
+        hz = strtod(optarg, NULL);
+        break;
+      default:
+        hz = 0;
+    }
+  if (hz <= 0 || optind != argc-1) {
+    fprintf(stderr, "usage: %s {-f hz} flightlog.bin\n", argv[0]);
+    return 1;
+  }
+  const char *name = argv[optind];
+  FILE *f = fopen(name, "rb");
+  if (!f) {
+    perror(name);
+    return 2;
+  }
+  size_t got = fread(&ring, 1, sizeof ring, f);
+  fclose(f);
+  if (got < sizeof ring - sizeof ring.event || ring.magic != traceMagic) {
+    fprintf(stderr, "%s: not a flight recorder ring\n", name);
+    return 2;
+  }
+  if (ring.size != traceEvents ||
+      got != sizeof ring - sizeof ring.event + ring.size * sizeof *ring.event) {
+    fprintf(stderr, "%s: holds %u events, expected %u\n",
+            name, ring.size, traceEvents);
+    return 2;
+  }
+
+  uint32_t first = ring.head > traceEvents ? ring.head - traceEvents : 0;
+  uint32_t i, origin = 0, last = 0;
+  printf("     #     cycles        us  event\n");
+  for (i = first; i != ring.head; i++) {
+    const TraceEvent *e = ring.event + (i & (traceEvents-1));
+    if (!e->what)  //never written
+      continue;
+    char text[80];
+    describe(text, sizeof text, e->what);
+    if (i == first || (e->what & 0xff) == traceReset) {
+      origin = e->stamp;
+      printf("%6u %10s %9.3f  %s\n", i, "", 0.0, text);
+    }else
+      printf("%6u %+10d %9.3f  %s\n", i, (int32_t)(e->stamp - last),
+             (uint32_t)(e->stamp - origin) * 1e6 / hz, text);
+    last = e->stamp;
+  }
+  printf("%u events recorded, %u held\n", ring.head,
+         ring.head < traceEvents ? ring.head : traceEvents);
+  return 0;
+}
@@ -0,0 +1,168 @@
+/**********************  host/zevreplay.c  ************************
+*
+*  Replay recorded raw ADC frames through the frame processing pipeline
+*
+*  Frames are processed back to back, as fast as the host allows.
+*  One CSV line is output for each frame:
+*    seq,stamp,rate,depth,C,Vin,VcmdIn,Thres,Vcc/2,curr,current,mA,dac,recdac
+*  where dac is the setting the controller computed during replay and
+*  recdac is the one recorded.  They differ only if the controller
+*  or its configuration has changed since the recording was made.
+*
+*  A summary of the recording and the time spent in each stage of the
+*  pipeline follows on stderr.
+*
+*  usage:  zevreplay {-q} {-p passes} recording
+*    -q  omit the CSV output
+*    -p  replay the recording this many times to profile the pipeline
+*
+***************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "pipeline.h"
+#include "rawframe.h"
+#include "sampling.h"
+
+halrtcnt_t halGetCounterValue(void)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (halrtcnt_t)(now.tv_sec * 1000000000ULL + now.tv_nsec);
+}
+
+static adcsample_t frame[ADCchannels*ADCmaxDepth] __attribute__((aligned(4)));
+
+typedef struct {
+  unsigned records, skipped, gaps, mismatches;
+  double seconds;                  //recorded time
+  uint64_t accum, decim, conv, ctl; //total ns in each pipeline stage
+} ReplayStats;
+
+
+static bool_t nextRecord(const uint8_t *data, size_t len, size_t *cursor,
+                         RawFrameHeader *hdr, ReplayStats *stats)
+/*
+  find the next valid record at or after *cursor
+  copy its header to hdr and its samples to frame
+  advance *cursor beyond it
+  returns FALSE if there are no more
+*/
+{
+  size_t skipped;
+  bool_t found = rawFrameFind(data, len, cursor, hdr, frame, &skipped);
+  if (skipped)
+    stats->skipped++;
+  return found;
+}
+
+
+static void replay(const uint8_t *data, size_t len, bool_t output,
+                   ReplayStats *stats)
+/*
+  replay every valid record in data
+*/
+{
+  RawFrameHeader hdr;
+  unsigned rowRate = 0;
+  uint32_t lastSeq = 0;
+  size_t pos = 0;
+  while (nextRecord(data, len, &pos, &hdr, stats)) {
+    if (!stats->records)
+      pipelineInit(&defaultCharge, rowRate = hdr.rate * hdr.depth);
+    else if (hdr.rate * hdr.depth != rowRate)
+      pipelineRate(rowRate = hdr.rate * hdr.depth);
+    if (stats->records && hdr.seq != lastSeq+1)
+      stats->gaps += hdr.seq - lastSeq - 1;
+    lastSeq = hdr.seq;
+    stats->records++;
+    stats->seconds += 1.0 / hdr.rate;
+
+    pipelineFrame(frame, hdr.depth);
+    uint16_t dac = pipelineControl(hdr.flags & rawCharging);
+    if (dac != hdr.dac)
+      stats->mismatches++;
+    stats->accum += pipeline.accumCycles;
+    stats->decim += pipeline.decimCycles;
+    stats->conv += pipeline.convCycles;
+    stats->ctl += pipeline.ctlCycles;
+    pipeline.ctlCycles = 0;
+
+    if (output) {
+      const uint32_t *adc = pipeline.adc;
+      printf("%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%d,%d,%u,%u\n",
+        hdr.seq, hdr.stamp, hdr.rate, hdr.depth,
+        adc[0], adc[1], adc[2], adc[3], adc[4], adc[5],
+        pipeline.sums.current, q16milli(pipeline.amps), dac, hdr.dac);
+    }
+  }
+}
+
+
+int main(int argc, char **argv)
+{
+  bool_t output = TRUE;
+  unsigned passes = 1;
+  int opt;
+  while ((opt = getopt(argc, argv, "qp:")) != -1)
+    switch (opt) {
+      case 'q':
+        output = FALSE;
+        break;
+      case 'p':
+        passes = strtoul(optarg, NULL, 0);
+        break;
+      default:
+        passes = 0;
+    }
+  if (!passes || optind != argc-1) {
+    fprintf(stderr, "usage: %s {-q} {-p passes} recording\n", argv[0]);
+    return 1;
+  }
+  const char *name = argv[optind];
+  FILE *f = fopen(name, "rb");
+  if (!f) {
+    perror(name);
+    return 2;
+  }
+  fseek(f, 0, SEEK_END);
+  long len = ftell(f);
+  rewind(f);
+  uint8_t *data = malloc(len > 0 ? len : 1);
+  if (!data || fread(data, 1, len, f) != (size_t)len) {
+    perror(name);
+    return 2;
+  }
+  fclose(f);
+
+  ReplayStats stats;
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  unsigned pass;
+  for (pass = 0; pass < passes; pass++) {
+    memset(&stats, 0, sizeof stats);
+    replay(data, len, output && !pass, &stats);
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  double wall = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec)*1e-9;
+
+  fprintf(stderr,
+    "%u frames (%.2f s recorded), %u dropped, %u spans skipped, %u DAC mismatches\n",
+    stats.records, stats.seconds, stats.gaps, stats.skipped, stats.mismatches);
+  if (stats.records) {
+    unsigned frames = stats.records * passes;
+    fprintf(stderr,
+      "%u frames replayed in %.3f s (%.0f frames/s, %.0fx real time)\n",
+      frames, wall, frames/wall, stats.seconds*passes/wall);
+    fprintf(stderr,
+      "ns/frame: accum=%.0f, decim=%.0f, Amps=%.0f, ctl=%.0f\n",
+      (double)stats.accum/stats.records, (double)stats.decim/stats.records,
+      (double)stats.conv/stats.records, (double)stats.ctl/stats.records);
+  }
+  free(data);
+  return 0;
+}
@@ -0,0 +1,131 @@
+/**********************  host/zevscope.c  ************************
+*
+*  Split a scope mode capture (see report.h) into per channel sample files
+*
+*  Each channel's samples are written, one per line, to prefix-name.txt
+*  where name is C, Vin, VcmdIn, Thres, Vcc2 or curr, in conversion order.
+*  The frames of a capture must all have the same depth and rate.
+*
+*  A summary follows on stderr:  the frames captured, those dropped
+*  (gaps in their sequence numbers), the times the sequence restarted
+*  (as where a fault capture was downloaded), the spans of corrupt data skipped
+*  (including frames torn by the ADC, the signon text and command replies),
+*  the sustained throughput over the time captured and the fraction of
+*  the link's bit rate it used.
+*
+*  usage:  zevscope {-o prefix} {-b bitrate} capture
+*    -o  output file prefix (default "scope")
+*    -b  serial bit rate for utilisation (default 2000000)
+*
+***************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "rawframe.h"
+#include "sampling.h"
+
+static adcsample_t frame[ADCchannels*ADCmaxDepth] __attribute__((aligned(4)));
+
+static const char *const channelName[ADCchannels] =
+  {"C", "Vin", "VcmdIn", "Thres", "Vcc2", "curr"};
+
+
+int main(int argc, char **argv)
+{
+  const char *prefix = "scope";
+  unsigned long bitrate = 2000000;
+  int opt;
+  while ((opt = getopt(argc, argv, "o:b:")) != -1)
+    switch (opt) {
+      case 'o':
+        prefix = optarg;
+        break;
+      case 'b':
+        bitrate = strtoul(optarg, NULL, 0);
+        break;
+      default:
+        bitrate = 0;
+    }
+  if (!bitrate || optind != argc-1) {
+    fprintf(stderr, "usage: %s {-o prefix} {-b bitrate} capture\n", argv[0]);
+    return 1;
+  }
+  const char *name = argv[optind];
+  FILE *f = fopen(name, "rb");
+  if (!f) {
+    perror(name);
+    return 2;
+  }
+  fseek(f, 0, SEEK_END);
+  long len = ftell(f);
+  rewind(f);
+  uint8_t *data = malloc(len > 0 ? len : 1);
+  if (!data || fread(data, 1, len, f) != (size_t)len) {
+    perror(name);
+    return 2;
+  }
+  fclose(f);
+
+  FILE *out[ADCchannels];
+  unsigned chan;
+  for (chan = 0; chan < ADCchannels; chan++) {
+    char fileName[256];
+    snprintf(fileName, sizeof fileName, "%s-%s.txt", prefix, channelName[chan]);
+    if (!(out[chan] = fopen(fileName, "w"))) {
+      perror(fileName);
+      return 2;
+    }
+  }
+
+  RawFrameHeader hdr;
+  unsigned records = 0, dropped = 0, restarts = 0, skipped = 0, changes = 0;
+  unsigned rate = 0, depth = 0;
+  unsigned long long bytes = 0, samples = 0;
+  uint32_t lastSeq = 0;
+  double seconds = 0;  //time spanned by frames captured and dropped
+  size_t pos = 0, skip;
+  for (;;) {
+    bool_t found = rawFrameFind(data, len, &pos, &hdr, frame, &skip);
+    if (skip)
+      skipped++;
+    if (!found)
+      break;
+    if (records && (hdr.rate != rate || hdr.depth != depth))
+      changes++;
+    if (!records || (int32_t)(hdr.seq - lastSeq) <= 0) {
+      if (records)
+        restarts++;
+      seconds += 1.0 / hdr.rate;
+    }else{
+      dropped += hdr.seq - lastSeq - 1;
+      seconds += (double)(hdr.seq - lastSeq) / hdr.rate;
+    }
+    rate = hdr.rate;
+    depth = hdr.depth;
+    lastSeq = hdr.seq;
+    records++;
+    bytes += sizeof hdr + depth * ADCchannels * sizeof(adcsample_t);
+    samples += depth * ADCchannels;
+    const adcsample_t *row = frame;
+    unsigned i;
+    for (i = 0; i < depth; i++, row += ADCchannels)
+      for (chan = 0; chan < ADCchannels; chan++)
+        fprintf(out[chan], "%u\n", row[chan]);
+  }
+  for (chan = 0; chan < ADCchannels; chan++)
+    fclose(out[chan]);
+  free(data);
+
+  fprintf(stderr, "%u frames (%u rows of %u at %u/s), %u dropped, %u restarts, "
+                  "%u spans skipped, %u profile changes\n",
+          records, depth, ADCchannels, rate, dropped, restarts, skipped, changes);
+  if (seconds > 0) {
+    double bps = bytes / seconds;
+    fprintf(stderr, "%.0f samples/s, %.0f bytes/s sustained over %.2f s, "
+                    "%.1f%% of %lu bps\n",
+            samples / seconds, bps, seconds, 100 * bps * 10 / bitrate, bitrate);
+  }
+  return 0;
+}
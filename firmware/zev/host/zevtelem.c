@@ -0,0 +1,94 @@
+/**********************  host/zevtelem.c  ************************
+*
+*  Decode binary telemetry (see telemetry.h) to CSV
+*
+*  Reads the serial port capture from the named file or stdin.
+*  Outputs one line per valid frame record:
+*    seq,ms,C,Vin,VcmdIn,Thres,Vcc/2,curr,Vcmd,dropped,mA,charging,mode
+*  Sequence numbers and times are unwrapped to 32 bits.
+*  Command replies are copied to stderr.
+*
+*  A summary follows on stderr.  Text preceding the first record
+*  (e.g. the signon message) is counted as a bad packet.
+*
+*  usage:  zevtelem {capture}
+*
+***************************************************************/
+
+#include <stdio.h>
+
+#include "telemetry.h"
+
+#define maxPacket  256
+
+static uint32_t unwrap(uint32_t last, uint16_t x)
+/*
+  return x extended to 32 bits nearest after last
+*/
+{
+  return last + (uint16_t)(x - (uint16_t)last);
+}
+
+int main(int argc, char **argv)
+{
+  FILE *in = stdin;
+  if (argc > 2) {
+    fprintf(stderr, "usage: %s {capture}\n", argv[0]);
+    return 1;
+  }
+  if (argc == 2 && !(in = fopen(argv[1], "rb"))) {
+    perror(argv[1]);
+    return 2;
+  }
+  uint8_t packet[maxPacket], payload[maxPacket];
+  size_t len = 0;
+  unsigned long bytes = 0, records = 0, bad = 0, other = 0, gaps = 0;
+  uint32_t seq = 0, ticks = 0;
+  int c;
+  puts("seq,ms,C,Vin,VcmdIn,Thres,Vcc/2,curr,Vcmd,dropped,mA,charging,mode");
+  while ((c = getc(in)) != EOF) {
+    bytes++;
+    if (c) {
+      if (len < maxPacket)
+        packet[len] = c;
+      len++;
+      continue;
+    }
+    if (!len)  //consecutive zeros delimit nothing
+      continue;
+    TelemetryFrame t;
+    size_t n = len <= maxPacket ? cobsUnpack(payload, packet, len) : 0;
+    len = 0;
+    if (!n) {
+      bad++;
+      continue;
+    }
+    if (!telemetryParse(&t, payload, n)) {
+      if (payload[0] >> 4 == telemetryReplyType)  //command reply
+        fprintf(stderr, "%.*s\n", (int)n-1, (const char *)payload+1);
+      else
+        other++;
+      continue;
+    }
+    if (records) {
+      uint32_t next = unwrap(seq, t.seq);
+      gaps += next - seq - 1;
+      seq = next;
+      ticks = unwrap(ticks, t.time);
+    }else{
+      seq = t.seq;
+      ticks = t.time;
+    }
+    records++;
+    printf("%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%d,%d,%s\n",
+      seq, ticks * (1000 / CH_FREQUENCY),
+      t.adc[0], t.adc[1], t.adc[2], t.adc[3], t.adc[4], t.adc[5],
+      t.dac, t.dropped, t.mA, t.flags & telCharging ? 1 : 0,
+      t.flags & telCV ? "CV" : "CC");
+  }
+  fprintf(stderr,
+    "%lu frame records, %lu other, %lu bad packets, %lu missing frames, "
+    "%.1f bytes/record\n",
+    records, other, bad, gaps, records ? (double)bytes/records : 0.0);
+  return 0;
+}
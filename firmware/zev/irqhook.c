@@ -0,0 +1,37 @@
+/**********************  irqhook.c  ************************
+*
+*  Hook interrupt handlers in front of those installed by ChibiOS
+*
+*  VTOR requires the table be aligned to the next power of two above
+*  its size.  The STM32L152xB has 16 system + 45 peripheral vectors.
+*
+***************************************************************/
+
+#include "irqhook.h"
+
+#define vectorCount 64
+
+static irqHandler ramVectors[vectorCount] __attribute__((aligned(4*vectorCount)));
+
+irqHandler irqHook(IRQn_Type irq, irqHandler handler)
+/*
+  install handler for irq
+  returns the handler it replaced
+*/
+{
+  chSysLock();
+  if (SCB->VTOR != (uintptr_t)ramVectors) {
+    /* VTOR is 0 when flash is aliased there at boot */
+    const irqHandler *rom = (const irqHandler *)
+                              (SCB->VTOR ? SCB->VTOR : FLASH_BASE);
+    unsigned i;
+    for (i = 0; i < vectorCount; i++)
+      ramVectors[i] = rom[i];
+    SCB->VTOR = (uintptr_t)ramVectors;
+    __DSB();
+  }
+  irqHandler replaced = ramVectors[16+irq];
+  ramVectors[16+irq] = handler;
+  chSysUnlock();
+  return replaced;
+}
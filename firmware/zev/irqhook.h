@@ -0,0 +1,33 @@
+/**********************  irqhook.h  ************************
+*
+*  Hook interrupt handlers in front of those installed by ChibiOS
+*
+*  The first hook copies the vector table to RAM and points VTOR at it.
+*  A hook may chain to the handler it replaced.  Hooked handlers must
+*  run at the same priority and follow the same rules as the handlers
+*  they replace.
+*
+*  A hook may do work after the handler it chains to returns, but must
+*  not call the kernel.  ChibiOS handlers end with CH_IRQ_EPILOGUE().
+*  In the ARMv7-M port, that raises BASEPRI and, if a context switch is
+*  due, pushes an exit frame on the thread's stack (PSP) for the
+*  exception return to unstack.  The handler's own stack (MSP) is left
+*  as it was, so the hook may still read the cycle counter and store
+*  its results, but the kernel is locked until the exception returns.
+*
+***************************************************************/
+
+#ifndef IRQHOOK_H
+#define IRQHOOK_H
+
+#include <hal.h>
+
+typedef void (*irqHandler)(void);
+
+irqHandler irqHook(IRQn_Type irq, irqHandler handler);
+/*
+  install handler for irq
+  returns the handler it replaced
+*/
+
+#endif /* IRQHOOK_H */
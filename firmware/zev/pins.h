@@ -0,0 +1,31 @@
+/**********************  pins.h  ************************
+*
+*  ZEV charger controller I/O pin assignments
+*
+***************************************************************/
+
+#ifndef PINS_H
+#define PINS_H
+
+#include <hal.h>
+
+#define clearPad(...) palClearPad(__VA_ARGS__)
+#define setPad(...) palSetPad(__VA_ARGS__)
+#define togglePad(...) palTogglePad(__VA_ARGS__)
+#define configurePad(...)  palSetPadMode(__VA_ARGS__)
+#define configureGroup(...)  palSetGroupMode(__VA_ARGS__)
+#define padLatched(...) latchedPad(__VA_ARGS__)
+#define latchedPad(port, pad)  ((palReadLatch(port) >> (pad)) & 1)
+
+/*  Discrete Digital Outputs  */
+#define GREEN_LED   GPIOB,GPIOB_LED3
+#define BLUE_LED    GPIOB,GPIOB_LED4
+#define BUZZER      GPIOC,9
+#define CHARGER     GPIOC,8
+
+/* Only PA4 and PA5 can be used for analog output
+    PA4 = Charger voltage set point
+*/
+#define ANALOGOUTS    GPIOA, 0x1, 4
+
+#endif /* PINS_H */
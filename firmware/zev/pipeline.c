@@ -0,0 +1,93 @@
+/**********************  pipeline.c  ************************
+*
+*  Per frame processing of raw ADC samples
+*
+*  The decimator's sinks take no context, so there is a single pipeline.
+*
+***************************************************************/
+
+#include "pipeline.h"
+
+Pipeline pipeline;
+
+
+static void fastSample(const DecimatedSample *sample)
+{
+  int32_t current = sample->current;
+  if (current < 0)
+    current = -current;
+  if (current > pipeline.fastPeak)
+    pipeline.fastPeak = current;
+}
+
+static void slowSample(const DecimatedSample *sample)
+{
+  pipeline.slowest = *sample;
+}
+
+
+void pipelineRate(unsigned rowRate)
+/*
+  reset the decimator for a new row rate
+*/
+{
+  decimatorInit(&pipeline.decimator, rowRate, fastSample, slowSample);
+  pipeline.fastPeak = 0;
+}
+
+void pipelineInit(const ChargeConfig *cfg, unsigned rowRate)
+/*
+  reset the charge controller and decimator
+  for frames arriving at rowRate rows per second
+*/
+{
+  chargeInit(&pipeline.charger, cfg);
+  pipelineRate(rowRate);
+}
+
+
+void pipelineFrame(const adcsample_t *samples, size_t depth)
+/*
+  process a frame of depth rows of ADCchannels interleaved samples
+*/
+{
+  Pipeline *p = &pipeline;
+  halrtcnt_t start = halGetCounterValue();
+  accumulateChannels(&p->sums, samples, depth);
+  halrtcnt_t end = halGetCounterValue();
+  p->accumCycles = end - start;
+
+  start = end;
+  decimate(&p->decimator, samples, depth);
+  end = halGetCounterValue();
+  p->decimCycles = end - start;
+
+  unsigned chan;
+  for(chan=0; chan < ADCchannels; chan++)
+    p->adc[chan] = p->sums.sum[chan] / depth;  //avg just for display for now
+  p->depth = depth;
+
+  /* average the current represented by the last channel to best filter VCC noise */
+  start = halGetCounterValue();
+  p->amps = ampsQ16(p->sums.current, depth, p->adc[4], p->adc[0]);
+  p->convCycles = halGetCounterValue() - start;
+}
+
+
+uint16_t pipelineControl(bool_t charging)
+/*
+  run the charge controller on the last frame if charging,
+  otherwise reset it to its minimum output
+  returns the DAC setting
+*/
+{
+  ChargeController *c = &pipeline.charger;
+  if (charging) {
+    halrtcnt_t start = halGetCounterValue();
+    uint16_t dac = chargeUpdate(c, pipeline.amps, voltsQ16(pipeline.adc[1]));
+    pipeline.ctlCycles = halGetCounterValue() - start;
+    return dac;
+  }
+  chargeReset(c);  //start from minimum output when next turned on
+  return c->cfg.dacMin;
+}
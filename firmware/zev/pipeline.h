@@ -0,0 +1,61 @@
+/**********************  pipeline.h  ************************
+*
+*  Per frame processing of raw ADC samples
+*
+*  Each frame's rows are accumulated, decimated into the fast and slow
+*  filtered streams and converted to Amps.  The charge controller then
+*  computes the next charger setpoint from the result.
+*
+*  The same code processes frames live from the ADC and replays frames
+*  recorded from it (see rawframe.h).
+*
+***************************************************************/
+
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include "accum.h"
+#include "decimate.h"
+#include "charge.h"
+
+typedef struct {
+  ChannelSums sums;            //of the last frame's rows
+  uint32_t adc[ADCchannels];   //last frame's averaged channels
+  size_t   depth;              //# of rows in last frame
+  q16      amps;               //last frame's current
+  Decimator decimator;         //fast and slow filtered streams
+  DecimatedSample slowest;     //latest slow stream output
+  int32_t  fastPeak;           //largest fast stream |current| since cleared
+  ChargeController charger;    //charger voltage setpoint via DAC on PA4
+  halrtcnt_t accumCycles;      //CPU cycles for last channel accumulation
+  halrtcnt_t decimCycles;      //CPU cycles to decimate last frame
+  halrtcnt_t convCycles;       //CPU cycles for last fixed point conversion
+  halrtcnt_t ctlCycles;        //CPU cycles for last charge controller update
+} Pipeline;
+
+extern Pipeline pipeline;
+
+void pipelineInit(const ChargeConfig *cfg, unsigned rowRate);
+/*
+  reset the charge controller and decimator
+  for frames arriving at rowRate rows per second
+*/
+
+void pipelineRate(unsigned rowRate);
+/*
+  reset the decimator for a new row rate
+*/
+
+void pipelineFrame(const adcsample_t *samples, size_t depth);
+/*
+  process a frame of depth rows of ADCchannels interleaved samples
+*/
+
+uint16_t pipelineControl(bool_t charging);
+/*
+  run the charge controller on the last frame if charging,
+  otherwise reset it to its minimum output
+  returns the DAC setting
+*/
+
+#endif /* PIPELINE_H */
@@ -0,0 +1,93 @@
+/**********************  rawframe.c  ************************
+*
+*  Recording of raw ADC frames
+*
+*  The checksum is a Fletcher style sum of the samples, so that
+*  transposed samples and bytes dropped by the serial link are detected.
+*
+***************************************************************/
+
+#include <string.h>
+
+#include "rawframe.h"
+#include "accum.h"
+#include "sampling.h"
+
+uint32_t rawFrameSum(const adcsample_t *samples, size_t count)
+/*
+  return checksum of count samples
+*/
+{
+  uint32_t a = 0, b = 0;
+  while (count--) {
+    a += *samples++;
+    b += a;
+  }
+  return (b << 16) ^ a;
+}
+
+
+void rawFrameHeader(RawFrameHeader *hdr, const AnalogFrame *frame,
+                    unsigned rate, uint16_t dac, unsigned flags)
+/*
+  fill in the header of a record of frame, except for its check
+*/
+{
+  hdr->magic = rawFrameMagic;
+  hdr->seq = frame->seq;
+  hdr->stamp = frame->stamp;
+  hdr->rate = rate;
+  hdr->depth = frame->depth;
+  hdr->channels = ADCchannels;
+  hdr->flags = flags;
+  hdr->dac = dac;
+}
+
+
+void rawFrameWrite(BaseSequentialStream *out, const AnalogFrame *frame,
+                   unsigned rate, uint16_t dac, unsigned flags)
+/*
+  write a record of the frame's samples to out
+*/
+{
+  size_t count = frame->depth * ADCchannels;
+  RawFrameHeader hdr;
+  rawFrameHeader(&hdr, frame, rate, dac, flags);
+  hdr.check = rawFrameSum(frame->samples, count);
+  chSequentialStreamWrite(out, (const uint8_t *)&hdr, sizeof hdr);
+  chSequentialStreamWrite(out, (const uint8_t *)frame->samples,
+                          count * sizeof(adcsample_t));
+}
+
+
+bool_t rawFrameFind(const uint8_t *data, size_t len, size_t *cursor,
+                    RawFrameHeader *hdr, adcsample_t *samples, size_t *skipped)
+/*
+  find the next valid record in data at or after *cursor
+  copy its header to hdr and its samples to samples,
+  which must hold ADCchannels*ADCmaxDepth samples
+  advance *cursor beyond it and set *skipped to the # of bytes passed over
+  returns FALSE if there are no more
+*/
+{
+  size_t pos;
+  for (pos = *cursor; pos + sizeof *hdr <= len; pos++) {
+    memcpy(hdr, data+pos, sizeof *hdr);
+    if (hdr->magic == rawFrameMagic) {
+      size_t bytes = hdr->depth * ADCchannels * sizeof(adcsample_t);
+      if (hdr->channels == ADCchannels && hdr->rate &&
+          hdr->depth && hdr->depth <= ADCmaxDepth &&
+          pos + sizeof *hdr + bytes <= len) {
+        memcpy(samples, data + pos + sizeof *hdr, bytes);
+        if (rawFrameSum(samples, bytes / sizeof(adcsample_t)) == hdr->check) {
+          *skipped = pos - *cursor;
+          *cursor = pos + sizeof *hdr + bytes;
+          return TRUE;
+        }
+      }
+    }
+  }
+  *skipped = len > *cursor ? len - *cursor : 0;
+  *cursor = len;
+  return FALSE;
+}
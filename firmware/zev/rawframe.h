@@ -0,0 +1,64 @@
+/**********************  rawframe.h  ************************
+*
+*  Recording of raw ADC frames
+*
+*  Each record is a RawFrameHeader followed by the frame's depth rows of
+*  channels interleaved samples, exactly as the DMA stored them.
+*  All fields are little endian.  Records may be separated by other output,
+*  so readers should search for the magic number and verify the checksum.
+*
+*  Sequence numbers are those of the frame queue, so gaps in a recording
+*  are frames that were dropped, either before or while recording.
+*
+***************************************************************/
+
+#ifndef RAWFRAME_H
+#define RAWFRAME_H
+
+#include "frameq.h"
+
+#define rawFrameMagic  0x5256455a  /* "ZEVR" */
+
+#define rawCharging    1  /* flags bit set if CHARGER was on */
+#define rawTrigger     2  /* flags bit set if a fault capture triggered */
+
+typedef struct {
+  uint32_t magic;     //rawFrameMagic
+  uint32_t seq;       //frame sequence number
+  uint32_t stamp;     //CPU cycle counter when the frame completed
+  uint16_t rate;      //sampling profile's frames per second
+  uint16_t depth;     //# of rows that follow
+  uint8_t  channels;  //# of samples in each row
+  uint8_t  flags;     //rawCharging, rawTrigger
+  uint16_t dac;       //DAC setting computed from this frame
+  uint32_t check;     //rawFrameSum() of the samples
+} RawFrameHeader;
+
+uint32_t rawFrameSum(const adcsample_t *samples, size_t count);
+/*
+  return checksum of count samples
+*/
+
+void rawFrameHeader(RawFrameHeader *hdr, const AnalogFrame *frame,
+                    unsigned rate, uint16_t dac, unsigned flags);
+/*
+  fill in the header of a record of frame, except for its check
+*/
+
+void rawFrameWrite(BaseSequentialStream *out, const AnalogFrame *frame,
+                   unsigned rate, uint16_t dac, unsigned flags);
+/*
+  write a record of the frame's samples to out
+*/
+
+bool_t rawFrameFind(const uint8_t *data, size_t len, size_t *cursor,
+                    RawFrameHeader *hdr, adcsample_t *samples, size_t *skipped);
+/*
+  find the next valid record in data at or after *cursor
+  copy its header to hdr and its samples to samples,
+  which must hold ADCchannels*ADCmaxDepth samples
+  advance *cursor beyond it and set *skipped to the # of bytes passed over
+  returns FALSE if there are no more
+*/
+
+#endif /* RAWFRAME_H */
@@ -0,0 +1,487 @@
+/**********************  report.c  ************************
+*
+*  Report processed frames on SD1 from a lower priority thread
+*
+*  The snapshot queue has a single producer and consumer, like frameq.c.
+*  Raw sample copies are used in the same order as queue entries,
+*  so queue entry i uses copy i % reportRawSlots.
+*
+*  Switching to and from raw frame records changes SD1's bit rate,
+*  so the reporter thread makes mode changes between reports,
+*  after any DMA transmission has finished.
+*
+*  Scope mode snapshots point at the ADC's buffer rather than a copy.
+*  Their checksums are computed when they are queued, while the samples
+*  are known to be intact.
+*
+*  Each snapshot notes the sinks subscribed to it when it was queued,
+*  so changing subscriptions never affects snapshots already queued.
+*
+*  A single command reply may be pending.  It is sent before the next
+*  snapshot, then any fault capture requested.
+*
+***************************************************************/
+
+#include <string.h>
+#include <chprintf.h>
+#include <memstreams.h>
+
+#include "report.h"
+#include "rawframe.h"
+#include "sampling.h"
+#include "uartdma.h"
+#include "debugput.h"
+#include "command.h"
+#include "trace.h"
+#include "fault.h"
+
+/*
+ * Nonzero to send binary telemetry by DMA rather than through SD1's queue
+ */
+#define telemetryDMA 1
+
+#define replyMax  (commandMaxLine + commandMaxReply)
+
+#if telemetryDMA && (telemetryMaxPacket > uartdmaBufSize || \
+                     telemetryReplySize(replyMax) > uartdmaBufSize)
+#error  telemetry records must fit in a uartdma buffer
+#endif
+
+#define reportQmask  (reportQsize-1)
+
+#if reportQsize & reportQmask
+#error  reportQsize must be a power of two
+#endif
+
+/*
+ * Raw frame records are sent at a bit rate fast enough for any sampling profile
+ */
+#define recordBitrate  460800
+static const SerialConfig recordSerial = {recordBitrate, 0, 0, 0};
+
+/*
+ * Scope mode's bit rate is PCLK2/16, the fastest USART1 can generate
+ * exactly with 16x oversampling.  Hardware flow control holds off
+ * transmission without losing bytes while the host is not reading.
+ */
+#define scopeBitrate  (STM32_PCLK2/16)
+static const SerialConfig scopeSerial =
+  {scopeBitrate, 0, 0, USART_CR3_CTSE | USART_CR3_RTSE};
+
+#if 1+telemetryReplySize(replyMax) > uartdmaBufSize
+#error  scope mode replies must fit in a uartdma buffer
+#endif
+typedef struct {
+  TelemetryFrame t;
+  uint16_t rate;    //sampling profile's frames/second
+  uint16_t dac;     //DAC setting computed from frame
+  uint8_t fields[reportSinks];  //fields to report to each sink, if any
+  uint32_t check;   //rawFrameSum() of raw samples when queued
+  AnalogFrame raw;  //raw samples are NULL unless recording
+} Snapshot;
+
+static Snapshot queue[reportQsize];
+static volatile uint32_t head, tail;
+static Thread *waiting;  //reporter awaiting next snapshot
+
+static adcsample_t rawCopy[reportRawSlots][ADCchannels*ADCmaxDepth]
+                                             __attribute__((aligned(4)));
+
+static volatile unsigned requested = reportText;  //mode for next snapshot
+static unsigned mode = reportText;                //mode of SD1 now
+
+static char replyText[replyMax];
+static volatile size_t replyLen;  //nonzero while a reply is pending
+static volatile bool_t capturing; //fault capture download requested
+
+ReportStats reportStats;
+
+static Subscription subscription[reportSinks] = {
+  {reportAllFields, 1},   //every frame on SD1
+  {reportAllFields, 10}   //every 10th to the debugger
+};
+
+static WORKING_AREA(reporterArea, 256);
+
+
+static void setMode(unsigned newMode)
+{
+  static const char *const modeName[] =
+    {"text", "telemetry", "raw frames", "scope frames"};
+  static const SerialConfig *const config[] =
+    {NULL, NULL, &recordSerial, &scopeSerial};
+  while (uartdmaFree() < 2)  //let DMA finish before reconfiguring
+    chThdSleepMilliseconds(1);
+  if (config[newMode] != config[mode]) {
+    sdStop(&SD1);
+    sdStart(&SD1, config[newMode]);
+  }
+  mode = newMode;
+  debugPrint("Reporting %s at %d bps", modeName[mode],
+    config[mode] ? config[mode]->sc_speed : SERIAL_DEFAULT_BITRATE);
+}
+
+
+#if textCheck
+static void printLine(BaseSequentialStream *out, const TelemetryFrame *t,
+                      unsigned fields)
+/*
+  output the selected fields of the text line with chprintf()
+*/
+{
+  static const char *const name[] =
+    {"Vcmd", "Vin", "VcmdIn", "Thres", "C", "Vcc/2", "curr", "A"};
+  const uint16_t *adc = t->adc;
+  const uint16_t value[] =
+    {t->dac, adc[1], adc[2], adc[3], adc[0], adc[4], adc[5]};
+  const char *sep = " ";
+  unsigned i;
+  chprintf(out, "#%d:%s:", t->seq, t->flags & telCharging ? "ON " : "off");
+  for (i = 0; i < 8; i++)
+    if (fields & 1<<i) {
+      if (*sep != ' ' && 1<<i == reportC)
+        sep = ", ";
+      chprintf(out, "%s%s=", sep, name[i]);
+      if (i < 7)
+        chprintf(out, "%d", value[i]);
+      else{
+        int32_t mA = t->mA;
+        const char *sign = "";
+        if (mA < 0) {
+          sign = "-";
+          mA = -mA;
+        }
+        chprintf(out, "%s%d.%03d", sign, mA/1000, mA%1000);
+      }
+      sep = ",";
+    }
+  chprintf(out, "\r\n");
+}
+#endif
+
+static void sendText(const TelemetryFrame *t, unsigned fields)
+{
+  char line[textMaxLine];
+  halrtcnt_t start = halGetCounterValue();
+  size_t len = textLine(line, t, fields);
+  reportStats.textCycles = halGetCounterValue() - start;
+#if textCheck
+  {
+    static uint8_t buf[textMaxLine];
+    MemoryStream ms;
+    msObjectInit(&ms, buf, sizeof buf, 0);
+    start = halGetCounterValue();
+    printLine((BaseSequentialStream *)&ms, t, fields);
+    reportStats.printfCycles = halGetCounterValue() - start;
+    if (ms.eos != len || memcmp(buf, line, len))
+      reportStats.textMismatches++;
+  }
+#endif
+  sdWrite(&SD1, (const uint8_t *)line, len);
+}
+
+
+static void sendDebug(const TelemetryFrame *t, unsigned fields)
+{
+  char line[textMaxLine];
+  debugPut((const uint8_t *)line, textDebugLine(line, t, fields));
+}
+
+static void sendReply(void)
+{
+  if (mode == reportText) {
+    sdWrite(&SD1, (const uint8_t *)replyText, replyLen);
+    sdWrite(&SD1, (const uint8_t *)"\r\n", 2);
+  }else{
+    static uint8_t packet[telemetryReplySize(replyMax)];
+    size_t len = telemetryReply(packet, replyText, replyLen);
+    if (mode == reportScope) {  //delimited from the records by a zero
+      while (!uartdmaFree())
+        chThdSleepMilliseconds(1);
+      uint8_t *buf = uartdmaClaim();
+      *buf = 0;
+      memcpy(buf+1, packet, len);
+      uartdmaSend(len+1);
+    }else
+#if telemetryDMA
+    if (mode == reportTelemetry) {
+      while (!uartdmaFree())  //replies are rare, so wait for a buffer
+        chThdSleepMilliseconds(1);
+      uint8_t *buf = uartdmaClaim();
+      memcpy(buf, packet, len);
+      uartdmaSend(len);
+    }else
+#endif
+    {
+      if (mode == reportRecord)  //delimit packet from the raw frame record
+        sdWrite(&SD1, (const uint8_t *)"", 1);
+      sdWrite(&SD1, packet, len);
+    }
+  }
+  replyLen = 0;
+}
+
+static void sendScope(const Snapshot *s)
+/*
+  send a scope mode record, its samples in place
+  drop it unless both DMA buffers are free
+*/
+{
+  RawFrameHeader *hdr;
+  if (uartdmaFree() < 2 || !(hdr = (RawFrameHeader *)uartdmaClaim())) {
+    reportStats.unsent++;
+    return;
+  }
+  rawFrameHeader(hdr, &s->raw, s->rate, s->dac,
+                 s->t.flags & telCharging ? rawCharging : 0);
+  hdr->check = s->check;
+  uartdmaSend(sizeof *hdr);
+  uartdmaSendFrom(s->raw.samples,
+                  s->raw.depth * ADCchannels * sizeof(adcsample_t));
+}
+
+static void sendCapture(void)
+/*
+  write the frames of the frozen fault capture ring to SD1
+*/
+{
+  FaultCapture cap;
+  faultLastCapture(&cap);
+  while (uartdmaFree() < 2)  //don't interleave with DMA
+    chThdSleepMilliseconds(1);
+  AnalogFrame frame;
+  uint16_t dac;
+  bool_t charging;
+  unsigned i;
+  for (i = 0; faultFrame(i, &frame, &dac, &charging); i++)
+    rawFrameWrite((BaseSequentialStream *)&SD1, &frame, cap.rate, dac,
+                  (charging ? rawCharging : 0) |
+                  (frame.seq == cap.seq ? rawTrigger : 0));
+  capturing = FALSE;
+}
+
+static void sendTelemetry(const TelemetryFrame *t)
+{
+#if telemetryDMA
+  uint8_t *packet = uartdmaClaim();
+  if (packet)  //otherwise dropped while both buffers are busy
+    uartdmaSend(telemetryPacket(packet, t));
+#else
+  uint8_t packet[telemetryMaxPacket];
+  sdWrite(&SD1, packet, telemetryPacket(packet, t));
+#endif
+}
+
+
+/*
+ * This thread sends queued snapshots
+ */
+__attribute__((noreturn))
+static msg_t reporter(void *arg)
+{
+  (void)arg;
+  chRegSetThreadName("reporter");
+  while (TRUE) {
+    chSysLock();
+    while (head == tail && !replyLen && !capturing) {
+      waiting = chThdSelf();
+      chSchGoSleepS(THD_STATE_SUSPENDED);
+    }
+    chSysUnlock();
+    if (requested != mode)
+      setMode(requested);
+    if (replyLen)
+      sendReply();
+    if (capturing)
+      sendCapture();
+    if (head == tail)
+      continue;
+    const Snapshot *s = queue + (tail & reportQmask);
+    if (s->fields[reportDebug])
+      sendDebug(&s->t, s->fields[reportDebug]);
+    if (s->fields[reportSerial])
+      switch (mode) {
+        case reportText:
+          sendText(&s->t, s->fields[reportSerial]);
+          break;
+        case reportTelemetry:
+          sendTelemetry(&s->t);
+          break;
+        case reportRecord:
+          if (s->raw.samples)
+            rawFrameWrite((BaseSequentialStream *)&SD1, &s->raw, s->rate,
+                          s->dac, s->t.flags & telCharging ? rawCharging : 0);
+          break;
+        case reportScope:
+          if (s->raw.samples)
+            sendScope(s);
+      }
+    tail++;
+  }
+}
+
+
+Thread *reportInit(tprio_t prio)
+/*
+  start reporter thread at the given priority
+  returns the thread
+*/
+{
+  head = tail = 0;
+  waiting = NULL;
+  capturing = FALSE;
+  return chThdCreateStatic(reporterArea, sizeof(reporterArea),
+                           prio, reporter, NULL);
+}
+
+
+void reportMode(unsigned newMode)
+/*
+  report subsequent frames in mode, or as text if already in that mode
+*/
+{
+  requested = newMode == requested ? reportText : newMode;
+}
+
+
+bool_t reportSubscribe(unsigned sink, unsigned fields, unsigned every)
+/*
+  report the given fields of every Nth frame to sink
+  returns FALSE if the sink or ratio is invalid
+*/
+{
+  if (sink >= reportSinks || !every || every > 255)
+    return FALSE;
+  Subscription *sub = subscription + sink;
+  chSysLock();  //reportFrame() reads both fields together
+  sub->fields = fields & reportAllFields;
+  sub->every = every;
+  chSysUnlock();
+  return TRUE;
+}
+
+
+Subscription reportSubscription(unsigned sink)
+/*
+  return sink's current subscription
+*/
+{
+  chSysLock();
+  Subscription sub = subscription[sink];
+  chSysUnlock();
+  return sub;
+}
+
+
+bool_t reportReply(const char *text, size_t len)
+/*
+  queue a command reply to be sent before the next snapshot
+  returns FALSE if the previous reply has not yet been sent
+*/
+{
+  if (replyLen)
+    return FALSE;
+  if (len > sizeof replyText)
+    len = sizeof replyText;
+  if (!len)
+    return TRUE;
+  memcpy(replyText, text, len);
+  chSysLock();
+  replyLen = len;
+  if (waiting) {
+    Thread *tp = waiting;
+    waiting = NULL;
+    trace(traceWakeup, tp->p_prio);
+    chSchWakeupS(tp, RDY_OK);
+  }
+  chSysUnlock();
+  return TRUE;
+}
+
+
+unsigned reportCapture(void)
+/*
+  send the frames held by the frozen fault capture ring as raw frame
+  records after any pending reply
+  returns # of frames to be sent (0 if the ring is not frozen)
+*/
+{
+  FaultCapture cap;
+  faultLastCapture(&cap);
+  if (!cap.frozen || !cap.frames)
+    return 0;
+  chSysLock();
+  capturing = TRUE;
+  if (waiting) {
+    Thread *tp = waiting;
+    waiting = NULL;
+    trace(traceWakeup, tp->p_prio);
+    chSchWakeupS(tp, RDY_OK);
+  }
+  chSysUnlock();
+  return cap.frames;
+}
+
+
+void reportFrame(const TelemetryFrame *t, uint16_t dac,
+                 const AnalogFrame *frame)
+/*
+  queue a snapshot of a processed frame without waiting
+  dac is the setting computed from it
+  frame's samples are copied only if recording raw frames
+  in scope mode, they must be sent before the ADC overwrites them
+  ignores frames to which no sink subscribes
+*/
+{
+  static bool_t skip = FALSE;  //alternates while queue is over half full
+  uint8_t fields[reportSinks];
+  bool_t wanted = FALSE;
+  unsigned sink;
+  chSysLock();  //so each sink's fields and ratio are read together
+  for (sink = 0; sink < reportSinks; sink++) {
+    Subscription sub = subscription[sink];
+    fields[sink] = t->seq % sub.every ? 0 : sub.fields;
+    wanted |= fields[sink] != 0;
+  }
+  chSysUnlock();
+  if (!wanted)
+    return;
+  unsigned rawMode = requested;
+  bool_t raw = (rawMode == reportRecord || rawMode == reportScope) &&
+               fields[reportSerial];
+  uint32_t used = head - tail;
+  if (used >= (raw ? reportRawSlots : reportQsize)) {
+    reportStats.dropped++;
+    return;
+  }
+  if (!raw && used >= reportQsize/2 && (skip = !skip)) {
+    reportStats.decimated++;
+    return;
+  }
+  Snapshot *s = queue + (head & reportQmask);
+  s->t = *t;
+  s->rate = samplingProfile()->rate;
+  s->dac = dac;
+  memcpy(s->fields, fields, sizeof s->fields);
+  s->raw.samples = NULL;
+  if (raw) {
+    size_t count = frame->depth * ADCchannels;
+    s->raw = *frame;
+    s->check = rawFrameSum(frame->samples, count);
+    if (rawMode != reportScope) {
+      adcsample_t *copy = rawCopy[head % reportRawSlots];
+      memcpy(copy, frame->samples, count * sizeof(adcsample_t));
+      s->raw.samples = copy;
+    }
+  }
+  chSysLock();
+  head++;
+  reportStats.queued++;
+  if (waiting) {
+    Thread *tp = waiting;
+    waiting = NULL;
+    trace(traceWakeup, tp->p_prio);
+    chSchWakeupS(tp, RDY_OK);
+  }
+  chSysUnlock();
+}
@@ -0,0 +1,126 @@
+/**********************  report.h  ************************
+*
+*  Report processed frames on SD1 from a lower priority thread
+*
+*  The frame loop queues a snapshot of each processed frame and never
+*  waits for the serial port.  The reporter thread formats and sends
+*  the snapshots as fast as the port accepts them.  If it falls behind,
+*  every other snapshot is skipped once the queue is half full, and all
+*  are dropped once it is full.
+*
+*  Frames may be reported as text lines, binary telemetry records
+*  (telemetry.h) or raw frame records (rawframe.h).  Command replies
+*  (command.h) are sent as text lines or, in the binary modes,
+*  as telemetry reply records.  Raw samples are
+*  copied with each snapshot, so only reportRawSlots may be queued.
+*
+*  Scope mode sends every sample of every frame as raw frame records, at
+*  the highest bit rate USART1 can generate exactly, with RTS/CTS flow
+*  control.  The samples are sent by DMA straight from the ADC's buffer,
+*  so a frame still being sent when the ADC overwrites it arrives torn
+*  and fails its checksum.  Frames are dropped rather than copied while
+*  the UART is busy.  The host's zevscope splits such a capture into
+*  a file per channel.
+*
+*  A frozen fault capture (fault.h) may be downloaded as raw frame
+*  records between reports, in any mode.
+*
+*  A subscription table selects, for each sink, which fields of the
+*  text line to report and for which frames.  A frame is queued only if
+*  some sink subscribes to it, so a fast stream of one field costs only
+*  the formatting of that field.  Binary records always carry every field.
+*
+***************************************************************/
+
+#ifndef REPORT_H
+#define REPORT_H
+
+#include "frameq.h"
+#include "textline.h"
+
+/*
+ * Nonzero to also format each text line with chprintf()
+ * and report the cost of each and any disagreement
+ */
+#define textCheck  0
+
+#define reportQsize     8  //must be a power of two
+#define reportRawSlots  2  //# of raw frame copies
+
+#define reportText       0  /* a human readable line */
+#define reportTelemetry  1  /* a binary telemetry record */
+#define reportRecord     2  /* a raw frame record */
+#define reportScope      3  /* a raw frame record sent in place by DMA */
+
+/*
+ * Sinks
+ */
+#define reportSerial     0  /* SD1, in the current mode */
+#define reportDebug      1  /* debugPrint() */
+#define reportSinks      2
+
+typedef struct {
+  uint8_t fields;  //text line fields (textline.h), none to unsubscribe
+  uint8_t every;   //report frames whose sequence # is a multiple of this
+} Subscription;
+
+typedef struct {
+  unsigned queued;     //snapshots queued for the reporter
+  unsigned decimated;  //skipped because the queue was over half full
+  unsigned dropped;    //discarded because the queue was full
+  unsigned unsent;     //scope frames dropped because the UART was busy
+  halrtcnt_t textCycles;    //CPU cycles to format last text line
+#if textCheck
+  halrtcnt_t printfCycles;  //CPU cycles to format it with chprintf()
+  unsigned textMismatches;  //lines that differed
+#endif
+} ReportStats;
+
+extern ReportStats reportStats;
+
+Thread *reportInit(tprio_t prio);
+/*
+  start reporter thread at the given priority
+  returns the thread
+*/
+
+void reportMode(unsigned mode);
+/*
+  report subsequent frames in mode, or as text if already in that mode
+*/
+
+bool_t reportSubscribe(unsigned sink, unsigned fields, unsigned every);
+/*
+  report the given fields of every Nth frame to sink
+  returns FALSE if the sink or ratio is invalid
+*/
+
+Subscription reportSubscription(unsigned sink);
+/*
+  return sink's current subscription
+*/
+
+bool_t reportReply(const char *text, size_t len);
+/*
+  queue a command reply to be sent before the next snapshot
+  returns FALSE if the previous reply has not yet been sent
+*/
+
+unsigned reportCapture(void);
+/*
+  send the frames held by the frozen fault capture ring as raw frame
+  records after any pending reply
+  returns # of frames to be sent (0 if the ring is not frozen)
+*/
+
+void reportFrame(const TelemetryFrame *t, uint16_t dac,
+                 const AnalogFrame *frame);
+/*
+  queue a snapshot of a processed frame without waiting
+  dac is the setting computed from it
+  frame's samples are copied only if recording raw frames
+  in scope mode, they must be sent before the ADC overwrites them
+  ignores frames to which no sink subscribes
+*/
+
+#endif /* REPORT_H */
@@ -0,0 +1,217 @@
+/**********************  sampling.c  ************************
+*
+*  ADC sampling profile
+*
+*  The STM32L ADC is clocked at 16Mhz from HSI.  Each conversion takes
+*  its sample time plus 12 ADC clocks.
+*
+***************************************************************/
+
+#include "sampling.h"
+#include "pins.h"
+
+/* The pins PC0 - 2 are analog inputs
+    PC0 = High Voltage
+    PC1 = Charger voltage setpoint feedback
+    PC2 = Overvoltage from celltops
+*/
+#define ANALOGINS_C    GPIOC, 0x7, 0
+
+/* The pins PA1 - 2 are also analog inputs
+    PA1 = Charger Current Sensor VCC/2 (nominally 2.5V)
+    PA2 = Charger Current Sensor (proportional to PA1)
+*/
+#define ANALOGINS_A    GPIOA, 0x3, 1
+
+adcsample_t analogSample[2*ADCchannels*ADCmaxDepth] __attribute__((aligned(4)));
+
+/*
+ * By default, convert 64 rows of samples every 1/20second
+ */
+const SamplingProfile defaultSampling = {
+  20, 64, ADC_SAMPLE_16, ADC_SAMPLE_96
+};
+
+#define adcClkRate  16000000  /* HSI */
+
+ //Timer 6 trigger
+#define adcTrigger (ADC_CR2_EXTSEL_1 | ADC_CR2_EXTSEL_3 | ADC_CR2_EXTEN_0)
+#define adcTimer STM32_TIM6
+#define adcTimerClkRate  STM32_PCLK1
+#define enableAdcTimer() rccEnableAPB1(RCC_APB1ENR_TIM6EN, FALSE)
+#define disableAdcTimer() rccDisableAPB1(RCC_APB1ENR_TIM6EN, FALSE)
+
+static SamplingProfile current;
+
+static INLINE void setAdcTimebase(uint32_t hz)
+{
+  adcTimer->PSC = (uint16_t)((adcTimerClkRate / hz) - 1);
+}
+
+/**
+ * @brief   Starts the timer in continuous mode.
+ */
+static INLINE void startAdcTimer(uint16_t interval) {
+  stm32_tim_t *tim = adcTimer;
+  tim->ARR   = interval - 1;              /* Time constant.           */
+  tim->EGR   = STM32_TIM_EGR_UG;          /* Update event.            */
+  tim->CNT   = 0;                         /* Reset counter.           */
+  tim->DIER  = 0;        /* no interrupts enabled */
+  tim->CR2   = STM32_TIM_CR2_MMS(2);      /* output TRGO pulse on update  */
+  tim->CR1   = STM32_TIM_CR1_URS | STM32_TIM_CR1_CEN;
+}
+
+static INLINE void stopAdcTimer(void) {
+  adcTimer->CR1 = 0;
+}
+
+/*
+ * ADC conversion group.
+ * Mode:        Circular buffer, depth rows of ADCchannels, TIM6 triggered.
+ * Channels:    SENSOR, IN10, IN11, IN12, IN1, IN2
+ */
+static ADCConversionGroup adcgrpcfg = {
+  TRUE,
+  ADCchannels,
+  NULL,
+  NULL,
+  /* HW dependent part.*/
+  0,                          /* CR1 */
+  adcTrigger,                 /* CR2 -- trigger */
+  0,
+  0,                          /* SMPR2 -- set from profile */
+  0,                          /* SMPR3 -- set from profile */
+  ADC_SQR1_NUM_CH(ADCchannels),
+  0,
+  0,
+  0,
+  ADC_SQR5_SQ1_N(ADC_CHANNEL_SENSOR) |
+   ADC_SQR5_SQ2_N(ADC_CHANNEL_IN10) | ADC_SQR5_SQ3_N(ADC_CHANNEL_IN11) |
+   ADC_SQR5_SQ4_N(ADC_CHANNEL_IN12) |
+   ADC_SQR5_SQ5_N(ADC_CHANNEL_IN1) | ADC_SQR5_SQ6_N(ADC_CHANNEL_IN2)
+};
+
+/* ADC clocks to sample for each ADC_SAMPLE_x code */
+static const uint16_t sampleClocks[8] = {4, 9, 16, 24, 48, 96, 192, 384};
+
+static int validate(const SamplingProfile *p, uint32_t *divisor)
+/*
+  compute trigger timer divisor for profile p
+  returns 0 or a negative samplingBad... code
+*/
+{
+  if (!p->depth || p->depth > ADCmaxDepth)
+    return samplingBadDepth;
+  if (!p->rate)
+    return samplingBadRate;
+  uint32_t div = adcTimeBase / (p->rate * p->depth);
+  if (!div || div >= 1<<16)
+    return samplingBadRate;
+  uint32_t clocks = sampleClocks[p->sensorTime & 7] + 12 +
+                    (sampleClocks[p->sampleTime & 7] + 12) * (ADCchannels-1);
+  if (clocks * (adcTimeBase/1000) > div * (adcClkRate/1000))
+    return samplingTooFast;
+  *divisor = div;
+  return 0;
+}
+
+static void apply(const SamplingProfile *p, uint32_t divisor)
+/*
+  (re)start sampling with validated profile p
+*/
+{
+  uint8_t t = p->sampleTime;
+  adcgrpcfg.smpr2 = ADC_SMPR2_SMP_SENSOR(p->sensorTime) |
+    ADC_SMPR2_SMP_AN10(t) | ADC_SMPR2_SMP_AN11(t) | ADC_SMPR2_SMP_AN12(t);
+  adcgrpcfg.smpr3 = ADC_SMPR3_SMP_AN1(t) | ADC_SMPR3_SMP_AN2(t);
+  current = *p;
+  startAdcTimer(divisor);
+  adcStartConversion(&ADCD1, &adcgrpcfg, analogSample, 2*p->depth);
+}
+
+
+void samplingStart(const SamplingProfile *profile,
+                   adccallback_t done, adcerrorcallback_t err)
+/*
+  configure analog inputs, ADC and its trigger timer
+  and start sampling with the given profile
+*/
+{
+  uint32_t divisor;
+  if (validate(profile, &divisor))
+    validate(profile = &defaultSampling, &divisor);
+  adcgrpcfg.end_cb = done;
+  adcgrpcfg.error_cb = err;
+
+  /*
+   * Configure Adc Timer
+   */
+  enableAdcTimer();
+  setAdcTimebase(adcTimeBase);
+
+  /*
+   * Initializes the ADC driver 1
+   */
+  configureGroup(ANALOGINS_C, PAL_MODE_INPUT_ANALOG);
+  configureGroup(ANALOGINS_A, PAL_MODE_INPUT_ANALOG);
+  adcStart(&ADCD1, NULL);
+  adcSTM32EnableTSVREFE();  /* enable temperature sensor */
+  apply(profile, divisor);
+}
+
+
+int samplingSet(const SamplingProfile *profile, FrameQueue *frames)
+/*
+  stop sampling and restart it with the given profile
+  flushes the frames queued from the old profile
+  returns 0 or a negative samplingBad... code if the profile is rejected
+  (leaves the current profile running if rejected)
+*/
+{
+  uint32_t divisor;
+  int err = validate(profile, &divisor);
+  if (!err) {
+    stopAdcTimer();
+    adcStopConversion(&ADCD1);
+    chSysLock();
+    frameqFlushI(frames);
+    chSysUnlock();
+    apply(profile, divisor);
+  }
+  return err;
+}
+
+
+const SamplingProfile *samplingProfile(void)
+/*
+  return the profile currently in effect
+*/
+{
+  return &current;
+}
+
+
+void samplingSetCR1(uint32_t cr1)
+/*
+  set the extra ADC CR1 bits (e.g. analog watchdog) to apply on every start
+  takes effect immediately if the ADC is already converting
+*/
+{
+  chSysLock();
+  adcgrpcfg.cr1 = cr1;
+  if (ADCD1.state == ADC_ACTIVE)  /* as adc_lld_start_conversion() would */
+    ADCD1.adc->CR1 = cr1 | ADC_CR1_OVRIE | ADC_CR1_SCAN;
+  chSysUnlock();
+}
+
+
+void samplingClearCR1I(uint32_t bits)
+/*
+  clear extra ADC CR1 bits, both now and for every later start
+  (from within a kernel lock, or the ADC interrupt, which samplingSetCR1()
+   locks out)
+*/
+{
+  adcgrpcfg.cr1 &= ~bits;
+  ADCD1.adc->CR1 &= ~bits;
+}
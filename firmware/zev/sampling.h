@@ -0,0 +1,90 @@
+/**********************  sampling.h  ************************
+*
+*  ADC sampling profile
+*
+*  TIM6 triggers a conversion of all ADCchannels inputs every
+*  1/(rate*depth) seconds.  The DMA fills alternate halves of the
+*  analogSample buffer with depth rows of samples, so each half (a frame)
+*  completes at the profile's frame rate.
+*
+*  The profile may be changed while running to trade noise for latency.
+*  Frames still queued from the old profile point into a buffer laid out
+*  for its depth, which the new one overwrites, so changing the profile
+*  discards them.  They are counted as stale, or as torn if one is being
+*  processed.
+*
+***************************************************************/
+
+#ifndef SAMPLING_H
+#define SAMPLING_H
+
+#include <hal.h>
+#include <stm32_tim.h>
+
+#include "accum.h"
+#include "frameq.h"
+
+/* Frequency of the ADC trigger timer's counter */
+#define adcTimeBase 8000000
+
+/* Maximum depth of each half of the conversion buffer */
+#define ADCmaxDepth   128
+
+/*
+ * Raw ADC sample buffer.
+ */
+extern adcsample_t analogSample[2*ADCchannels*ADCmaxDepth];
+
+typedef struct {
+  unsigned rate;        //frames per second
+  unsigned depth;       //rows of samples per frame
+  uint8_t sampleTime;   //ADC_SAMPLE_x for external inputs
+  uint8_t sensorTime;   //ADC_SAMPLE_x for temperature sensor (at least 10us)
+} SamplingProfile;
+
+extern const SamplingProfile defaultSampling;
+
+/* reasons samplingSet() may reject a profile */
+#define samplingBadDepth  -1  //zero or exceeds ADCmaxDepth
+#define samplingBadRate   -2  //timer divisor out of range
+#define samplingTooFast   -3  //conversions would outlast the trigger interval
+
+void samplingStart(const SamplingProfile *profile,
+                   adccallback_t done, adcerrorcallback_t err);
+/*
+  configure analog inputs, ADC and its trigger timer
+  and start sampling with the given profile
+*/
+
+int samplingSet(const SamplingProfile *profile, FrameQueue *frames);
+/*
+  stop sampling and restart it with the given profile
+  flushes the frames queued from the old profile
+  returns 0 or a negative samplingBad... code if the profile is rejected
+  (leaves the current profile running if rejected)
+*/
+
+const SamplingProfile *samplingProfile(void);
+/*
+  return the profile currently in effect
+*/
+
+void samplingSetCR1(uint32_t cr1);
+/*
+  set the extra ADC CR1 bits (e.g. analog watchdog) to apply on every start
+  takes effect immediately if the ADC is already converting
+*/
+
+void samplingClearCR1I(uint32_t bits);
+/*
+  clear extra ADC CR1 bits, both now and for every later start
+  (from within a kernel lock, or the ADC interrupt, which samplingSetCR1()
+   locks out)
+*/
+
+#define samplingSinceTrigger() ((uint16_t)STM32_TIM6->CNT)
+/*
+  adcTimeBase ticks since the last conversion trigger
+*/
+
+#endif /* SAMPLING_H */
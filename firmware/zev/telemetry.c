@@ -0,0 +1,103 @@
+/**********************  telemetry.c  ************************
+*
+*  Compact binary telemetry records
+*
+***************************************************************/
+
+#include <string.h>
+
+#include "telemetry.h"
+
+#define telValues  8  /* twelve bit values per frame record */
+
+#if telValues != ADCchannels+2
+#error  frame record layout assumes 6 ADC channels
+#endif
+
+static uint8_t *put16(uint8_t *out, uint16_t x)
+{
+  *out++ = x;
+  *out++ = x >> 8;
+  return out;
+}
+
+static uint16_t get16(const uint8_t *in)
+{
+  return in[0] | in[1] << 8;
+}
+
+
+size_t telemetryPacket(uint8_t *packet, const TelemetryFrame *t)
+/*
+  encode t into packet, which must hold telemetryMaxPacket bytes
+  returns # of bytes in the packet
+*/
+{
+  uint16_t value[telValues];
+  uint8_t payload[telemetryPayload];
+  unsigned i;
+  for (i = 0; i < ADCchannels; i++)
+    value[i] = t->adc[i];
+  value[ADCchannels] = t->dac;
+  value[ADCchannels+1] = t->dropped;
+
+  uint8_t *out = payload;
+  *out++ = telemetryFrameType << 4 | (t->flags & 0xf);
+  out = put16(out, t->seq);
+  out = put16(out, t->time);
+  for (i = 0; i < telValues; i += 2) {
+    uint16_t a = value[i] & 0xfff, b = value[i+1] & 0xfff;
+    *out++ = a;
+    *out++ = a >> 8 | b << 4;
+    *out++ = b >> 4;
+  }
+  int32_t mA = t->mA;
+  put16(out, mA > INT16_MAX ? INT16_MAX : mA < INT16_MIN ? INT16_MIN : mA);
+  return cobsPacket(packet, payload, sizeof payload);
+}
+
+
+size_t telemetryReply(uint8_t *packet, const char *text, size_t len)
+/*
+  encode len bytes of a command reply's text into packet,
+  which must hold telemetryReplySize(len) bytes
+  text is truncated to telemetryMaxText bytes
+  returns # of bytes in the packet
+*/
+{
+  uint8_t payload[cobsMaxPayload];
+  if (len > telemetryMaxText)
+    len = telemetryMaxText;
+  payload[0] = telemetryReplyType << 4;
+  memcpy(payload+1, text, len);
+  return cobsPacket(packet, payload, len+1);
+}
+
+
+bool_t telemetryParse(TelemetryFrame *t, const uint8_t *payload, size_t len)
+/*
+  decode a frame record's payload (as returned by cobsUnpack)
+  seq and time are modulo 2^16, dropped modulo 2^12
+  returns FALSE if payload is not a frame record
+*/
+{
+  if (len != telemetryPayload || payload[0] >> 4 != telemetryFrameType)
+    return FALSE;
+  uint16_t value[telValues];
+  t->flags = payload[0] & 0xf;
+  t->seq = get16(payload+1);
+  t->time = get16(payload+3);
+  const uint8_t *in = payload+5;
+  unsigned i;
+  for (i = 0; i < telValues; i += 2) {
+    value[i] = in[0] | (in[1] & 0xf) << 8;
+    value[i+1] = in[1] >> 4 | in[2] << 4;
+    in += 3;
+  }
+  for (i = 0; i < ADCchannels; i++)
+    t->adc[i] = value[i];
+  t->dac = value[ADCchannels];
+  t->dropped = value[ADCchannels+1];
+  t->mA = (int16_t)get16(in);
+  return TRUE;
+}
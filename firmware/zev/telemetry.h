@@ -0,0 +1,70 @@
+/**********************  telemetry.h  ************************
+*
+*  Compact binary telemetry records
+*
+*  Each record is a COBS packet (see cobs.h) with this little endian payload:
+*    byte  0      record type (high nibble) and flags (low nibble)
+*    bytes 1-2    frame sequence number modulo 2^16
+*    bytes 3-4    system time in ticks (CH_FREQUENCY per second) modulo 2^16
+*    bytes 5-16   8 twelve bit values, packed two per three bytes:
+*                   C, Vin, VcmdIn, Thres, Vcc/2, curr (averaged ADC counts),
+*                   Vcmd (DAC output) and dropped frames modulo 2^12
+*    bytes 17-18  current in mA, saturated to 16 bits
+*
+*  A record occupies 23 bytes on the wire vs. ~90 for the text line.
+*
+*  A command reply record's payload is its type byte followed by the text.
+*
+***************************************************************/
+
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <ch.h>
+#include "accum.h"
+#include "cobs.h"
+
+#define telemetryFrameType  1
+#define telemetryReplyType  2
+
+#define telCharging  1  /* CHARGER on */
+#define telCV        2  /* charge controller in constant voltage mode */
+
+#define telemetryPayload  19
+#define telemetryMaxPacket  (telemetryPayload + cobsOverhead(telemetryPayload))
+
+#define telemetryMaxText  (cobsMaxPayload-1)  /* longest reply text */
+#define telemetryReplySize(len)  ((len)+1 + cobsOverhead((len)+1))
+
+typedef struct {
+  uint32_t seq;                //frame sequence number
+  systime_t time;              //system time in ticks
+  uint16_t adc[ADCchannels];   //averaged ADC inputs
+  uint16_t dac;                //charger voltage setpoint output
+  uint16_t dropped;            //total frames dropped
+  int32_t  mA;                 //current
+  uint8_t  flags;              //telCharging, telCV
+} TelemetryFrame;
+
+size_t telemetryPacket(uint8_t *packet, const TelemetryFrame *t);
+/*
+  encode t into packet, which must hold telemetryMaxPacket bytes
+  returns # of bytes in the packet
+*/
+
+size_t telemetryReply(uint8_t *packet, const char *text, size_t len);
+/*
+  encode len bytes of a command reply's text into packet,
+  which must hold telemetryReplySize(len) bytes
+  text is truncated to telemetryMaxText bytes
+  returns # of bytes in the packet
+*/
+
+bool_t telemetryParse(TelemetryFrame *t, const uint8_t *payload, size_t len);
+/*
+  decode a frame record's payload (as returned by cobsUnpack)
+  seq and time are modulo 2^16, dropped modulo 2^12
+  returns FALSE if payload is not a frame record
+*/
+
+#endif /* TELEMETRY_H */
@@ -0,0 +1,141 @@
+/**********************  textline.c  ************************
+*
+*  Format telemetry frames as human readable text lines
+*
+*  The divisions by constants below compile to multiplies.
+*
+***************************************************************/
+
+#include <string.h>
+
+#include "textline.h"
+
+static const char digitPairs[200] =
+  "00010203040506070809101112131415161718192021222324"
+  "25262728293031323334353637383940414243444546474849"
+  "50515253545556575859606162636465666768697071727374"
+  "75767778798081828384858687888990919293949596979899";
+
+/*
+ * Each field's name, including the separator that precedes it
+ * (C has always been set apart by a space)
+ */
+static const char *const fieldName[] =
+  {",Vcmd=", ",Vin=", ",VcmdIn=", ",Thres=", ", C=", ",Vcc/2=", ",curr=", ",A="};
+#define textFields  (sizeof fieldName / sizeof *fieldName)
+
+
+static char *put(char *out, const char *str)
+{
+  while (*str)
+    *out++ = *str++;
+  return out;
+}
+
+static char *putUnsigned(char *out, uint32_t x)
+/*
+  output x in decimal without leading zeros
+*/
+{
+  char digits[10];
+  char *cursor = digits + sizeof digits;
+  while (x >= 100) {
+    const char *pair = digitPairs + 2*(x % 100);
+    x /= 100;
+    *--cursor = pair[1];
+    *--cursor = pair[0];
+  }
+  if (x >= 10) {
+    *--cursor = digitPairs[2*x+1];
+    *--cursor = digitPairs[2*x];
+  }else
+    *--cursor = '0' + x;
+  size_t len = digits + sizeof digits - cursor;
+  memcpy(out, cursor, len);
+  return out + len;
+}
+
+static char *putMilli(char *out, int32_t milli)
+/*
+  output milli/1000 with three fraction digits
+*/
+{
+  uint32_t x = milli;
+  if (milli < 0) {
+    *out++ = '-';
+    x = -x;
+  }
+  out = putUnsigned(out, x / 1000);
+  x %= 1000;
+  *out++ = '.';
+  *out++ = '0' + x / 100;
+  const char *pair = digitPairs + 2*(x % 100);
+  *out++ = pair[0];
+  *out++ = pair[1];
+  return out;
+}
+
+static char *putFields(char *out, const TelemetryFrame *t, unsigned fields,
+                       const char *leader)
+/*
+  output the selected fields
+  leader replaces the comma before the first one
+*/
+{
+  const uint16_t *adc = t->adc;
+  const uint16_t value[textFields-1] =
+    {t->dac, adc[1], adc[2], adc[3], adc[0], adc[4], adc[5]};
+  unsigned i;
+  for (i = 0; i < textFields; i++)
+    if (fields & 1<<i) {
+      const char *name = fieldName[i];
+      if (leader) {
+        out = put(out, leader);
+        name += name[1] == ' ' ? 2 : 1;
+        leader = NULL;
+      }
+      out = put(out, name);
+      if (i < textFields-1)
+        out = putUnsigned(out, value[i]);
+      else
+        out = putMilli(out, t->mA);
+    }
+  return out;
+}
+
+
+size_t textLine(char *line, const TelemetryFrame *t, unsigned fields)
+/*
+  format the selected fields of t as a report line ending with CR LF
+  line must hold textMaxLine bytes
+  returns # of characters in line
+*/
+{
+  char *out = line;
+  *out++ = '#';
+  out = putUnsigned(out, t->seq);
+  out = put(out, t->flags & telCharging ? ":ON :" : ":off:");
+  out = putFields(out, t, fields, " ");
+  *out++ = '\r';
+  *out++ = '\n';
+  return out - line;
+}
+
+
+size_t textDebugLine(char *line, const TelemetryFrame *t, unsigned fields)
+/*
+  format the selected fields of t as a line for debugPut()
+  prefixed by the frame's time in ticks and without a terminator
+  line must hold textMaxLine bytes
+  returns # of characters in line
+*/
+{
+  char *out = line;
+  *out++ = '@';
+  out = putUnsigned(out, t->time);
+  *out++ = '#';
+  out = putUnsigned(out, t->seq);
+  out = put(out, t->flags & telCharging ? ":ON :" : ":off:");
+  out = putFields(out, t, fields, "");
+  return out - line;
+}
@@ -0,0 +1,51 @@
+/**********************  textline.h  ************************
+*
+*  Format telemetry frames as human readable text lines
+*
+*  A full line reads:
+*    #seq:ON : Vcmd=n,Vin=n,VcmdIn=n,Thres=n, C=n,Vcc/2=n,curr=n,A=-a.mmm
+*  Any subset of the fields may be selected.
+*
+*  chprintf() interprets its format string and converts each number
+*  with a divide per digit.  Here, the line is assembled from constant
+*  strings and numbers converted two digits at a time from a table,
+*  using only integer operations.  The text is byte for byte the same.
+*
+***************************************************************/
+
+#ifndef TEXTLINE_H
+#define TEXTLINE_H
+
+#include "telemetry.h"
+
+/*
+ * Text line fields, in order
+ */
+#define reportVcmd       0x01  /* DAC output */
+#define reportVin        0x02  /* PC0 High Voltage counts */
+#define reportVcmdIn     0x04  /* PC1 DAC feedback */
+#define reportThres      0x08  /* PC2 celltop */
+#define reportC          0x10  /* temperature sensor */
+#define reportVcc2       0x20  /* current sensor's Vcc/2 */
+#define reportCurr       0x40  /* current sensor output */
+#define reportAmps       0x80  /* current in Amps */
+#define reportAllFields  0xff
+
+#define textMaxLine  128  /* longest line, including its terminator */
+
+size_t textLine(char *line, const TelemetryFrame *t, unsigned fields);
+/*
+  format the selected fields of t as a report line ending with CR LF
+  line must hold textMaxLine bytes
+  returns # of characters in line
+*/
+
+size_t textDebugLine(char *line, const TelemetryFrame *t, unsigned fields);
+/*
+  format the selected fields of t as a line for debugPut()
+  prefixed by the frame's time in ticks and without a terminator
+  line must hold textMaxLine bytes
+  returns # of characters in line
+*/
+
+#endif /* TEXTLINE_H */
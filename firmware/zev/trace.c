@@ -0,0 +1,56 @@
+/**********************  trace.c  ************************
+*
+*  Flight recorder -- an always on ring of timestamped events
+*
+*  head counts events from the last time the ring was cleared, so the
+*  oldest held is event[head % traceEvents] once it has wrapped.
+*
+***************************************************************/
+
+#include <string.h>
+
+#include "trace.h"
+
+TraceRing traceRing __attribute__((section(".noinit")));
+
+
+void traceInit(void)
+/*
+  clear the ring unless it survived a reset intact,
+  then record the reset and its cause
+*/
+{
+  if (traceRing.magic != traceMagic || traceRing.size != traceEvents) {
+    memset(&traceRing, 0, sizeof traceRing);
+    traceRing.size = traceEvents;
+    traceRing.magic = traceMagic;
+  }
+  trace(traceReset, RCC->CSR >> 24);
+  RCC->CSR |= RCC_CSR_RMVF;  //so the next reset's cause stands alone
+}
+
+
+void trace(unsigned type, uint32_t arg)
+/*
+  record an event of type with the low 24 bits of arg
+  (from any thread or interrupt handler)
+*/
+{
+  TraceEvent *e = traceRing.event +
+    (__sync_fetch_and_add(&traceRing.head, 1) & (traceEvents-1));
+  e->stamp = halGetCounterValue();
+  e->what = type | arg << 8;
+}
+
+
+uint32_t traceName(const char *name, size_t len)
+/*
+  return an argument holding the first 3 characters of name
+*/
+{
+  uint32_t arg = 0;
+  unsigned i;
+  for (i = 0; i < 3 && i < len; i++)
+    arg |= (uint32_t)(uint8_t)name[i] << 8*i;
+  return arg;
+}
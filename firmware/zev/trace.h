@@ -0,0 +1,76 @@
+/**********************  trace.h  ************************
+*
+*  Flight recorder -- an always on ring of timestamped events
+*
+*  Each event is two words:  the CPU cycle counter (DWT CYCCNT) when it
+*  occurred, and its type in the low byte with a 24 bit argument above.
+*  Recording one takes an atomic increment of the ring's head, a read of
+*  the counter and two stores, so any thread or interrupt handler may
+*  record events without a kernel lock.  An event interrupted between
+*  its increment and its stores is overtaken by the interrupting one,
+*  so stamps may be out of order by that much.
+*
+*  The ring lives in the .noinit section (zev.ld), which the startup
+*  code neither loads nor clears, so it survives a warm reset, as by the
+*  watchdog, the reset pin or a debugger.  traceInit() keeps the events
+*  recorded before the reset if the ring's magic word is intact.  The
+*  cycle counter need not continue across a reset, so only the stamps
+*  of events between the same two resets may be compared.
+*
+*  gdb's flightlog command (stm32l-discovery/cmds.gdb) lists the events
+*  and saves the ring in flightlog.bin for host/zevflight.c to format.
+*
+***************************************************************/
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <ch.h>
+#include <hal.h>
+
+#define traceEvents  64  /* must be a power of two */
+#define traceMagic   0x46544c31  /* "FLT1" */
+
+/*
+ * Event types
+ */
+#define traceReset     1  /* arg:  RCC_CSR reset flags (bits 31..24) */
+#define traceFrame     2  /* ADC frame done, arg:  its sequence # */
+#define traceAdcError  3  /* arg:  ADC error code */
+#define traceWakeup    4  /* arg:  priority of the thread woken */
+#define traceCommand   5  /* arg:  first 3 characters of its name */
+#define traceCharger   6  /* arg:  1 if CHARGER turned on, 0 if off */
+#define traceTrip      7  /* CHARGER dropped, arg:  awd source<<8 | column */
+
+typedef struct {
+  uint32_t stamp;  //CPU cycle counter when it occurred
+  uint32_t what;   //type | argument<<8, 0 if never written
+} TraceEvent;
+
+typedef struct {
+  uint32_t          magic;   //traceMagic if the ring is intact
+  uint32_t          size;    //traceEvents
+  volatile uint32_t head;    //events ever recorded, since the ring was cleared
+  TraceEvent        event[traceEvents];
+} TraceRing;
+
+extern TraceRing traceRing;
+
+void traceInit(void);
+/*
+  clear the ring unless it survived a reset intact,
+  then record the reset and its cause
+*/
+
+void trace(unsigned type, uint32_t arg);
+/*
+  record an event of type with the low 24 bits of arg
+  (from any thread or interrupt handler)
+*/
+
+uint32_t traceName(const char *name, size_t len);
+/*
+  return an argument holding the first 3 characters of name
+*/
+
+#endif /* TRACE_H */
@@ -0,0 +1,154 @@
+/**********************  uartdma.c  ************************
+*
+*  Transmit prebuilt buffers on USART1 by DMA
+*
+*  Buffers are sent in the order they were claimed.  The buffer being
+*  filled is txBuf[head], the one being sent is txBuf[tail].
+*  A slot sends txData[], normally its buffer but possibly data elsewhere.
+*
+***************************************************************/
+
+#include "uartdma.h"
+#include "irqhook.h"
+
+#define txStream  STM32_DMA1_STREAM4  /* USART1_TX request */
+#define txMode    (STM32_DMA_CR_DIR_M2P | STM32_DMA_CR_MINC | \
+                   STM32_DMA_CR_PSIZE_BYTE | STM32_DMA_CR_MSIZE_BYTE | \
+                   STM32_DMA_CR_PL(0) | STM32_DMA_CR_TCIE)
+
+static uint8_t txBuf[2][uartdmaBufSize];
+static const uint8_t *txData[2];
+static size_t txLen[2];
+static unsigned head, tail;      //buffer being filled, buffer being sent
+static volatile unsigned queued; //buffers sent or awaiting transmission
+
+static UartdmaStats stats;
+static irqHandler serialDriverIrq;
+
+
+static void startTx(void)
+/*
+  start sending txBuf[tail] (from within a kernel lock)
+*/
+{
+  USART1->CR3 |= USART_CR3_DMAT;  //sdStart() clears this
+  dmaStreamSetMemory0(txStream, txData[tail]);
+  dmaStreamSetTransactionSize(txStream, txLen[tail]);
+  dmaStreamSetMode(txStream, txMode);
+  dmaStreamEnable(txStream);
+}
+
+static void txDone(void *param, uint32_t flags)
+/*
+  DMA transmit complete interrupt
+*/
+{
+  halrtcnt_t entry = halGetCounterValue();
+  (void)param; (void)flags;
+  chSysLockFromIsr();
+  dmaStreamDisable(txStream);
+  stats.sent++;
+  tail ^= 1;
+  if (--queued)
+    startTx();
+  chSysUnlockFromIsr();
+  stats.dma.irqs++;
+  stats.dma.cycles += halGetCounterValue() - entry;
+}
+
+
+static void serialIrq(void)
+/*
+  hooked in front of the serial driver's USART1 interrupt handler
+*/
+{
+  halrtcnt_t entry = halGetCounterValue();
+  serialDriverIrq();  //no kernel calls after this (see irqhook.h)
+  stats.serial.irqs++;
+  stats.serial.cycles += halGetCounterValue() - entry;
+}
+
+
+void uartdmaInit(void)
+/*
+  allocate the transmit DMA channel and hook the USART1 interrupt
+*/
+{
+  head = tail = queued = 0;
+  dmaStreamAllocate(txStream, STM32_SERIAL_USART1_PRIORITY, txDone, NULL);
+  dmaStreamSetPeripheral(txStream, &USART1->DR);
+  serialDriverIrq = irqHook(USART1_IRQn, serialIrq);
+}
+
+
+uint8_t *uartdmaClaim(void)
+/*
+  returns a free buffer of uartdmaBufSize bytes to be filled and sent
+  or NULL (and counts a drop) if both buffers are busy
+  to wait for a buffer, poll uartdmaFree() rather than this
+*/
+{
+  if (queued < 2)
+    return txBuf[head];
+  stats.dropped++;
+  return NULL;
+}
+
+
+static void queue(const uint8_t *data, size_t len)
+{
+  chSysLock();
+  txData[head] = data;
+  txLen[head] = len;
+  head ^= 1;
+  if (!queued++)
+    startTx();
+  chSysUnlock();
+}
+
+void uartdmaSend(size_t len)
+/*
+  transmit the first len bytes of the buffer last claimed
+*/
+{
+  queue(txBuf[head], len);
+}
+
+
+bool_t uartdmaSendFrom(const void *data, size_t len)
+/*
+  transmit len bytes in place, after any buffers already queued
+  data must not change until sent
+  returns FALSE (and drops the data) if both buffers are busy
+*/
+{
+  if (queued < 2) {
+    queue(data, len);
+    return TRUE;
+  }
+  stats.dropped++;
+  return FALSE;
+}
+
+
+unsigned uartdmaFree(void)
+/*
+  returns # of buffers free (0, 1 or 2)
+*/
+{
+  return 2 - queued;
+}
+
+
+void uartdmaStats(UartdmaStats *copy)
+/*
+  copy and reset the statistics accumulated since last called
+*/
+{
+  chSysLock();
+  *copy = stats;
+  stats.serial.irqs = stats.dma.irqs = 0;
+  stats.serial.cycles = stats.dma.cycles = 0;
+  stats.sent = stats.dropped = 0;
+  chSysUnlock();
+}
@@ -0,0 +1,73 @@
+/**********************  uartdma.h  ************************
+*
+*  Transmit prebuilt buffers on USART1 by DMA
+*
+*  The serial driver SD1 interrupts once per character sent.  Here, a
+*  whole buffer is sent by DMA1 channel 4 with one interrupt at its end.
+*  Two buffers alternate, so one may be filled while the other is sent.
+*  If both are busy, the caller gets no buffer and its data is dropped,
+*  so the sender never waits for the UART.  Large blocks, such as frames
+*  of raw samples, may be sent in place of a buffer without being copied.
+*
+*  SD1 continues to receive, but nothing else should be written to it
+*  while DMA transmissions are in progress.
+*
+*  The USART1 interrupt is hooked so that the CPU time spent in the
+*  serial driver's handler can be compared with that spent in the DMA's.
+*
+***************************************************************/
+
+#ifndef UARTDMA_H
+#define UARTDMA_H
+
+#include <hal.h>
+
+#define uartdmaBufSize  256  /* bytes per transmit buffer */
+
+typedef struct {
+  unsigned   irqs;     //# of interrupts handled
+  halrtcnt_t cycles;   //CPU cycles spent handling them
+} IsrLoad;
+
+typedef struct {
+  IsrLoad  serial;     //serial driver's USART1 interrupts
+  IsrLoad  dma;        //DMA transmit complete interrupts
+  unsigned sent;       //buffers transmitted
+  unsigned dropped;    //buffers refused because both were busy
+} UartdmaStats;
+
+void uartdmaInit(void);
+/*
+  allocate the transmit DMA channel and hook the USART1 interrupt
+*/
+
+uint8_t *uartdmaClaim(void);
+/*
+  returns a free buffer of uartdmaBufSize bytes to be filled and sent
+  or NULL (and counts a drop) if both buffers are busy
+  to wait for a buffer, poll uartdmaFree() rather than this
+*/
+
+void uartdmaSend(size_t len);
+/*
+  transmit the first len bytes of the buffer last claimed
+*/
+
+bool_t uartdmaSendFrom(const void *data, size_t len);
+/*
+  transmit len bytes in place, after any buffers already queued
+  data must not change until sent
+  returns FALSE (and drops the data) if both buffers are busy
+*/
+
+unsigned uartdmaFree(void);
+/*
+  returns # of buffers free (0, 1 or 2)
+*/
+
+void uartdmaStats(UartdmaStats *stats);
+/*
+  copy and reset the statistics accumulated since last called
+*/
+
+#endif /* UARTDMA_H */
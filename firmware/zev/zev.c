@@ -1,162 +1,429 @@
 #include <ch.h>
 #include <hal.h>
 #include <chprintf.h>
-#include <stm32_tim.h>
+#include <string.h>
+#include <stdlib.h>
 
 #include "debugput.h"
-
-char debugOutput[300];  //debugging output awaiting transmission to host
+#include "dccput.h"
+#include "pins.h"
+#include "convert.h"
+#include "accum.h"
+#include "frameq.h"
+#include "sampling.h"
+#include "pipeline.h"
+#include "report.h"
+#include "uartdma.h"
+#include "command.h"
+#include "awd.h"
+#include "fault.h"
+#include "trace.h"
+
+char debugOutput[512];  //debugging output awaiting transmission to host (power of 2)
+char debugRAMlog[512];  //latest debugging output for gdb's debuglog (power of 2)
 
 //#define debugPrint(fmt,...) chprintf(&SD1, fmt, __VA_ARGS__)
 //#define debugPuts(str) debugPrint("%d/r/n", str)
 
-#define clearPad(...) palClearPad(__VA_ARGS__)
-#define setPad(...) palSetPad(__VA_ARGS__)
-#define togglePad(...) palTogglePad(__VA_ARGS__)
-#define configurePad(...)  palSetPadMode(__VA_ARGS__)
-#define configureGroup(...)  palSetGroupMode(__VA_ARGS__)
-
-/*  Discrete Digital Outputs  */
-#define GREEN_LED   GPIOB,GPIOB_LED3
-#define BLUE_LED    GPIOB,GPIOB_LED4
-#define BUZZER      GPIOC,9
-#define CHARGER     GPIOC,8
-
-/* Only PA4 and PA5 can be used for analog output
-    PA4 = Charger voltage set point
-*/
-#define ANALOGOUTS    GPIOA, 0x1, 4
-
 
-/* The pins PC0 - 2 are analog inputs
-    PC0 = High Voltage
-    PC1 = Charger voltage setpoint feedback
-    PC2 = Overvoltage from celltops
-*/
-#define ANALOGINS_C    GPIOC, 0x7, 0
+/*
+ * Alternative sampling profiles selectable from the serial port
+ */
+static const SamplingProfile quietSampling = {  //less noise, more latency
+  5, ADCmaxDepth, ADC_SAMPLE_96, ADC_SAMPLE_192
+};
+static const SamplingProfile fastSampling = {  //less latency, more noise
+  100, 16, ADC_SAMPLE_16, ADC_SAMPLE_96
+};
 
-/* The pins PA1 - 2 are also analog inputs
-    PA1 = Charger Current Sensor VCC/2 (nominally 2.5V)
-    PA2 = Charger Current Sensor (proportional to PA1)
-*/
-#define ANALOGINS_A    GPIOA, 0x3, 1
 
-/* Total number of channels to be sampled by a single ADC operation.*/
-#define ADCchannels   6
+/*
+ * Protection limits
+ */
+#define overcurrentAmps  25.0f  /* trip charger above this current */
+#define overcurrentCounts  \
+          ((uint16_t)(ampVnom - overcurrentAmps / (ampScale*ampDepth)))
+#define celltopColumn    3      /* PC2 position in each sample row */
+#define celltopLimit     2048   /* trip charger above these PC2 counts */
 
-/* Depth of the conversion buffer, channels are sampled sixteen times each.*/
-#define ADCdepth      64
+#define faultPost        2      /* frames captured after a fault */
 
-#define ADCsamples    (ADCchannels*ADCdepth)
 
 /*
- * Raw ADC sample buffer.
+ * Nonzero to also compute Amps with the original soft-float expression
+ * and report its cost and any disagreement with the fixed point result
  */
-adcsample_t analogSample[2*ADCsamples];
+#define ampFloatCheck 0
 
 /*
- * Generate ADCsamples pulses every 1/20second
+ * Nonzero to also accumulate with the scalar kernel when ADCaccumSWAR is set
+ * and report its cost and any disagreement with the SWAR sums
  */
-#define adcTimeBase 8000000
-#define adcTimerDivisor (adcTimeBase/(20*ADCdepth))
+#define accumCheck 0
+
+
+static unsigned totalSamples = 0, totalErrs = 0, count = 0;
 
-#if adcTimerDivisor >= 1<<16
-#error  adcTimerDivisor too large
+#if accumCheck
+static halrtcnt_t scalarCycles; //CPU cycles for last scalar accumulation
+static unsigned accumMismatches = 0;
 #endif
+#if ampFloatCheck
+static halrtcnt_t floatCycles;  //CPU cycles for last soft-float conversion
+static unsigned ampMismatches = 0;  //# of results differing by more than 1mA
+#endif
+
+static FrameQueue analogFrames;  //completed ADC frames awaiting processing
 
+static TelemetryFrame snapshot(uint32_t seq, int32_t mA, bool_t charging)
 /*
- * ADC conversion group.
- * Mode:        Linear buffer, 4 samples of 2 channels, SW triggered.
- * Channels:    IN10, IN11, IN12, IN13   (16 cycles sample time)
+  return snapshot of the frame just processed
+*/
+{
+  TelemetryFrame t;
+  unsigned chan;
+  t.seq = seq;
+  t.time = chTimeNow();
+  for(chan=0; chan < ADCchannels; chan++)
+    t.adc[chan] = pipeline.adc[chan];
+  t.dac = DAC->DOR1;
+  t.dropped = frameqDropped(&analogFrames);
+  t.mA = mA;
+  t.flags = (charging ? telCharging : 0) |
+            (pipeline.charger.mode == chargeCV ? telCV : 0);
+  return t;
+}
+
+static void reportDecimation(const SamplingProfile *profile)
+{
+  unsigned rowRate = profile->rate * profile->depth;
+  debugPrint("Decimating to %d and %d samples/s",
+    decimatorFastRate(&pipeline.decimator, rowRate),
+    decimatorSlowRate(&pipeline.decimator, rowRate));
+}
+
+static void adcErr(ADCDriver *adcp, adcerror_t err)
+{
+  (void)adcp;
+  totalErrs++;  //restart app if this occurs
+  trace(traceAdcError, err);
+  chSysLockFromIsr();
+  faultTriggerI(faultAdcError, 0, halGetCounterValue());
+  chSysUnlockFromIsr();
+}
+
+static void adcDone(ADCDriver *adcp, adcsample_t *buffer, size_t n)
+{
+  (void)adcp;
+  /* Queue frame for the analog procesing thread */
+  trace(traceFrame, analogFrames.seq);
+  chSysLockFromIsr();
+  faultFrameI(buffer, n, analogFrames.seq);
+  if (awdScanI(buffer, n, celltopColumn, 0, celltopLimit))
+    faultTriggerI(faultTrip, celltopColumn, halGetCounterValue());
+  frameqPutI(&analogFrames, buffer, n);
+  chSysUnlockFromIsr();
+}
+
+
+static void changeSampling(const SamplingProfile *profile)
+/*
+  switch to a new sampling profile and report the result
+*/
+{
+  int err = samplingSet(profile, &analogFrames);
+  if (err)
+    debugPrint("Sampling profile rejected (%d)", err);
+  else{
+    debugPrint("Sampling %d frames/s, %d rows, sample times %d,%d",
+      profile->rate, profile->depth, profile->sampleTime, profile->sensorTime);
+    pipelineRate(profile->rate * profile->depth);
+    reportDecimation(profile);
+  }
+}
+
+
+/*
+ * Serial commands (see command.h)
  */
-#define adcSampleTime    ADC_SAMPLE_16
-#define sensorSampleTime ADC_SAMPLE_96  /* must sample temp sensor for at least 10us */
+static const SamplingProfile *volatile newProfile;  //for the frame loop
+static volatile int32_t dacOverride = -1;  //fixed DAC output if >= 0
 
- //Timer 6 trigger
-#define adcTrigger (ADC_CR2_EXTSEL_1 | ADC_CR2_EXTSEL_3 | ADC_CR2_EXTEN_0)
-#define adcTimer STM32_TIM6
-#define adcTimerClkRate  STM32_PCLK1
-#define enableAdcTimer() rccEnableAPB1(RCC_APB1ENR_TIM6EN, FALSE)
-#define disableAdcTimer() rccDisableAPB1(RCC_APB1ENR_TIM6EN, FALSE)
+static void shutdown(void)
+/*
+  turn off the charger immediately
+*/
+{
+  clearPad(CHARGER);
+  trace(traceCharger, 0);
+  awdDisarm();
+}
 
+static const char *offCmd(const char *args)
+{
+  (void)args;
+  shutdown();
+  return NULL;
+}
 
-/* ADC counts to Amps converison factors */
-#define ampScale   1.89e-4f /* ADC counts per amp / ADCdepth */
-#define ampVoffset 0        /* ADCdepth * (ADC counts @ zero current - Vcc/2) */
-#define ampVnom    3124     /* nominal Vcc/2 ADC counts */
-#define ampTnom    611      /* nominal temperature ADC counts */
-#define ampToffset 0.0f     /* offset change per temperature count */
-#define ampTscale  0.0f     /* scale gain change per temperature count */
+static const char *onCmd(const char *args)
+{
+  (void)args;
+  if (chTimeNow() <= 5000)
+    return "too soon after reset";
+  awdArm(ADC_CHANNEL_IN2, overcurrentCounts, 0xfff);
+  setPad(CHARGER);
+  trace(traceCharger, 1);
+  return NULL;
+}
 
+static const char *sample(const SamplingProfile *profile)
+{
+  if (newProfile)
+    return "sampling change pending";
+  newProfile = profile;
+  return NULL;
+}
 
-static unsigned totalSamples = 0, totalErrs = 0, count = 0;
+static const char *normalCmd(const char *args)
+{
+  (void)args;
+  return sample(&defaultSampling);
+}
 
-static Thread *waitingAnalogThread = NULL;
+static const char *quietCmd(const char *args)
+{
+  (void)args;
+  return sample(&quietSampling);
+}
 
-static void adcDone(ADCDriver *adcp, adcsample_t *buffer, size_t n);
+static const char *fastCmd(const char *args)
+{
+  (void)args;
+  return sample(&fastSampling);
+}
 
-static void adcErr(ADCDriver *adcp, adcerror_t err)
+static const char *recordCmd(const char *args)
 {
-  (void)adcp; (void)err;
-  totalErrs++;  //restart app if this occurs
+  (void)args;
+  reportMode(reportRecord);
+  return NULL;
 }
 
-static INLINE void setAdcTimebase(uint32_t hz)
+static const char *telemetryCmd(const char *args)
 {
-  adcTimer->PSC = (uint16_t)((adcTimerClkRate / hz) - 1);
+  (void)args;
+  reportMode(reportTelemetry);
+  return NULL;
 }
 
-/**
- * @brief   Starts the timer in continuous mode.
- */
-static INLINE void startAdcTimer(uint16_t interval) {
-  stm32_tim_t *tim = adcTimer;
-  tim->ARR   = interval - 1;              /* Time constant.           */
-  tim->EGR   = STM32_TIM_EGR_UG;          /* Update event.            */
-  tim->CNT   = 0;                         /* Reset counter.           */
-  tim->DIER  = 0;        /* no interrupts enabled */
-  tim->CR2   = STM32_TIM_CR2_MMS(2);      /* output TRGO pulse on update  */
-  tim->CR1   = STM32_TIM_CR1_URS | STM32_TIM_CR1_CEN;
+static const char *scopeCmd(const char *args)
+{
+  (void)args;
+  reportMode(reportScope);
+  return NULL;
 }
 
-static const ADCConversionGroup adcgrpcfg = {
-  TRUE,
-  ADCchannels,
-  adcDone,
-  adcErr,
-  /* HW dependent part.*/
-  0,                          /* CR1 */
-  adcTrigger,                 /* CR2 -- trigger */
-  0,
-  ADC_SMPR2_SMP_SENSOR(sensorSampleTime) |
-  ADC_SMPR2_SMP_AN10(adcSampleTime) | ADC_SMPR2_SMP_AN11(adcSampleTime) |
-   ADC_SMPR2_SMP_AN12(adcSampleTime),
-  ADC_SMPR3_SMP_AN1(adcSampleTime) | ADC_SMPR3_SMP_AN2(adcSampleTime),
-  ADC_SQR1_NUM_CH(ADCchannels),
-  0,
-  0,
-  0,
-  ADC_SQR5_SQ1_N(ADC_CHANNEL_SENSOR) |
-   ADC_SQR5_SQ2_N(ADC_CHANNEL_IN10) | ADC_SQR5_SQ3_N(ADC_CHANNEL_IN11) |
-   ADC_SQR5_SQ4_N(ADC_CHANNEL_IN12) |
-   ADC_SQR5_SQ5_N(ADC_CHANNEL_IN1) | ADC_SQR5_SQ6_N(ADC_CHANNEL_IN2)
-};
+static const char *faultCmd(const char *args)
+/*
+  args are:  {arm {post {triggers}} | trig | win column {low high} | dump}
+    arm empties the ring and arms the hex mask of triggers (see fault.h),
+      which are unchanged if omitted
+    trig fires the command trigger
+    win sets or (without limits) clears a column's threshold window
+    dump downloads the frozen ring as raw frame records
+  replies with the capture's status
+*/
+{
+  FaultCapture cap;
+  faultLastCapture(&cap);
+  char *end;
+  if (!strncmp(args, "arm", 3)) {
+    unsigned post = strtoul(args+3, &end, 10);
+    if (end == args+3)
+      post = cap.post;
+    const char *arg = end;
+    unsigned triggers = strtoul(arg, &end, 16);
+    if (!faultArm(post, end == arg ? cap.triggers : triggers))
+      return "too many post-trigger frames";
+  }else if (!strncmp(args, "trig", 4))
+    faultTrigger(faultCommand, 0, halGetCounterValue());
+  else if (!strncmp(args, "win", 3)) {
+    unsigned column = strtoul(args+3, &end, 10);
+    if (end == args+3 || column >= ADCchannels)
+      return "no such column";
+    const char *arg = end;
+    unsigned long low = strtoul(arg, &end, 0);
+    if (end == arg)
+      faultWindow(column, 1, 0);
+    else{
+      arg = end;
+      unsigned long high = strtoul(arg, &end, 0);
+      if (end == arg || low > high || high > 0xfff)
+        return "invalid window";
+      faultWindow(column, low, high);
+    }
+  }else if (!strncmp(args, "dump", 4)) {
+    commandReply(" sending %d frames", reportCapture());
+    return NULL;
+  }else if (*args)
+    return "unknown fault subcommand";
+  faultLastCapture(&cap);
+  commandReply(" triggers=%x post=%d frames=%d/%d",
+               cap.triggers, cap.post, cap.frames, cap.capacity);
+  if (cap.cause)
+    commandReply(" cause=%x col=%d seq=%d", cap.cause, cap.column, cap.seq);
+  if (cap.frozen)
+    commandReply(" froze=%dns", commandNanoseconds(cap.latency));
+  return NULL;
+}
 
+static const char *subscribeCmd(const char *args)
+/*
+  args are:  sink {fields {every}}
+    sink is u for SD1 or d for debugPrint
+    fields is a hex mask of text line fields (see report.h)
+    every is the decimation ratio, unchanged if omitted
+*/
+{
+  static const char sinkName[reportSinks+1] = "ud";
+  const char *match = *args ? strchr(sinkName, *args) : NULL;
+  if (!match)
+    return "no such sink";
+  unsigned sink = match - sinkName;
+  Subscription sub = reportSubscription(sink);
+  char *end;
+  unsigned fields = strtoul(args+1, &end, 16);
+  if (end != args+1) {
+    const char *arg = end;
+    unsigned every = strtoul(arg, &end, 10);
+    if (!reportSubscribe(sink, fields, end == arg ? sub.every : every))
+      return "invalid decimation ratio";
+    sub = reportSubscription(sink);
+  }
+  commandReply(" %c=%x/%d", sinkName[sink], sub.fields, sub.every);
+  return NULL;
+}
 
-static void adcDone(ADCDriver *adcp, adcsample_t *buffer, size_t n)
+static const char *dacCmd(const char *args)
+/*
+  args are:  {counts}
+    fix the DAC output at counts, or return it to the charge controller
+*/
+{
+  if (*args) {
+    char *end;
+    unsigned long counts = strtoul(args, &end, 0);
+    const ChargeConfig *cfg = &pipeline.charger.cfg;
+    if (end == args || counts < cfg->dacMin || counts > cfg->dacMax)
+      return "DAC counts out of range";
+    dacOverride = counts;
+  }else
+    dacOverride = -1;
+  int32_t dac = dacOverride;
+  commandReply(" dac=%d", dac >= 0 ? dac : (int32_t)DAC->DOR1);
+  return NULL;
+}
+
+static const char *limit(const char *args, q16 *setpoint, q16 max,
+                         const char *units)
 {
-  (void)n; (void)adcp;
-  DAC->DHR12R1 = (DAC->DOR1+1) & 0xfff;    //update DAC
-  /* Wake any waiting analog procesing thread */
-  if (waitingAnalogThread) {   //indicate which buffer to read
-    chSysLockFromIsr();
-    waitingAnalogThread->p_u.rdymsg = (msg_t) buffer;
-    chSchReadyI(waitingAnalogThread);
-    waitingAnalogThread = NULL;
-    chSysUnlockFromIsr();
+  if (*args) {
+    q16 x;
+    if (!commandQ16(args, &x) || x < 0 || x > max)
+      return "out of range";
+    *setpoint = x;
   }
+  int32_t milli = q16milli(*setpoint);
+  commandReply(" %s=%d.%03d", units, milli/1000, milli%1000);
+  return NULL;
+}
+
+static const char *ampsCmd(const char *args)
+/*
+  args are:  {Amps}
+    set or show the constant current setpoint
+*/
+{
+  return limit(args, &pipeline.charger.cfg.amps,
+               Q16(overcurrentAmps), "A");
 }
 
+static const char *voltsCmd(const char *args)
+/*
+  args are:  {Volts}
+    set or show the constant voltage setpoint
+*/
+{
+  return limit(args, &pipeline.charger.cfg.volts, voltsQ16(4095), "V");
+}
+
+static const char *debugCmd(const char *args)
+/*
+  args are:  {dcc | serial | ram}
+    send debugging output to openocd via DCC, to SD1 among the reports
+    (text reports only, as it would corrupt binary ones), or into
+    debugRAMlog for gdb's debuglog command
+*/
+{
+  static const char *const name[] = {"dcc", "serial", "ram"};
+  static const DebugTransport *const transport[] =
+    {&debugDCC, &debugStream, &debugRAM};
+  static unsigned current;
+  if (*args) {
+    unsigned i;
+    for (i = 0; strcmp(args, name[i]); )
+      if (++i == sizeof name / sizeof *name)
+        return "no such transport";
+    debugTransport(transport[current = i]);
+  }
+  commandReply(" %s", name[current]);
+  return NULL;
+}
+
+static const char *statsCmd(const char *args)
+{
+  (void)args;
+  commandReply(" frames=%d errs=%d dropped=%d torn=%d"
+               " reports=%d/%d/%d/%d cmds=%d/%d/%d/%d off=%d/%dns",
+    totalSamples, totalErrs, frameqDropped(&analogFrames), analogFrames.torn,
+    reportStats.queued, reportStats.decimated, reportStats.dropped,
+    reportStats.unsent, commandStats.lines, commandStats.errors,
+    commandStats.truncated, commandStats.cancelled,
+    commandNanoseconds(commandStats.lastLatency),
+    commandNanoseconds(commandStats.maxLatency));
+  return NULL;
+}
+
+static const char *dccCmd(const char *args)
+{
+  (void)args;
+  commandReply(" dcc=%d/%dus/%d/%d", DCCstats.spins,
+    DCCstats.spinCycles / (halGetCounterFrequency() / 1000000),
+    DCCstats.sleeps, DCCstats.detached);
+  return NULL;
+}
+
+static const Command commands[] = {
+  {"0", offCmd},         //turn off power supply
+  {"1", onCmd},          //turn on power supply
+  {"n", normalCmd},      //normal sampling profile
+  {"q", quietCmd},       //quiet sampling profile
+  {"f", fastCmd},        //fast sampling profile
+  {"r", recordCmd},      //start or stop recording raw frames
+  {"t", telemetryCmd},   //start or stop binary telemetry
+  {"scope", scopeCmd},   //start or stop streaming every raw sample
+  {"s", subscribeCmd},   //change a report subscription
+  {"fault", faultCmd},   //fault capture ring
+  {"dac", dacCmd},       //fix DAC output
+  {"amps", ampsCmd},     //constant current setpoint
+  {"volts", voltsCmd},   //constant voltage setpoint
+  {"debug", debugCmd},   //select debugging output transport
+  {"stats", statsCmd},   //frame, report and command statistics
+  {"dcc", dccCmd},       //debug output (DCC) statistics
+  {NULL}
+};
+
 
 int main(void) {
   halInit();
@@ -165,9 +432,9 @@ int main(void) {
   /*
    *  Disable Power Supply
    */
-  const char *power = "off";
   configurePad(CHARGER, PAL_MODE_OUTPUT_OPENDRAIN);
   clearPad(CHARGER);  //turn off charger ASAP
+  traceInit();  //keeping any events that led up to a warm reset
 
   debugPrintInit(debugOutput);
   const char signon[] = "ZEV Charger v0.14 -- 1/2/14 brent@mbari.org";
@@ -181,6 +448,11 @@ int main(void) {
   configureGroup(GPIOA, 0xf, 9, PAL_MODE_ALTERNATE(7)); //TX,RX,CTS,RTS
 
   chprintf((BaseSequentialStream *)&SD1, "\r\n%s\r\n", signon);
+  debugStreamInit((BaseSequentialStream *)&SD1);
+  debugRAMInit(debugRAMlog, sizeof debugRAMlog);
+  uartdmaInit();
+  reportInit(NORMALPRIO-1);
+  commandInit(commands, shutdown, NORMALPRIO+1);
 
   /*
    *  Piezo buzzer output
@@ -193,95 +465,141 @@ int main(void) {
   configureGroup(ANALOGOUTS, PAL_MODE_INPUT_ANALOG);
   rccEnableAPB1(RCC_APB1ENR_DACEN, FALSE);
   DAC->CR = DAC_CR_EN1;
+  pipelineInit(&defaultCharge, defaultSampling.rate * defaultSampling.depth);
+  DAC->DHR12R1 = pipeline.charger.cfg.dacMin;
 
   /*
-   * Configure Adc Timer
-   */
-  enableAdcTimer();
-  setAdcTimebase(adcTimeBase);
-  startAdcTimer(adcTimerDivisor);
-
-  /*
-   * Initializes the ADC driver 1
+   * Start sampling analog inputs
    */
-  configureGroup(ANALOGINS_C, PAL_MODE_INPUT_ANALOG);
-  configureGroup(ANALOGINS_A, PAL_MODE_INPUT_ANALOG);
-  adcStart(&ADCD1, NULL);
-  adcSTM32EnableTSVREFE();  /* enable temperature sensor */
-  adcStartConversion(&ADCD1, &adcgrpcfg, analogSample, 2*ADCdepth);
+  frameqInit(&analogFrames);
+  reportDecimation(&defaultSampling);
+  awdInit();
+  faultInit(faultPost, faultAllTriggers);
+  samplingStart(&defaultSampling, adcDone, adcErr);
 
   adcsample_t *samples;
-  uint32_t adc[ADCchannels];  //filtered adc inputs
-
+  size_t depth;
+  AwdTrip trip;
+  unsigned reportedTrips = 0;
+  FaultCapture capture;
+  bool_t reportedCapture = FALSE;
+#if ampFloatCheck
+  const uint32_t *adc = pipeline.adc;  //filtered adc inputs
+#endif
   while (1) {
-    int key;
-
-    while ((key = chnGetTimeout(&SD1, TIME_IMMEDIATE)) != Q_TIMEOUT)
-      if (!(key & ~0x7f)) {
-        switch (key) {
-          case '0':  //turn off power supply
-            clearPad(CHARGER);
-            power = "off";
-            break;
-          case '1':  //turn on power supply
-            if (chTimeNow() > 5000) {
-              setPad(CHARGER);
-              power = "ON ";
-            }
-            break;
-        }
-      }
+    const SamplingProfile *profile = newProfile;
+    if (profile) {  //as requested by serial command
+      changeSampling(profile);
+      newProfile = NULL;
+    }
+
+    if (awdLastTrip(&trip) != reportedTrips) {
+      reportedTrips = trip.trips;
+      faultTrigger(faultTrip, trip.channel, trip.stamp);
+      debugPrint("Trip #%d: %s ch%d, %dns after trigger, %d cycles in ISR",
+        trip.trips, trip.source == awdHardware ? "watchdog" : "frame scan",
+        trip.channel, trip.latency, trip.isrCycles);
+    }
+
+    faultLastCapture(&capture);
+    if (capture.frozen != reportedCapture) {
+      reportedCapture = capture.frozen;
+      if (reportedCapture)
+        debugPrint("Fault capture: trigger %x col%d in #%d, froze %dns later, %d frames",
+          capture.cause, capture.column, capture.seq,
+          commandNanoseconds(capture.latency), capture.frames);
+    }
 
     clearPad(GREEN_LED);
     clearPad(BUZZER);
 
     /* Wait for ADC conversions to complete */
-    chSysLock();
-    waitingAnalogThread = chThdSelf();
-    chSchGoSleepS(THD_STATE_SUSPENDED);
-    samples = (adcsample_t *)(chThdSelf()->p_u.rdymsg);
-    chSysUnlock();
+    const AnalogFrame *frame = frameqGet(&analogFrames);
+    samples = frame->samples;
+    depth = frame->depth;
 
     totalSamples++;
     if (samples==analogSample) {
       setPad(GREEN_LED);
       setPad(BUZZER);
     }
-    /* Calculate the sum of values for each ADC channel.*/
-    unsigned chan;
-    adcsample_t *end = samples + ADCsamples;
-    for(chan=0; chan < ADCchannels; chan++) {
-      adcsample_t *row = samples+chan;
-      uint32_t *cursor = adc+chan;
-      *cursor=0;
-      do {
-        *cursor += *row;
-        row += ADCchannels;
-      } while (row < end);
-      *cursor /= ADCdepth;  //avg just for display for now
-    }
-    /* average the current represented by the last channel to best filter VCC noise */
-    int32_t current = 0;
+    /* Filter, convert and regulate charger output */
+    pipelineFrame(samples, depth);
+#if accumCheck
     {
-      adcsample_t *currentRow = samples+5;
-      do {
-        current += currentRow[-1] - currentRow[0]; /* vcc/2 - current */
-        currentRow += ADCchannels;
-      } while (currentRow < end);
+      ChannelSums scalar;
+      halrtcnt_t accumStart = halGetCounterValue();
+      accumulateScalar(&scalar, samples, depth);
+      scalarCycles = halGetCounterValue() - accumStart;
+      if (memcmp(&scalar, &pipeline.sums, sizeof(scalar)))
+        accumMismatches++;
     }
-
+#endif
+    bool_t charging = padLatched(CHARGER);
+    uint16_t dac = pipelineControl(charging);
+    int32_t fixedDac = dacOverride;
+    if (fixedDac >= 0)
+      dac = fixedDac;
+    DAC->DHR12R1 = dac;
+    int32_t mA = q16milli(pipeline.amps);
+    {  //queue report on SD1 without waiting for it
+      TelemetryFrame t = snapshot(totalSamples, mA, charging);
+      reportFrame(&t, dac, frame);
+    }
+    faultScan(frame);
+    frameqRelease(&analogFrames, frame);  //done with raw samples
+#if ampFloatCheck
+    halrtcnt_t convStart = halGetCounterValue();
     float deltaT = adc[0] - ampTnom;
-    float amps = ((float)ampVnom / (float)adc[4]) * (ampScale+(ampTscale*deltaT)) *
-       ((float)(current+ampVoffset)+(ampToffset*deltaT));
+    float ampsF = ((float)ampVnom / (float)adc[4]) * (ampScale+(ampTscale*deltaT)) *
+       ((float)pipeline.sums.current*ampDepth/depth+ampVoffset+(ampToffset*deltaT));
+    floatCycles = halGetCounterValue() - convStart;
+    int32_t mAdiff = mA - (int32_t)(ampsF*1000.0f + (ampsF < 0 ? -0.5f : 0.5f));
+    if (mAdiff > 1 || mAdiff < -1)
+      ampMismatches++;
+#endif
 
-    chprintf((BaseSequentialStream *)&SD1,
-    "#%d:%s: Vcmd=%d,Vin=%d,VcmdIn=%d,Thres=%d, C=%d,Vcc/2=%d,curr=%d,A=%f\r\n",
-	 totalSamples, power, DAC->DOR1, adc[1], adc[2], adc[3], adc[0], adc[4], adc[5], amps);
     if (++count >= 10) {
-      debugPrint(
-        "@%d#%d:%s:Vcmd=%d,Vin=%d,VcmdIn=%d,Thres=%d, C=%d,Vcc/2=%d,curr=%d,A=%f (%d errs)",
-        chTimeNow(), totalSamples, power, DAC->DOR1,
-                      adc[1], adc[2], adc[3], adc[0], adc[4], adc[5], amps, totalErrs);
+      debugPrint("Frames: %d errs, %d dropped, %d torn", totalErrs,
+                 frameqDropped(&analogFrames), analogFrames.torn);
+#if ampFloatCheck
+      debugPrint("Cycles: accum=%d, decim=%d, Amps=%d fixed, %d float, %d saved/frame, %d mismatches, ctl=%d",
+                 pipeline.accumCycles, pipeline.decimCycles,
+                 pipeline.convCycles, floatCycles,
+                 floatCycles-pipeline.convCycles, ampMismatches,
+                 pipeline.ctlCycles);
+#else
+      debugPrint("Cycles: accum=%d, decim=%d, Amps=%d, ctl=%d (%s)",
+                 pipeline.accumCycles, pipeline.decimCycles,
+                 pipeline.convCycles, pipeline.ctlCycles,
+                 pipeline.charger.mode == chargeCV ? "CV" : "CC");
+#endif
+      {  //filtered streams are in 1/4 ADC counts
+        const DecimatedSample *slowest = &pipeline.slowest;
+        uint32_t vcc2 = slowest->chan[4]/4, temp = slowest->chan[0]/4;
+        debugPrint("Filtered: %dmA, fast peak %dmA, %d slow samples",
+          q16milli(ampsQ16(slowest->current, 4, vcc2, temp)),
+          q16milli(ampsQ16(pipeline.fastPeak, 4, vcc2, temp)), slowest->seq);
+        pipeline.fastPeak = 0;
+      }
+      {
+        UartdmaStats io;
+        uartdmaStats(&io);
+        debugPrint("Serial ISRs: %d in %d cycles, DMA ISRs: %d in %d cycles, %d dropped",
+                   io.serial.irqs, io.serial.cycles, io.dma.irqs, io.dma.cycles,
+                   io.dropped);
+      }
+      debugPrint("Reports: %d queued, %d decimated, %d dropped, %d unsent, %d cycles/line",
+                 reportStats.queued, reportStats.decimated, reportStats.dropped,
+                 reportStats.unsent, reportStats.textCycles);
+#if textCheck
+      debugPrint("Text: %d cycles by chprintf, %d mismatches",
+                 reportStats.printfCycles, reportStats.textMismatches);
+#endif
+#if accumCheck
+      debugPrint("Accum: %d cycles SWAR, %d scalar, %d mismatches",
+                 pipeline.accumCycles, scalarCycles, accumMismatches);
+#endif
       count = 0;
     }
   }